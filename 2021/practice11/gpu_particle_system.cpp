@@ -0,0 +1,272 @@
+#include "gpu_particle_system.hpp"
+
+#include <cmath>
+#include <cstddef>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace
+{
+
+	const char update_shader_source[] =
+R"(#version 330 core
+
+uniform float dt;
+uniform float damping;
+uniform vec3 velocity_change;
+uniform uint frame;
+
+uniform vec3 emitter_position;
+uniform float emitter_radius;
+uniform vec2 speed_range;
+uniform float spread;
+uniform vec2 lifetime_range;
+uniform vec2 size_range;
+
+layout (location = 0) in vec3 in_position;
+layout (location = 1) in vec3 in_velocity;
+layout (location = 2) in float in_age;
+layout (location = 3) in float in_lifetime;
+layout (location = 4) in float in_size;
+layout (location = 5) in uint in_color;
+
+out vec3 out_position;
+out vec3 out_velocity;
+out float out_age;
+out float out_lifetime;
+out float out_size;
+flat out uint out_color;
+
+const float pi = 3.141592653589793;
+
+uint hash(uint x)
+{
+	x ^= x >> 16;
+	x *= 0x7feb352du;
+	x ^= x >> 15;
+	x *= 0x846ca68bu;
+	x ^= x >> 16;
+	return x;
+}
+
+uint random_state;
+
+float random()
+{
+	random_state = hash(random_state);
+	return float(random_state >> 8) * (1.0 / 16777216.0);
+}
+
+float mix_range(vec2 range, float t)
+{
+	return range.x + (range.y - range.x) * t;
+}
+
+void main()
+{
+	out_velocity = (in_velocity + velocity_change) * damping;
+	out_position = in_position + out_velocity * dt;
+	out_age = in_age + dt;
+	out_lifetime = in_lifetime;
+	out_size = in_size;
+	out_color = in_color;
+
+	if (out_age >= in_lifetime)
+	{
+		// The same random numbers in the same order as particle_system::spawn
+		random_state = hash(uint(gl_VertexID) * 0x9e3779b9u ^ hash(frame));
+
+		float angle = 2.0 * pi * random();
+		float radius = emitter_radius * sqrt(random());
+		out_position = emitter_position + vec3(radius * cos(angle), 0.0, radius * sin(angle));
+
+		float spread_x = spread * (2.0 * random() - 1.0);
+		float spread_z = spread * (2.0 * random() - 1.0);
+		out_velocity = normalize(vec3(spread_x, 1.0, spread_z)) * mix_range(speed_range, random());
+
+		out_age = 0.0;
+		out_lifetime = mix_range(lifetime_range, random());
+		out_size = mix_range(size_range, random());
+
+		uint green = 64u + uint(191.0 * random());
+		uint blue = uint(64.0 * random());
+		out_color = 255u | (green << 8) | (blue << 16) | (255u << 24);
+	}
+}
+)";
+
+	GLuint create_update_program()
+	{
+		GLuint shader = glCreateShader(GL_VERTEX_SHADER);
+		char const * source = update_shader_source;
+		glShaderSource(shader, 1, &source, nullptr);
+		glCompileShader(shader);
+
+		GLint status;
+		glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
+		if (status != GL_TRUE)
+		{
+			GLint info_log_length;
+			glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &info_log_length);
+			std::string info_log(info_log_length, '\0');
+			glGetShaderInfoLog(shader, info_log.size(), nullptr, info_log.data());
+			throw std::runtime_error("Particle update shader compilation failed: " + info_log);
+		}
+
+		GLuint program = glCreateProgram();
+		glAttachShader(program, shader);
+
+		// Captured in the layout of gpu_particle
+		char const * varyings[] = {"out_position", "out_velocity", "out_age", "out_lifetime", "out_size", "out_color"};
+		glTransformFeedbackVaryings(program, std::size(varyings), varyings, GL_INTERLEAVED_ATTRIBS);
+
+		glLinkProgram(program);
+		glDeleteShader(shader);
+
+		glGetProgramiv(program, GL_LINK_STATUS, &status);
+		if (status != GL_TRUE)
+		{
+			GLint info_log_length;
+			glGetProgramiv(program, GL_INFO_LOG_LENGTH, &info_log_length);
+			std::string info_log(info_log_length, '\0');
+			glGetProgramInfoLog(program, info_log.size(), nullptr, info_log.data());
+			throw std::runtime_error("Particle update program linkage failed: " + info_log);
+		}
+
+		return program;
+	}
+
+}
+
+gpu_particle_system::gpu_particle_system()
+	: program_(create_update_program())
+{
+	dt_location_ = glGetUniformLocation(program_, "dt");
+	damping_location_ = glGetUniformLocation(program_, "damping");
+	velocity_change_location_ = glGetUniformLocation(program_, "velocity_change");
+	frame_location_ = glGetUniformLocation(program_, "frame");
+	emitter_position_location_ = glGetUniformLocation(program_, "emitter_position");
+	emitter_radius_location_ = glGetUniformLocation(program_, "emitter_radius");
+	speed_range_location_ = glGetUniformLocation(program_, "speed_range");
+	spread_location_ = glGetUniformLocation(program_, "spread");
+	lifetime_range_location_ = glGetUniformLocation(program_, "lifetime_range");
+	size_range_location_ = glGetUniformLocation(program_, "size_range");
+
+	glGenBuffers(2, buffers_.data());
+	glGenVertexArrays(2, vaos_.data());
+
+	for (int i = 0; i < 2; ++i)
+	{
+		glBindVertexArray(vaos_[i]);
+		glBindBuffer(GL_ARRAY_BUFFER, buffers_[i]);
+
+		for (GLuint location = 0; location < 6; ++location)
+			glEnableVertexAttribArray(location);
+
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(gpu_particle), reinterpret_cast<void *>(offsetof(gpu_particle, position_x)));
+		glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(gpu_particle), reinterpret_cast<void *>(offsetof(gpu_particle, velocity_x)));
+		glVertexAttribPointer(2, 1, GL_FLOAT, GL_FALSE, sizeof(gpu_particle), reinterpret_cast<void *>(offsetof(gpu_particle, age)));
+		glVertexAttribPointer(3, 1, GL_FLOAT, GL_FALSE, sizeof(gpu_particle), reinterpret_cast<void *>(offsetof(gpu_particle, lifetime)));
+		glVertexAttribPointer(4, 1, GL_FLOAT, GL_FALSE, sizeof(gpu_particle), reinterpret_cast<void *>(offsetof(gpu_particle, size)));
+		glVertexAttribIPointer(5, 1, GL_UNSIGNED_INT, sizeof(gpu_particle), reinterpret_cast<void *>(offsetof(gpu_particle, color)));
+	}
+
+	glBindVertexArray(0);
+}
+
+gpu_particle_system::~gpu_particle_system()
+{
+	glDeleteVertexArrays(2, vaos_.data());
+	glDeleteBuffers(2, buffers_.data());
+	glDeleteProgram(program_);
+}
+
+void gpu_particle_system::upload(particle_system const & particles)
+{
+	parameters = particles.parameters;
+	count_ = particles.count();
+	padded_count_ = particles.position_x.size();
+	frame_ = particles.frame();
+
+	std::vector<gpu_particle> data(padded_count_);
+	for (std::size_t i = 0; i < padded_count_; ++i)
+	{
+		data[i] = {
+			particles.position_x[i], particles.position_y[i], particles.position_z[i],
+			particles.velocity_x[i], particles.velocity_y[i], particles.velocity_z[i],
+			particles.age[i],
+			particles.lifetime[i],
+			particles.size[i],
+			particles.color[i],
+		};
+	}
+
+	current_ = 0;
+	for (int i = 0; i < 2; ++i)
+	{
+		glBindBuffer(GL_ARRAY_BUFFER, buffers_[i]);
+		glBufferData(GL_ARRAY_BUFFER, data.size() * sizeof(gpu_particle), i == current_ ? data.data() : nullptr, GL_DYNAMIC_COPY);
+	}
+}
+
+void gpu_particle_system::download(particle_system & particles) const
+{
+	if (particles.position_x.size() != padded_count_)
+		throw std::runtime_error("Particle count mismatch on download");
+
+	std::vector<gpu_particle> data(padded_count_);
+	glBindBuffer(GL_ARRAY_BUFFER, buffers_[current_]);
+	glGetBufferSubData(GL_ARRAY_BUFFER, 0, data.size() * sizeof(gpu_particle), data.data());
+
+	for (std::size_t i = 0; i < padded_count_; ++i)
+	{
+		auto const & p = data[i];
+		particles.position_x[i] = p.position_x;
+		particles.position_y[i] = p.position_y;
+		particles.position_z[i] = p.position_z;
+		particles.velocity_x[i] = p.velocity_x;
+		particles.velocity_y[i] = p.velocity_y;
+		particles.velocity_z[i] = p.velocity_z;
+		particles.age[i] = p.age;
+		particles.lifetime[i] = p.lifetime;
+		particles.size[i] = p.size;
+		particles.color[i] = p.color;
+	}
+}
+
+void gpu_particle_system::update(float dt)
+{
+	++frame_;
+
+	auto const & p = parameters;
+	glm::vec3 const velocity_change = p.gravity * dt;
+
+	glUseProgram(program_);
+	glUniform1f(dt_location_, dt);
+	// Computed here, so that the GPU uses the very same factor as the CPU
+	glUniform1f(damping_location_, std::exp(-p.drag * dt));
+	glUniform3f(velocity_change_location_, velocity_change.x, velocity_change.y, velocity_change.z);
+	glUniform1ui(frame_location_, frame_);
+	glUniform3f(emitter_position_location_, p.emitter_position.x, p.emitter_position.y, p.emitter_position.z);
+	glUniform1f(emitter_radius_location_, p.emitter_radius);
+	glUniform2f(speed_range_location_, p.min_speed, p.max_speed);
+	glUniform1f(spread_location_, p.spread);
+	glUniform2f(lifetime_range_location_, p.min_lifetime, p.max_lifetime);
+	glUniform2f(size_range_location_, p.min_size, p.max_size);
+
+	glEnable(GL_RASTERIZER_DISCARD);
+	glBindVertexArray(vaos_[current_]);
+	glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, buffers_[1 - current_]);
+
+	glBeginTransformFeedback(GL_POINTS);
+	glDrawArrays(GL_POINTS, 0, padded_count_);
+	glEndTransformFeedback();
+
+	glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, 0);
+	glBindVertexArray(0);
+	glDisable(GL_RASTERIZER_DISCARD);
+
+	current_ = 1 - current_;
+}
@@ -0,0 +1,142 @@
+// Runs gpu_particle_system and particle_system side by side over the same sequence of
+// time steps in a surfaceless EGL context, and checks that the state downloaded from
+// the GPU matches the CPU simulation
+
+#include <GL/glew.h>
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+#include <string_view>
+#include <stdexcept>
+#include <iostream>
+#include <algorithm>
+#include <cmath>
+#include <string>
+#include <cstdlib>
+
+#include "job_system.hpp"
+#include "particle_system.hpp"
+#include "gpu_particle_system.hpp"
+
+std::string to_string(std::string_view str)
+{
+	return std::string(str.begin(), str.end());
+}
+
+void egl_fail(std::string_view message)
+{
+	throw std::runtime_error(to_string(message) + std::to_string(eglGetError()));
+}
+
+void create_headless_context()
+{
+	auto get_platform_display = reinterpret_cast<PFNEGLGETPLATFORMDISPLAYEXTPROC>(eglGetProcAddress("eglGetPlatformDisplayEXT"));
+	EGLDisplay display = get_platform_display
+		? get_platform_display(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr)
+		: eglGetDisplay(EGL_DEFAULT_DISPLAY);
+
+	if (!eglInitialize(display, nullptr, nullptr))
+		egl_fail("eglInitialize: ");
+
+	EGLint const config_attributes[] = {EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, EGL_NONE};
+	EGLConfig config;
+	EGLint config_count = 0;
+	if (!eglChooseConfig(display, config_attributes, &config, 1, &config_count))
+		egl_fail("eglChooseConfig: ");
+
+	if (!eglBindAPI(EGL_OPENGL_API))
+		egl_fail("eglBindAPI: ");
+
+	EGLint const context_attributes[] =
+	{
+		EGL_CONTEXT_MAJOR_VERSION, 3,
+		EGL_CONTEXT_MINOR_VERSION, 3,
+		EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+		EGL_NONE,
+	};
+	EGLContext context = eglCreateContext(display, config_count > 0 ? config : EGL_NO_CONFIG_KHR, EGL_NO_CONTEXT, context_attributes);
+	if (context == EGL_NO_CONTEXT)
+		egl_fail("eglCreateContext: ");
+
+	if (!eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context))
+		egl_fail("eglMakeCurrent: ");
+
+	// A GLEW built for GLX reports a missing GLX display after it has already
+	// loaded the core entry points, so check for the functions themselves
+	glewExperimental = GL_TRUE;
+	glewInit();
+	if (!glTransformFeedbackVaryings || !glGenFramebuffers)
+		throw std::runtime_error("glewInit: OpenGL 3.3 entry points are missing");
+
+	// There is no default framebuffer without a surface
+	GLuint framebuffer, renderbuffer;
+	glGenFramebuffers(1, &framebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	glGenRenderbuffers(1, &renderbuffer);
+	glBindRenderbuffer(GL_RENDERBUFFER, renderbuffer);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, 1, 1);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, renderbuffer);
+}
+
+int main() try
+{
+	std::size_t const particle_count = 100'000;
+	int const frames = 300;
+	float const tolerance = 1e-4f;
+
+	create_headless_context();
+
+	job_system jobs;
+	particle_system cpu(particle_count);
+	particle_system from_gpu(particle_count);
+
+	gpu_particle_system gpu;
+	gpu.upload(cpu);
+
+	// Varying time steps, long enough for every particle to respawn a few times
+	for (int frame = 0; frame < frames; ++frame)
+	{
+		float const dt = 1.f / 60.f + 0.002f * std::sin(frame * 0.3f);
+		cpu.update(dt, jobs);
+		gpu.update(dt);
+	}
+
+	gpu.download(from_gpu);
+
+	if (auto error = glGetError(); error != GL_NO_ERROR)
+		throw std::runtime_error("OpenGL error " + std::to_string(error));
+
+	float max_difference = 0.f;
+	std::size_t mismatched = 0;
+	std::size_t color_mismatched = 0;
+	for (std::size_t i = 0; i < cpu.count(); ++i)
+	{
+		float const difference = std::max({
+			std::abs(cpu.position_x[i] - from_gpu.position_x[i]),
+			std::abs(cpu.position_y[i] - from_gpu.position_y[i]),
+			std::abs(cpu.position_z[i] - from_gpu.position_z[i]),
+			std::abs(cpu.velocity_x[i] - from_gpu.velocity_x[i]),
+			std::abs(cpu.velocity_y[i] - from_gpu.velocity_y[i]),
+			std::abs(cpu.velocity_z[i] - from_gpu.velocity_z[i]),
+			std::abs(cpu.age[i] - from_gpu.age[i]),
+			std::abs(cpu.lifetime[i] - from_gpu.lifetime[i]),
+			std::abs(cpu.size[i] - from_gpu.size[i]),
+		});
+
+		max_difference = std::max(max_difference, difference);
+		if (!(difference <= tolerance))
+			++mismatched;
+		if (cpu.color[i] != from_gpu.color[i])
+			++color_mismatched;
+	}
+
+	std::cout << cpu.count() << " particles, " << frames << " frames: max difference " << max_difference
+		<< ", " << mismatched << " particles above " << tolerance << ", " << color_mismatched << " color mismatches" << std::endl;
+
+	return (mismatched == 0 && color_mismatched == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+catch (std::exception const & e)
+{
+	std::cerr << e.what() << std::endl;
+	return EXIT_FAILURE;
+}
@@ -0,0 +1,146 @@
+#include "job_system.hpp"
+
+namespace
+{
+
+	// Queue of the current thread in the system it belongs to
+	thread_local job_system const * current_system = nullptr;
+	thread_local std::size_t current_index = 0;
+
+}
+
+job_system::job_system(std::size_t worker_count)
+{
+	for (std::size_t i = 0; i <= worker_count; ++i)
+		queues_.push_back(std::make_unique<queue>());
+
+	current_system = this;
+	current_index = 0;
+
+	for (std::size_t i = 1; i <= worker_count; ++i)
+		workers_.emplace_back([this, i]{ worker_loop(i); });
+}
+
+job_system::~job_system()
+{
+	{
+		std::lock_guard<std::mutex> lock(sleep_mutex_);
+		stop_ = true;
+	}
+	sleep_condition_.notify_all();
+
+	for (auto & worker : workers_)
+		worker.join();
+
+	if (current_system == this)
+		current_system = nullptr;
+}
+
+std::size_t job_system::current_queue() const
+{
+	// Threads outside of the system hand their jobs to the creating thread's queue
+	return current_system == this ? current_index : 0;
+}
+
+void job_system::run(job_counter & counter, std::function<void()> function)
+{
+	counter.pending.fetch_add(1, std::memory_order_relaxed);
+
+	{
+		auto & q = *queues_[current_queue()];
+		std::lock_guard<std::mutex> lock(q.mutex);
+		q.jobs.push_back({std::move(function), &counter});
+	}
+
+	queued_.fetch_add(1, std::memory_order_release);
+
+	// Taking the lock orders the push before a worker's check for work
+	{
+		std::lock_guard<std::mutex> lock(sleep_mutex_);
+	}
+	sleep_condition_.notify_one();
+}
+
+void job_system::wait(job_counter & counter)
+{
+	std::size_t const index = current_queue();
+	while (!counter.done())
+		if (!try_run_one(index))
+			std::this_thread::yield();
+
+	std::exception_ptr error;
+	{
+		std::lock_guard<std::mutex> lock(counter.error_mutex);
+		std::swap(error, counter.error);
+	}
+	if (error)
+		std::rethrow_exception(error);
+}
+
+bool job_system::try_run_one(std::size_t index)
+{
+	job j;
+	bool found = false;
+
+	{
+		// Own jobs are taken newest first, while they are still in cache
+		auto & q = *queues_[index];
+		std::lock_guard<std::mutex> lock(q.mutex);
+		if (!q.jobs.empty())
+		{
+			j = std::move(q.jobs.back());
+			q.jobs.pop_back();
+			found = true;
+		}
+	}
+
+	// Others' jobs are stolen oldest first, as those tend to be the biggest ones
+	for (std::size_t k = 1; k < queues_.size() && !found; ++k)
+	{
+		auto & q = *queues_[(index + k) % queues_.size()];
+		std::lock_guard<std::mutex> lock(q.mutex);
+		if (!q.jobs.empty())
+		{
+			j = std::move(q.jobs.front());
+			q.jobs.pop_front();
+			found = true;
+		}
+	}
+
+	if (!found)
+		return false;
+
+	queued_.fetch_sub(1, std::memory_order_relaxed);
+
+	// An exception must not leave a worker thread, nor keep the job from being counted as done
+	try
+	{
+		j.function();
+	}
+	catch (...)
+	{
+		std::lock_guard<std::mutex> lock(j.counter->error_mutex);
+		if (!j.counter->error)
+			j.counter->error = std::current_exception();
+	}
+
+	j.counter->pending.fetch_sub(1, std::memory_order_release);
+	return true;
+}
+
+void job_system::worker_loop(std::size_t index)
+{
+	current_system = this;
+	current_index = index;
+
+	while (true)
+	{
+		if (try_run_one(index))
+			continue;
+
+		std::unique_lock<std::mutex> lock(sleep_mutex_);
+		sleep_condition_.wait(lock, [this]{ return stop_ || queued_.load(std::memory_order_acquire) > 0; });
+		if (stop_)
+			return;
+	}
+}
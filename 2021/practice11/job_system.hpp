@@ -0,0 +1,93 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Number of jobs started with it and not finished yet. A job may start child jobs
+// with its own counter and wait for them: waiting never blocks a worker, it runs
+// other jobs meanwhile, so jobs can be nested arbitrarily deep
+struct job_counter
+{
+	std::atomic<std::size_t> pending{0};
+
+	// The first exception thrown by one of the jobs, rethrown by job_system::wait
+	std::mutex error_mutex;
+	std::exception_ptr error;
+
+	bool done() const
+	{
+		return pending.load(std::memory_order_acquire) == 0;
+	}
+};
+
+// Work-stealing job system: every thread pushes and pops its own jobs at the back
+// of its deque, and idle threads steal from the front of the others' deques.
+// The thread that created the system takes part in the work while waiting
+struct job_system
+{
+	// hardware_concurrency - 1 workers by default, as the creating thread works too
+	explicit job_system(std::size_t worker_count = std::max(std::thread::hardware_concurrency(), 1u) - 1);
+	~job_system();
+
+	job_system(job_system const &) = delete;
+	job_system & operator = (job_system const &) = delete;
+
+	// Including the creating thread
+	std::size_t thread_count() const { return queues_.size(); }
+
+	void run(job_counter & counter, std::function<void()> job);
+
+	// Runs jobs until the counter drops to zero. A job that throws still counts as finished;
+	// once all of them are, the first exception is rethrown and cleared from the counter
+	void wait(job_counter & counter);
+
+	// Calls function(begin, end) for consecutive ranges of at most grain_size
+	// items covering [0, count), and waits for all of them
+	template <typename Function>
+	void parallel_for(std::size_t count, std::size_t grain_size, Function const & function)
+	{
+		job_counter counter;
+		for (std::size_t begin = 0; begin < count; begin += grain_size)
+		{
+			std::size_t const end = std::min(begin + grain_size, count);
+			run(counter, [&function, begin, end]{ function(begin, end); });
+		}
+		wait(counter);
+	}
+
+private:
+	struct job
+	{
+		std::function<void()> function;
+		job_counter * counter;
+	};
+
+	struct alignas(64) queue
+	{
+		std::mutex mutex;
+		std::deque<job> jobs;
+	};
+
+	// queues_[0] belongs to the creating thread, queues_[i] to workers_[i - 1]
+	std::vector<std::unique_ptr<queue>> queues_;
+	std::vector<std::thread> workers_;
+
+	// Jobs in all queues, for idle workers to know when to go to sleep
+	std::atomic<std::size_t> queued_{0};
+	std::mutex sleep_mutex_;
+	std::condition_variable sleep_condition_;
+	bool stop_ = false;
+
+	std::size_t current_queue() const;
+	bool try_run_one(std::size_t index);
+	void worker_loop(std::size_t index);
+};
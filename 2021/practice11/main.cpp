@@ -14,9 +14,10 @@
 #include <vector>
 #include <map>
 #include <cmath>
+#include <cstddef>
 #include <fstream>
 #include <sstream>
-#include <random>
+#include <algorithm>
 
 #define GLM_FORCE_SWIZZLE
 #define GLM_ENABLE_EXPERIMENTAL
@@ -28,6 +29,10 @@
 #include <glm/gtx/quaternion.hpp>
 #include <glm/gtx/string_cast.hpp>
 
+#include "particle_system.hpp"
+#include "gpu_particle_system.hpp"
+#include "spatial_grid.hpp"
+
 std::string to_string(std::string_view str)
 {
 	return std::string(str.begin(), str.end());
@@ -46,11 +51,21 @@ void glew_fail(std::string_view message, GLenum error)
 const char vertex_shader_source[] =
 R"(#version 330 core
 
-layout (location = 0) in vec3 in_position;
+// Particle attributes come from separate arrays
+layout (location = 0) in float in_position_x;
+layout (location = 1) in float in_position_y;
+layout (location = 2) in float in_position_z;
+layout (location = 3) in float in_size;
+layout (location = 4) in vec4 in_color;
+
+out float size;
+out vec4 color;
 
 void main()
 {
-	gl_Position = vec4(in_position, 1.0);
+	gl_Position = vec4(in_position_x, in_position_y, in_position_z, 1.0);
+	size = in_size;
+	color = in_color;
 }
 )";
 
@@ -60,14 +75,23 @@ R"(#version 330 core
 uniform mat4 model;
 uniform mat4 view;
 uniform mat4 projection;
+// Pixels per world unit at unit distance
+uniform float point_scale;
 
 layout (points) in;
 layout (points, max_vertices = 1) out;
 
+in float size[];
+in vec4 color[];
+
+out vec4 point_color;
+
 void main()
 {
 	vec3 center = gl_in[0].gl_Position.xyz;
 	gl_Position = projection * view * model * vec4(center, 1.0);
+	gl_PointSize = max(1.0, size[0] * point_scale / gl_Position.w);
+	point_color = color[0];
 	EmitVertex();
 	EndPrimitive();
 }
@@ -77,11 +101,44 @@ void main()
 const char fragment_shader_source[] =
 R"(#version 330 core
 
+in vec4 point_color;
+
 layout (location = 0) out vec4 out_color;
 
 void main()
 {
-	out_color = vec4(1.0, 0.0, 0.0, 1.0);
+	out_color = point_color;
+}
+)";
+
+const char quad_vertex_shader_source[] =
+R"(#version 330 core
+
+uniform mat4 model;
+uniform mat4 view;
+uniform mat4 projection;
+// Pixels per world unit at unit distance
+uniform float point_scale;
+
+// Per instance, from the same arrays as the points
+layout (location = 0) in float in_position_x;
+layout (location = 1) in float in_position_y;
+layout (location = 2) in float in_position_z;
+layout (location = 3) in float in_size;
+layout (location = 4) in vec4 in_color;
+
+out vec4 point_color;
+
+// Triangle strip corners, so that no per-vertex buffer is needed
+const vec2 corners[4] = vec2[4](vec2(-1.0, -1.0), vec2(1.0, -1.0), vec2(-1.0, 1.0), vec2(1.0, 1.0));
+
+void main()
+{
+	vec4 center = view * model * vec4(in_position_x, in_position_y, in_position_z, 1.0);
+	// As large as the points, which are at least a pixel wide
+	float half_size = 0.5 * max(in_size, -center.z / point_scale);
+	gl_Position = projection * (center + vec4(corners[gl_VertexID] * half_size, 0.0, 0.0));
+	point_color = in_color;
 }
 )";
 
@@ -124,11 +181,6 @@ GLuint create_program(Shaders ... shaders)
 	return result;
 }
 
-struct particle
-{
-	glm::vec3 position;
-};
-
 int main() try
 {
 	if (SDL_Init(SDL_INIT_VIDEO) != 0)
@@ -175,16 +227,38 @@ int main() try
 	GLuint model_location = glGetUniformLocation(program, "model");
 	GLuint view_location = glGetUniformLocation(program, "view");
 	GLuint projection_location = glGetUniformLocation(program, "projection");
+	GLuint point_scale_location = glGetUniformLocation(program, "point_scale");
 
-	std::default_random_engine rng;
+	auto quad_vertex_shader = create_shader(GL_VERTEX_SHADER, quad_vertex_shader_source);
+	auto quad_program = create_program(quad_vertex_shader, fragment_shader);
 
-	std::vector<particle> particles(256);
-	for (auto & p : particles)
-	{
-		p.position.x = std::uniform_real_distribution<float>{-1.f, 1.f}(rng);
-		p.position.y = 0.f;
-		p.position.z = std::uniform_real_distribution<float>{-1.f, 1.f}(rng);
-	}
+	GLuint quad_model_location = glGetUniformLocation(quad_program, "model");
+	GLuint quad_view_location = glGetUniformLocation(quad_program, "view");
+	GLuint quad_projection_location = glGetUniformLocation(quad_program, "projection");
+	GLuint quad_point_scale_location = glGetUniformLocation(quad_program, "point_scale");
+
+	job_system jobs;
+	std::size_t const particle_capacity = 1'000'000;
+	particle_system particles(particle_capacity);
+
+	// E switches from respawning to emitters on the CPU: a fountain with a constant
+	// rate, and a wide burst at the press of B. Dead particles are removed instead
+	particle_emitter fountain;
+	fountain.rate = 500'000.f;
+
+	particle_emitter burst;
+	burst.parameters.emitter_position = {0.5f, 1.f, 0.f};
+	burst.parameters.spread = 2.f;
+	burst.parameters.min_speed = 0.5f;
+	burst.parameters.max_speed = 1.5f;
+
+	particle_emitter * const emitters[] = {&fountain, &burst};
+
+	// N makes the CPU particles push each other apart, found through the spatial grid
+	spatial_grid grid;
+	bool separation = false;
+	float const separation_radius = 0.01f;
+	float const separation_strength = 1.f;
 
 	GLuint vao, vbo;
 	glGenVertexArrays(1, &vao);
@@ -192,12 +266,29 @@ int main() try
 
 	glGenBuffers(1, &vbo);
 	glBindBuffer(GL_ARRAY_BUFFER, vbo);
-	glBufferData(GL_ARRAY_BUFFER, particles.size() * sizeof(particle), particles.data(), GL_STATIC_DRAW);
 
-	glEnableVertexAttribArray(0);
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(particle), (void*)(0));
+	for (GLuint i = 0; i < 5; ++i)
+		glEnableVertexAttribArray(i);
+
+	// G switches the simulation between the CPU and transform feedback, handing the state over
+	gpu_particle_system gpu_particles;
+	bool gpu_simulation = false;
 
-	glPointSize(5.f);
+	// Q switches from points expanded by the geometry shader to instanced quads, with the
+	// particle arrays as per-instance attributes. C alternates them every frame, to compare
+	// their frame and draw (GPU timer query) times side by side
+	enum renderer_type { geometry_shader_renderer, instanced_quad_renderer, renderer_count };
+	char const * renderer_names[renderer_count] = {"geometry shader", "instanced quads"};
+	int renderer = geometry_shader_renderer;
+	bool compare_renderers = false;
+	int last_renderer = -1;
+
+	// A query is only restarted once its result has been read
+	GLuint draw_queries[renderer_count];
+	glGenQueries(renderer_count, draw_queries);
+	bool draw_query_pending[renderer_count] = {};
+
+	glEnable(GL_PROGRAM_POINT_SIZE);
 
 	auto last_frame_start = std::chrono::high_resolution_clock::now();
 
@@ -213,6 +304,15 @@ int main() try
 
 	bool paused = false;
 
+	float stats_time = 0.f;
+	float stats_update_time = 0.f;
+	float stats_separation_time = 0.f;
+	float stats_renderer_frame_time[renderer_count] = {};
+	std::size_t stats_renderer_frames[renderer_count] = {};
+	float stats_renderer_draw_time[renderer_count] = {};
+	std::size_t stats_renderer_draws[renderer_count] = {};
+	std::size_t stats_frames = 0;
+
 	bool running = true;
 	while (running)
 	{
@@ -234,6 +334,29 @@ int main() try
 			button_down[event.key.keysym.sym] = true;
 			if (event.key.keysym.sym == SDLK_SPACE)
 				paused = !paused;
+			if (event.key.keysym.sym == SDLK_n)
+				separation = !separation;
+			if (event.key.keysym.sym == SDLK_q)
+				renderer = (renderer + 1) % renderer_count;
+			if (event.key.keysym.sym == SDLK_c)
+				compare_renderers = !compare_renderers;
+			if (event.key.keysym.sym == SDLK_e && !gpu_simulation)
+			{
+				particles.respawn = !particles.respawn;
+				if (particles.respawn)
+					particles.resize(particle_capacity);
+			}
+			if (event.key.keysym.sym == SDLK_b)
+				burst.burst(200'000);
+			// Transform feedback only respawns
+			if (event.key.keysym.sym == SDLK_g && particles.respawn)
+			{
+				gpu_simulation = !gpu_simulation;
+				if (gpu_simulation)
+					gpu_particles.upload(particles);
+				else
+					gpu_particles.download(particles);
+			}
 			break;
 		case SDL_KEYUP:
 			button_down[event.key.keysym.sym] = false;
@@ -248,6 +371,34 @@ int main() try
 		last_frame_start = now;
 		time += dt;
 
+		// The frame that just ended
+		if (last_renderer >= 0)
+		{
+			stats_renderer_frame_time[last_renderer] += dt;
+			++stats_renderer_frames[last_renderer];
+		}
+
+		for (int i = 0; i < renderer_count; ++i)
+		{
+			if (!draw_query_pending[i])
+				continue;
+
+			GLint available;
+			glGetQueryObjectiv(draw_queries[i], GL_QUERY_RESULT_AVAILABLE, &available);
+			if (!available)
+				continue;
+
+			GLuint64 nanoseconds;
+			glGetQueryObjectui64v(draw_queries[i], GL_QUERY_RESULT, &nanoseconds);
+			stats_renderer_draw_time[i] += nanoseconds * 1e-9f;
+			++stats_renderer_draws[i];
+			draw_query_pending[i] = false;
+		}
+
+		if (compare_renderers)
+			renderer = (renderer + 1) % renderer_count;
+		bool const instanced = (renderer == instanced_quad_renderer);
+
 		if (button_down[SDLK_UP])
 			camera_distance -= 3.f * dt;
 		if (button_down[SDLK_DOWN])
@@ -258,6 +409,30 @@ int main() try
 		if (button_down[SDLK_RIGHT])
 			camera_rotation += 3.f * dt;
 
+		if (!paused)
+		{
+			auto update_start = std::chrono::high_resolution_clock::now();
+			// Long frames (e.g. window dragging) would throw particles far away
+			if (gpu_simulation)
+				gpu_particles.update(std::min(dt, 0.05f));
+			else
+			{
+				particles.update(std::min(dt, 0.05f), jobs);
+				if (!particles.respawn)
+					for (auto * emitter : emitters)
+						particles.emit(*emitter, std::min(dt, 0.05f));
+			}
+			stats_update_time += std::chrono::duration_cast<std::chrono::duration<float>>(std::chrono::high_resolution_clock::now() - update_start).count();
+
+			if (separation && !gpu_simulation)
+			{
+				auto separation_start = std::chrono::high_resolution_clock::now();
+				grid.build(particles, separation_radius, jobs);
+				apply_separation(particles, grid, separation_radius, separation_strength, std::min(dt, 0.05f), jobs);
+				stats_separation_time += std::chrono::duration_cast<std::chrono::duration<float>>(std::chrono::high_resolution_clock::now() - separation_start).count();
+			}
+		}
+
 		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 		glEnable(GL_DEPTH_TEST);
 		glEnable(GL_CULL_FACE);
@@ -276,14 +451,118 @@ int main() try
 
 		glm::vec3 camera_position = (glm::inverse(view) * glm::vec4(0.f, 0.f, 0.f, 1.f)).xyz();
 
-		glUseProgram(program);
+		float point_scale = projection[1][1] * height / 2.f;
 
-		glUniformMatrix4fv(model_location, 1, GL_FALSE, reinterpret_cast<float *>(&model));
-		glUniformMatrix4fv(view_location, 1, GL_FALSE, reinterpret_cast<float *>(&view));
-		glUniformMatrix4fv(projection_location, 1, GL_FALSE, reinterpret_cast<float *>(&projection));
+		// The buffer holds the arrays of the live particles one after another,
+		// in the order of their attribute locations
+		std::size_t const particle_array_size = particles.count() * sizeof(float);
+		if (!gpu_simulation)
+		{
+			glBindBuffer(GL_ARRAY_BUFFER, vbo);
+			glBufferData(GL_ARRAY_BUFFER, 5 * particle_array_size, nullptr, GL_STREAM_DRAW);
+			glBufferSubData(GL_ARRAY_BUFFER, 0 * particle_array_size, particle_array_size, particles.position_x.data());
+			glBufferSubData(GL_ARRAY_BUFFER, 1 * particle_array_size, particle_array_size, particles.position_y.data());
+			glBufferSubData(GL_ARRAY_BUFFER, 2 * particle_array_size, particle_array_size, particles.position_z.data());
+			glBufferSubData(GL_ARRAY_BUFFER, 3 * particle_array_size, particle_array_size, particles.size.data());
+			glBufferSubData(GL_ARRAY_BUFFER, 4 * particle_array_size, particle_array_size, particles.color.data());
+		}
+
+		if (instanced)
+		{
+			glUseProgram(quad_program);
+
+			glUniformMatrix4fv(quad_model_location, 1, GL_FALSE, reinterpret_cast<float *>(&model));
+			glUniformMatrix4fv(quad_view_location, 1, GL_FALSE, reinterpret_cast<float *>(&view));
+			glUniformMatrix4fv(quad_projection_location, 1, GL_FALSE, reinterpret_cast<float *>(&projection));
+			glUniform1f(quad_point_scale_location, point_scale);
+		}
+		else
+		{
+			glUseProgram(program);
+
+			glUniformMatrix4fv(model_location, 1, GL_FALSE, reinterpret_cast<float *>(&model));
+			glUniformMatrix4fv(view_location, 1, GL_FALSE, reinterpret_cast<float *>(&view));
+			glUniformMatrix4fv(projection_location, 1, GL_FALSE, reinterpret_cast<float *>(&projection));
+			glUniform1f(point_scale_location, point_scale);
+		}
 
 		glBindVertexArray(vao);
-		glDrawArrays(GL_POINTS, 0, particles.size());
+
+		for (GLuint i = 0; i < 5; ++i)
+			glVertexAttribDivisor(i, instanced ? 1 : 0);
+
+		bool const timed = !draw_query_pending[renderer];
+		if (timed)
+			glBeginQuery(GL_TIME_ELAPSED, draw_queries[renderer]);
+
+		if (gpu_simulation)
+		{
+			// Straight from the transform feedback output
+			glBindBuffer(GL_ARRAY_BUFFER, gpu_particles.buffer());
+			glVertexAttribPointer(0, 1, GL_FLOAT, GL_FALSE, sizeof(gpu_particle), reinterpret_cast<void *>(offsetof(gpu_particle, position_x)));
+			glVertexAttribPointer(1, 1, GL_FLOAT, GL_FALSE, sizeof(gpu_particle), reinterpret_cast<void *>(offsetof(gpu_particle, position_y)));
+			glVertexAttribPointer(2, 1, GL_FLOAT, GL_FALSE, sizeof(gpu_particle), reinterpret_cast<void *>(offsetof(gpu_particle, position_z)));
+			glVertexAttribPointer(3, 1, GL_FLOAT, GL_FALSE, sizeof(gpu_particle), reinterpret_cast<void *>(offsetof(gpu_particle, size)));
+			glVertexAttribPointer(4, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(gpu_particle), reinterpret_cast<void *>(offsetof(gpu_particle, color)));
+
+			if (instanced)
+				glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, gpu_particles.count());
+			else
+				glDrawArrays(GL_POINTS, 0, gpu_particles.count());
+		}
+		else
+		{
+			glBindBuffer(GL_ARRAY_BUFFER, vbo);
+			for (GLuint i = 0; i < 4; ++i)
+				glVertexAttribPointer(i, 1, GL_FLOAT, GL_FALSE, 0, reinterpret_cast<void *>(i * particle_array_size));
+			glVertexAttribPointer(4, 4, GL_UNSIGNED_BYTE, GL_TRUE, 0, reinterpret_cast<void *>(4 * particle_array_size));
+
+			if (instanced)
+				glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, particles.count());
+			else
+				glDrawArrays(GL_POINTS, 0, particles.count());
+		}
+
+		if (timed)
+		{
+			glEndQuery(GL_TIME_ELAPSED);
+			draw_query_pending[renderer] = true;
+		}
+		last_renderer = renderer;
+
+		stats_time += dt;
+		++stats_frames;
+		if (stats_time >= 0.5f)
+		{
+			std::ostringstream title;
+			title << "Graphics course practice 11: " << (stats_time / stats_frames * 1000.f) << " ms/frame, " << particles.count() << " particles";
+			if (!particles.respawn)
+				title << " from emitters";
+			if (gpu_simulation)
+				title << " simulated on the GPU";
+			else
+				title << " updated in " << (stats_update_time / stats_frames * 1000.f) << " ms ("
+					<< (stats_update_time / stats_frames * 1e9f / particles.count()) << " ns/particle) on " << jobs.thread_count() << " threads";
+			if (separation && !gpu_simulation)
+				title << ", separated in " << (stats_separation_time / stats_frames * 1000.f) << " ms";
+			for (int i = 0; i < renderer_count; ++i)
+				if (stats_renderer_frames[i] > 0 && stats_renderer_draws[i] > 0)
+					title << ", " << renderer_names[i] << ": " << (stats_renderer_frame_time[i] / stats_renderer_frames[i] * 1000.f) << " ms/frame, "
+						<< (stats_renderer_draw_time[i] / stats_renderer_draws[i] * 1000.f) << " ms draw";
+			SDL_SetWindowTitle(window, title.str().c_str());
+
+			stats_time = 0.f;
+			stats_update_time = 0.f;
+			stats_separation_time = 0.f;
+			for (int i = 0; i < renderer_count; ++i)
+			{
+				stats_renderer_frame_time[i] = 0.f;
+				stats_renderer_frames[i] = 0;
+				stats_renderer_draw_time[i] = 0.f;
+				stats_renderer_draws[i] = 0;
+			}
+			stats_frames = 0;
+		}
 
 		SDL_GL_SwapWindow(window);
 	}
@@ -0,0 +1,136 @@
+#pragma once
+
+#include "job_system.hpp"
+
+#include <glm/vec3.hpp>
+
+#include <cstdint>
+#include <new>
+#include <vector>
+
+// Allocates over-aligned storage, so that SIMD kernels can use aligned loads and stores
+template <typename T, std::size_t Alignment = 64>
+struct aligned_allocator
+{
+	using value_type = T;
+
+	template <typename U>
+	struct rebind
+	{
+		using other = aligned_allocator<U, Alignment>;
+	};
+
+	aligned_allocator() = default;
+
+	template <typename U>
+	aligned_allocator(aligned_allocator<U, Alignment> const &)
+	{}
+
+	T * allocate(std::size_t n)
+	{
+		return static_cast<T *>(::operator new(n * sizeof(T), std::align_val_t(Alignment)));
+	}
+
+	void deallocate(T * p, std::size_t)
+	{
+		::operator delete(p, std::align_val_t(Alignment));
+	}
+
+	friend bool operator == (aligned_allocator const &, aligned_allocator const &) { return true; }
+};
+
+template <typename T>
+using aligned_vector = std::vector<T, aligned_allocator<T>>;
+
+struct particle_parameters
+{
+	glm::vec3 gravity{0.f, -4.f, 0.f};
+	// Velocity decays as exp(-drag * t)
+	float drag = 0.5f;
+
+	// New particles start in a disc around the emitter, flying mostly upwards
+	glm::vec3 emitter_position{0.f};
+	float emitter_radius = 0.05f;
+	float min_speed = 1.5f;
+	float max_speed = 2.5f;
+	float spread = 0.4f;
+
+	float min_lifetime = 1.f;
+	float max_lifetime = 2.f;
+	float min_size = 0.002f;
+	float max_size = 0.008f;
+};
+
+// Source of new particles for a particle system without respawning. Only the emission
+// parameters are used, gravity and drag are the particle system's
+struct particle_emitter
+{
+	particle_parameters parameters;
+	// Particles per second
+	float rate = 0.f;
+
+	// Emits count more particles on the next emission
+	void burst(std::size_t count) { burst_ += count; }
+
+private:
+	friend struct particle_system;
+
+	// Fraction of a particle left over from the previous emissions
+	float accumulator_ = 0.f;
+	std::size_t burst_ = 0;
+};
+
+// Particles stored as a structure of arrays: every attribute is a separate
+// 64-byte aligned array padded to a multiple of simd_width elements,
+// so that the update kernel processes whole SIMD registers only.
+// A particle which outlives its lifetime is respawned at the emitter, unless
+// respawn is off: then it is removed by moving the last particle into its place,
+// and emitters refill the arrays up to their capacity, which never reallocates
+struct particle_system
+{
+	static constexpr std::size_t simd_width = 8;
+
+	aligned_vector<float> position_x, position_y, position_z;
+	aligned_vector<float> velocity_x, velocity_y, velocity_z;
+	aligned_vector<float> age;
+	aligned_vector<float> lifetime;
+	aligned_vector<float> size;
+	// RGBA8
+	aligned_vector<std::uint32_t> color;
+
+	particle_parameters parameters;
+	bool respawn = true;
+
+	explicit particle_system(std::size_t count, particle_parameters const & parameters = {});
+
+	std::size_t count() const { return count_; }
+
+	std::size_t capacity() const { return position_x.size(); }
+
+	// Number of updates so far, which seeds the respawn randomness
+	std::uint32_t frame() const { return frame_; }
+
+	// Allocates the arrays for at least capacity particles
+	void reserve(std::size_t capacity);
+
+	// Spawns the added particles with random ages, so that they don't all die at once
+	void resize(std::size_t count);
+
+	// Integrates gravity and drag and respawns or removes dead particles, in chunks
+	// of chunk_size (a multiple of simd_width) updated as separate jobs
+	void update(float dt, job_system & jobs, std::size_t chunk_size = 16384);
+
+	// Spawns the emitter's particles for a step of dt (the rate ones and any burst) in
+	// constant time each, as long as there is capacity left. Returns the number spawned
+	std::size_t emit(particle_emitter & emitter, float dt);
+
+private:
+	std::size_t count_ = 0;
+	// Seeds the respawn randomness, which is a function of the particle
+	// index and the frame only, so that chunks can be updated in any order
+	std::uint32_t frame_ = 0;
+
+	void update_range(float dt, std::size_t begin, std::size_t end);
+	void remove_dead();
+	void spawn(std::size_t i, std::uint32_t seed, particle_parameters const & p);
+};
@@ -0,0 +1,111 @@
+#pragma once
+
+#include "job_system.hpp"
+#include "particle_system.hpp"
+
+#include <glm/vec3.hpp>
+
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+// Spatial hash over a uniform grid for particle neighbor queries. Cells are hashed
+// into a table of about as many buckets as there are particles, and the particles are
+// counting-sorted by bucket, so a bucket is a contiguous range of slots ordered by the
+// particle index. Only the y, z row of a cell is hashed and x is added to it, so
+// neighboring cells of a row are neighboring buckets and slots. The grid keeps its own
+// copies of the positions in slot order, which makes the queries of nearby particles
+// read nearby memory; the particle arrays themselves keep their order
+struct spatial_grid
+{
+	// Rebuilds the grid from the first particles.count() particles in parallel
+	void build(particle_system const & particles, float cell_size, job_system & jobs);
+
+	float cell_size() const { return cell_size_; }
+
+	// Number of particles, which is also the number of slots
+	std::size_t count() const { return index_.size(); }
+
+	// Particle index stored in a slot
+	std::uint32_t index(std::size_t slot) const { return index_[slot]; }
+
+	glm::vec3 position(std::size_t slot) const { return {position_x_[slot], position_y_[slot], position_z_[slot]}; }
+
+	// Calls function(slot, offset, distance_squared) for every particle within the radius
+	// (which must not exceed the cell size) of the point, offset pointing from the particle
+	// to the point. The point itself is reported too if it is a particle. Returning false
+	// from the function stops the query
+	template <typename Function>
+	void for_each_neighbor(glm::vec3 const & point, float radius, Function const & function) const;
+
+private:
+	float cell_size_ = 1.f;
+	float inverse_cell_size_ = 1.f;
+	std::uint32_t bucket_mask_ = 0;
+
+	std::vector<std::uint32_t> particle_bucket_;
+	// Particle counts during the build, then the first slot of each bucket, plus the total
+	std::vector<std::uint32_t> bucket_start_;
+	// Next free slot of each bucket during the build
+	std::vector<std::uint32_t> bucket_fill_;
+	std::vector<std::uint32_t> block_sums_;
+
+	std::vector<std::uint32_t> index_;
+	std::vector<float> position_x_, position_y_, position_z_;
+
+	static std::uint32_t row_hash(int y, int z)
+	{
+		return (std::uint32_t(y) * 19349663u) ^ (std::uint32_t(z) * 83492791u);
+	}
+
+	std::uint32_t bucket(int x, int y, int z) const
+	{
+		return (row_hash(y, z) + std::uint32_t(x)) & bucket_mask_;
+	}
+
+	int cell(float coordinate) const
+	{
+		return int(std::floor(coordinate * inverse_cell_size_));
+	}
+};
+
+template <typename Function>
+void spatial_grid::for_each_neighbor(glm::vec3 const & point, float radius, Function const & function) const
+{
+	if (index_.empty())
+		return;
+
+	int const x0 = cell(point.x - radius), x1 = cell(point.x + radius);
+	int const y0 = cell(point.y - radius), y1 = cell(point.y + radius);
+	int const z0 = cell(point.z - radius), z1 = cell(point.z + radius);
+
+	float const radius_squared = radius * radius;
+
+	for (int z = z0; z <= z1; ++z)
+	for (int y = y0; y <= y1; ++y)
+	for (int x = x0; x <= x1; ++x)
+	{
+		std::uint32_t const b = bucket(x, y, z);
+		for (std::uint32_t slot = bucket_start_[b], end = bucket_start_[b + 1]; slot < end; ++slot)
+		{
+			glm::vec3 const offset(point.x - position_x_[slot], point.y - position_y_[slot], point.z - position_z_[slot]);
+			float const distance_squared = offset.x * offset.x + offset.y * offset.y + offset.z * offset.z;
+			if (distance_squared > radius_squared)
+				continue;
+
+			// A bucket may hold other cells, including ones visited separately, so
+			// a particle is only reported while visiting its own cell
+			if (cell(position_x_[slot]) != x || cell(position_y_[slot]) != y || cell(position_z_[slot]) != z)
+				continue;
+
+			if (!function(std::size_t(slot), offset, distance_squared))
+				return;
+		}
+	}
+}
+
+// Pushes particles closer than the radius apart, with a force growing linearly from zero
+// at the radius, taking at most max_neighbors neighbors into account. The velocities are
+// changed using the grid's positions, so particles can be processed in any order
+void apply_separation(particle_system & particles, spatial_grid const & grid, float radius, float strength, float dt,
+	job_system & jobs, std::size_t max_neighbors = 16);
@@ -0,0 +1,123 @@
+// Times building the spatial grid and the separation pass over it on 100k to 1M
+// particles of the fountain plume, checks the neighbor sets of sampled particles
+// against brute force, and checks that a single thread and several threads give the
+// same slot order and velocities. The first argument replaces the particle counts
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "job_system.hpp"
+#include "particle_system.hpp"
+#include "spatial_grid.hpp"
+
+float const radius = 0.01f;
+float const dt = 1.f / 60.f;
+std::size_t const sample_count = 200;
+
+template <typename Function>
+double time_ms(Function const & function)
+{
+	auto const start = std::chrono::steady_clock::now();
+	function();
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+std::vector<std::uint32_t> grid_neighbors(spatial_grid const & grid, glm::vec3 const & point)
+{
+	std::vector<std::uint32_t> result;
+	grid.for_each_neighbor(point, radius, [&](std::size_t slot, glm::vec3 const &, float)
+	{
+		result.push_back(grid.index(slot));
+		return true;
+	});
+	std::sort(result.begin(), result.end());
+	return result;
+}
+
+std::vector<std::uint32_t> brute_force_neighbors(particle_system const & particles, glm::vec3 const & point)
+{
+	std::vector<std::uint32_t> result;
+	for (std::size_t i = 0; i < particles.count(); ++i)
+	{
+		glm::vec3 const offset(point.x - particles.position_x[i], point.y - particles.position_y[i], point.z - particles.position_z[i]);
+		if (offset.x * offset.x + offset.y * offset.y + offset.z * offset.z <= radius * radius)
+			result.push_back(std::uint32_t(i));
+	}
+	return result;
+}
+
+bool run(std::size_t count, job_system & single, job_system & all)
+{
+	particle_system particles(count);
+	for (int step = 0; step < 60; ++step)
+		particles.update(dt, all);
+
+	spatial_grid grid;
+	double build_ms = 0.0;
+	int const repeats = 5;
+	for (int i = 0; i < repeats; ++i)
+		build_ms += time_ms([&]{ grid.build(particles, radius, all); });
+	build_ms /= repeats;
+
+	std::size_t pairs = 0;
+	for (std::size_t slot = 0; slot < grid.count(); ++slot)
+		grid.for_each_neighbor(grid.position(slot), radius, [&](std::size_t, glm::vec3 const &, float){ ++pairs; return true; });
+
+	particle_system separated = particles;
+	double const separation_ms = time_ms([&]{ apply_separation(separated, grid, radius, 1.f, dt, all); });
+
+	std::size_t mismatches = 0;
+	for (std::size_t sample = 0; sample < sample_count; ++sample)
+	{
+		std::size_t const slot = sample * grid.count() / sample_count;
+		if (grid_neighbors(grid, grid.position(slot)) != brute_force_neighbors(particles, grid.position(slot)))
+			++mismatches;
+	}
+
+	// The same build and separation on a single thread
+	spatial_grid single_grid;
+	single_grid.build(particles, radius, single);
+	particle_system single_separated = particles;
+	apply_separation(single_separated, single_grid, radius, 1.f, dt, single);
+
+	bool deterministic = single_separated.velocity_x == separated.velocity_x
+		&& single_separated.velocity_y == separated.velocity_y
+		&& single_separated.velocity_z == separated.velocity_z;
+	for (std::size_t slot = 0; slot < grid.count(); ++slot)
+		deterministic = deterministic && single_grid.index(slot) == grid.index(slot);
+
+	std::cout << count << " particles: build " << build_ms << " ms, separation " << separation_ms << " ms, "
+		<< double(pairs) / count << " neighbors per particle, " << mismatches << " of " << sample_count
+		<< " sampled neighbor sets differ from brute force, " << (deterministic ? "deterministic" : "NOT deterministic") << std::endl;
+
+	return mismatches == 0 && deterministic;
+}
+
+int main(int argc, char ** argv) try
+{
+	std::vector<std::size_t> counts{100'000, 300'000, 1'000'000};
+	if (argc > 1)
+		counts = {std::size_t(std::stoul(argv[1]))};
+
+	// At least four threads, so that their scheduling varies even on fewer cores
+	job_system single(0);
+	job_system all(std::max(std::thread::hardware_concurrency(), 4u) - 1);
+	std::cout << all.thread_count() << " thread(s), radius " << radius << std::endl;
+
+	bool ok = true;
+	for (std::size_t count : counts)
+		ok = run(count, single, all) && ok;
+
+	return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+catch (std::exception const & e)
+{
+	std::cerr << e.what() << std::endl;
+	return EXIT_FAILURE;
+}
@@ -0,0 +1,42 @@
+#include "macro_grid.hpp"
+
+#include <glm/common.hpp>
+
+#include <algorithm>
+
+macro_grid build_macro_grid(std::uint8_t const * voxels, glm::ivec3 const & volume_size, std::size_t stride, int cell_size)
+{
+	macro_grid result;
+	result.cell_size = cell_size;
+	result.size = (volume_size + cell_size - 1) / cell_size;
+	result.min_max.resize(2 * std::size_t(result.size.x) * result.size.y * result.size.z);
+
+	auto voxel = [&](int x, int y, int z)
+	{
+		return voxels[((std::size_t(z) * volume_size.y + y) * volume_size.x + x) * stride];
+	};
+
+	std::size_t cell = 0;
+	for (int cz = 0; cz < result.size.z; ++cz)
+	for (int cy = 0; cy < result.size.y; ++cy)
+	for (int cx = 0; cx < result.size.x; ++cx, ++cell)
+	{
+		glm::ivec3 const begin = glm::max(glm::ivec3(cx, cy, cz) * cell_size - 1, glm::ivec3(0));
+		glm::ivec3 const end = glm::min(glm::ivec3(cx + 1, cy + 1, cz + 1) * cell_size + 1, volume_size);
+
+		std::uint8_t min = 255, max = 0;
+		for (int z = begin.z; z < end.z; ++z)
+		for (int y = begin.y; y < end.y; ++y)
+		for (int x = begin.x; x < end.x; ++x)
+		{
+			std::uint8_t const value = voxel(x, y, z);
+			min = std::min(min, value);
+			max = std::max(max, value);
+		}
+
+		result.min_max[2 * cell + 0] = min;
+		result.min_max[2 * cell + 1] = max;
+	}
+
+	return result;
+}
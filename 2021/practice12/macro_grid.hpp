@@ -0,0 +1,23 @@
+#pragma once
+
+#include <glm/vec3.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Coarse grid over a volume: the minimum and the maximum density of every cell_size^3
+// block of voxels, so that a raymarcher can leap over the cells it would see nothing in
+struct macro_grid
+{
+	int cell_size = 0;
+	// In cells
+	glm::ivec3 size{0};
+	// Two bytes (min, max) per cell, x changing fastest, ready for an RG8 texture
+	std::vector<std::uint8_t> min_max;
+};
+
+// Densities are every stride'th byte of voxels, starting from the first one, x changing
+// fastest. Each cell also covers one voxel around it, since trilinear filtering
+// anywhere inside the cell reads those too
+macro_grid build_macro_grid(std::uint8_t const * voxels, glm::ivec3 const & volume_size, std::size_t stride, int cell_size);
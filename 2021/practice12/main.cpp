@@ -14,6 +14,9 @@
 #include <chrono>
 #include <vector>
 #include <map>
+#include <cmath>
+#include <iterator>
+#include <sstream>
 
 #define GLM_FORCE_SWIZZLE
 #define GLM_ENABLE_EXPERIMENTAL
@@ -24,6 +27,8 @@
 #include <glm/ext/scalar_constants.hpp>
 #include <glm/gtx/string_cast.hpp>
 
+#include "macro_grid.hpp"
+
 std::string to_string(std::string_view str)
 {
 	return std::string(str.begin(), str.end());
@@ -62,13 +67,136 @@ R"(#version 330 core
 uniform vec3 camera_position;
 uniform vec3 light_dir;
 
+// Color and density
+uniform sampler3D volume_texture;
+// Min and max density of every macro cell
+uniform sampler3D macro_texture;
+// Macro cells per unit of texture coordinates
+uniform vec3 macro_scale;
+uniform bool skip_empty;
+// Distance between samples, half a voxel
+uniform float step_size;
+uniform float absorption;
+
 in vec3 position;
 
 layout (location = 0) out vec4 out_color;
 
+const vec3 bbox_min = vec3(-1.0);
+const vec3 bbox_max = vec3(1.0);
+
+void sort(inout float x, inout float y)
+{
+	if (x > y)
+	{
+		float t = x;
+		x = y;
+		y = t;
+	}
+}
+
+float vmin(vec3 v)
+{
+	return min(v.x, min(v.y, v.z));
+}
+
+float vmax(vec3 v)
+{
+	return max(v.x, max(v.y, v.z));
+}
+
+vec2 intersect_bbox(vec3 origin, vec3 direction)
+{
+	vec3 tmin = (bbox_min - origin) / direction;
+	vec3 tmax = (bbox_max - origin) / direction;
+
+	sort(tmin.x, tmax.x);
+	sort(tmin.y, tmax.y);
+	sort(tmin.z, tmax.z);
+
+	return vec2(vmax(tmin), vmin(tmax));
+}
+
+// Texture coordinates of a point
+vec3 volume_coords(vec3 p)
+{
+	return (p - bbox_min) / (bbox_max - bbox_min);
+}
+
+// Index of the first sample (at origin + direction * (i + 0.5) * step_size) at or
+// after sample i outside of empty macro cells. The samples stay the same as without
+// skipping, so the result is exactly the same, as an empty cell contributes nothing
+int skip_empty_cells(vec3 origin, vec3 direction, int i, int sample_count)
+{
+	vec3 cell_origin = volume_coords(origin) * macro_scale;
+	vec3 cell_direction = direction / (bbox_max - bbox_min) * macro_scale;
+	// Axis-parallel rays never leave the cell across the axes they are parallel to
+	cell_direction = mix(cell_direction, vec3(1e-6), equal(cell_direction, vec3(0.0)));
+
+	while (i < sample_count)
+	{
+		float t = (float(i) + 0.5) * step_size;
+		vec3 cell = floor(cell_origin + cell_direction * t);
+		// Samples just outside the volume read its boundary, as the volume texture is clamped
+		ivec3 texel = clamp(ivec3(cell), ivec3(0), textureSize(macro_texture, 0) - 1);
+		if (texelFetch(macro_texture, texel, 0).g > 0.0)
+			break;
+
+		vec3 cell_exit = (cell + step(vec3(0.0), cell_direction) - cell_origin) / cell_direction;
+		i = max(i + 1, int(ceil(vmin(cell_exit) / step_size - 0.5)));
+	}
+
+	return i;
+}
+
 void main()
 {
-	out_color = vec4(position * 0.5 + vec3(0.5), 1.0);
+	vec3 direction = normalize(position - camera_position);
+	vec2 t = intersect_bbox(camera_position, direction);
+	t.x = max(t.x, 0.0);
+
+	vec3 origin = camera_position + direction * t.x;
+	int sample_count = int(ceil((t.y - t.x) / step_size));
+
+	vec3 texel_size = 1.0 / vec3(textureSize(volume_texture, 0));
+
+	vec3 color = vec3(0.0);
+	float transmittance = 1.0;
+
+	for (int i = 0; i < sample_count; ++i)
+	{
+		if (skip_empty)
+		{
+			i = skip_empty_cells(origin, direction, i, sample_count);
+			if (i == sample_count)
+				break;
+		}
+
+		vec3 p = volume_coords(origin + direction * (float(i) + 0.5) * step_size);
+		vec4 voxel = texture(volume_texture, p);
+		if (voxel.a == 0.0)
+			continue;
+
+		// Diffuse lighting, with the density gradient as the normal
+		vec3 gradient = vec3(
+			texture(volume_texture, p + vec3(texel_size.x, 0.0, 0.0)).a - texture(volume_texture, p - vec3(texel_size.x, 0.0, 0.0)).a,
+			texture(volume_texture, p + vec3(0.0, texel_size.y, 0.0)).a - texture(volume_texture, p - vec3(0.0, texel_size.y, 0.0)).a,
+			texture(volume_texture, p + vec3(0.0, 0.0, texel_size.z)).a - texture(volume_texture, p - vec3(0.0, 0.0, texel_size.z)).a);
+		float lighting = 0.3;
+		if (dot(gradient, gradient) > 0.0)
+			lighting += 0.7 * max(0.0, dot(-normalize(gradient), light_dir));
+
+		float alpha = 1.0 - exp(-absorption * voxel.a * step_size);
+		color += transmittance * alpha * voxel.rgb * lighting;
+		transmittance *= 1.0 - alpha;
+
+		// Nothing behind would be visible
+		if (transmittance < 0.01)
+			break;
+	}
+
+	float alpha = 1.0 - transmittance;
+	out_color = vec4(color / max(alpha, 1e-4), alpha);
 }
 )";
 
@@ -196,6 +324,12 @@ int main() try
 	GLuint projection_location = glGetUniformLocation(program, "projection");
 	GLuint camera_position_location = glGetUniformLocation(program, "camera_position");
 	GLuint light_dir_location = glGetUniformLocation(program, "light_dir");
+	GLuint volume_texture_location = glGetUniformLocation(program, "volume_texture");
+	GLuint macro_texture_location = glGetUniformLocation(program, "macro_texture");
+	GLuint macro_scale_location = glGetUniformLocation(program, "macro_scale");
+	GLuint skip_empty_location = glGetUniformLocation(program, "skip_empty");
+	GLuint step_size_location = glGetUniformLocation(program, "step_size");
+	GLuint absorption_location = glGetUniformLocation(program, "absorption");
 
 	GLuint vao, vbo, ebo;
 	glGenVertexArrays(1, &vao);
@@ -212,6 +346,64 @@ int main() try
 	glEnableVertexAttribArray(0);
 	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, nullptr);
 
+	// 64^3 voxels of RGBA8, with the density in alpha
+	const glm::ivec3 volume_size{64, 64, 64};
+	// Voxels per side of a macro cell
+	const int macro_cell_size = 4;
+
+	struct volume
+	{
+		std::string name;
+		GLuint texture = 0;
+		glm::ivec3 macro_size{0};
+		GLuint macro_texture = 0;
+		float macro_build_time = 0.f;
+	};
+
+	auto load_volume = [&](std::string name)
+	{
+		std::string const path = std::string(PRACTICE_SOURCE_DIRECTORY) + "/" + name;
+		std::ifstream input(path, std::ios::binary);
+		std::vector<std::uint8_t> voxels((std::istreambuf_iterator<char>(input)), std::istreambuf_iterator<char>());
+		if (voxels.size() != 4 * std::size_t(volume_size.x) * volume_size.y * volume_size.z)
+			throw std::runtime_error("Failed to load " + path);
+
+		volume result{std::move(name)};
+
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+		glGenTextures(1, &result.texture);
+		glBindTexture(GL_TEXTURE_3D, result.texture);
+		glTexImage3D(GL_TEXTURE_3D, 0, GL_RGBA8, volume_size.x, volume_size.y, volume_size.z, 0, GL_RGBA, GL_UNSIGNED_BYTE, voxels.data());
+		glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+
+		auto build_start = std::chrono::high_resolution_clock::now();
+		macro_grid grid = build_macro_grid(voxels.data() + 3, volume_size, 4, macro_cell_size);
+		result.macro_build_time = std::chrono::duration_cast<std::chrono::duration<float>>(std::chrono::high_resolution_clock::now() - build_start).count();
+		result.macro_size = grid.size;
+
+		glGenTextures(1, &result.macro_texture);
+		glBindTexture(GL_TEXTURE_3D, result.macro_texture);
+		glTexImage3D(GL_TEXTURE_3D, 0, GL_RG8, grid.size.x, grid.size.y, grid.size.z, 0, GL_RG, GL_UNSIGNED_BYTE, grid.min_max.data());
+		glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+		return result;
+	};
+
+	// V switches the volumes, K switches empty space skipping
+	volume volumes[] = {load_volume("bunny64"), load_volume("house64")};
+	int current_volume = 0;
+	bool skip_empty = true;
+
+	for (auto const & v : volumes)
+		std::cout << v.name << ": macro grid " << v.macro_size.x << "x" << v.macro_size.y << "x" << v.macro_size.z
+			<< " built in " << (v.macro_build_time * 1000.f) << " ms" << std::endl;
+
 	auto last_frame_start = std::chrono::high_resolution_clock::now();
 
 	float time = 0.f;
@@ -224,6 +416,9 @@ int main() try
 
 	bool running = true;
 	bool paused = false;
+
+	float stats_time = 0.f;
+	std::size_t stats_frames = 0;
 	while (running)
 	{
 		for (SDL_Event event; SDL_PollEvent(&event);) switch (event.type)
@@ -244,6 +439,10 @@ int main() try
 			button_down[event.key.keysym.sym] = true;
 			if (event.key.keysym.sym == SDLK_SPACE)
 				paused = !paused;
+			if (event.key.keysym.sym == SDLK_v)
+				current_volume = (current_volume + 1) % std::size(volumes);
+			if (event.key.keysym.sym == SDLK_k)
+				skip_empty = !skip_empty;
 			break;
 		case SDL_KEYUP:
 			button_down[event.key.keysym.sym] = false;
@@ -310,9 +509,41 @@ int main() try
 		glUniform3fv(camera_position_location, 1, reinterpret_cast<float *>(&camera_position));
 		glUniform3fv(light_dir_location, 1, reinterpret_cast<float *>(&light_dir));
 
+		volume const & v = volumes[current_volume];
+
+		// The volume fills the [-1, 1] cube
+		float const step_size = 0.5f * 2.f / volume_size.x;
+		glm::vec3 const macro_scale = glm::vec3(volume_size) / float(macro_cell_size);
+
+		glUniform1i(volume_texture_location, 0);
+		glUniform1i(macro_texture_location, 1);
+		glUniform3fv(macro_scale_location, 1, reinterpret_cast<const float *>(&macro_scale));
+		glUniform1i(skip_empty_location, skip_empty);
+		glUniform1f(step_size_location, step_size);
+		glUniform1f(absorption_location, 50.f);
+
+		glActiveTexture(GL_TEXTURE0);
+		glBindTexture(GL_TEXTURE_3D, v.texture);
+		glActiveTexture(GL_TEXTURE1);
+		glBindTexture(GL_TEXTURE_3D, v.macro_texture);
+
 		glBindVertexArray(vao);
 		glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, nullptr);
 
+		stats_time += dt;
+		++stats_frames;
+		if (stats_time >= 0.5f)
+		{
+			std::ostringstream title;
+			title << "Graphics course practice 12: " << (stats_time / stats_frames * 1000.f) << " ms/frame, " << v.name
+				<< ", empty space skipping " << (skip_empty ? "on" : "off")
+				<< " (macro grid built in " << (v.macro_build_time * 1000.f) << " ms)";
+			SDL_SetWindowTitle(window, title.str().c_str());
+
+			stats_time = 0.f;
+			stats_frames = 0;
+		}
+
 		SDL_GL_SwapWindow(window);
 	}
 
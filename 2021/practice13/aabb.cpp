@@ -1,6 +1,8 @@
 #include "aabb.hpp"
 
 aabb::aabb(glm::vec3 const & min, glm::vec3 const & max)
+	: min(min)
+	, max(max)
 {
 	for (std::size_t i = 0; i < 8; ++i)
 	{
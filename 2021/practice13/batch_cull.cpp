@@ -0,0 +1,123 @@
+#include "batch_cull.hpp"
+
+#include <cmath>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define BATCH_CULL_SSE2
+#include <emmintrin.h>
+#endif
+
+void aabb_soa::push_back(glm::vec3 const & min, glm::vec3 const & max)
+{
+	glm::vec3 center = (min + max) / 2.f;
+	glm::vec3 extent = (max - min) / 2.f;
+
+	center_x.push_back(center.x);
+	center_y.push_back(center.y);
+	center_z.push_back(center.z);
+	extent_x.push_back(extent.x);
+	extent_y.push_back(extent.y);
+	extent_z.push_back(extent.z);
+}
+
+std::array<glm::vec4, 6> frustum_planes(glm::mat4 const & view_projection)
+{
+	// glm matrices are column-major, m[column][row]
+	auto row = [&](int i)
+	{
+		return glm::vec4(view_projection[0][i], view_projection[1][i], view_projection[2][i], view_projection[3][i]);
+	};
+
+	return {
+		row(3) + row(0),
+		row(3) - row(0),
+		row(3) + row(1),
+		row(3) - row(1),
+		row(3) + row(2),
+		row(3) - row(2),
+	};
+}
+
+void cull_aabbs(std::array<glm::vec4, 6> const & planes, aabb_soa const & boxes, std::vector<std::uint32_t> & visible)
+{
+	visible.clear();
+
+	std::size_t const count = boxes.size();
+	std::size_t i = 0;
+
+	// A box is outside a plane iff its center is further behind it than
+	// the box's extent projected onto the plane normal
+
+#if defined(__AVX__)
+	for (; i + 8 <= count; i += 8)
+	{
+		__m256 cx = _mm256_loadu_ps(boxes.center_x.data() + i);
+		__m256 cy = _mm256_loadu_ps(boxes.center_y.data() + i);
+		__m256 cz = _mm256_loadu_ps(boxes.center_z.data() + i);
+		__m256 ex = _mm256_loadu_ps(boxes.extent_x.data() + i);
+		__m256 ey = _mm256_loadu_ps(boxes.extent_y.data() + i);
+		__m256 ez = _mm256_loadu_ps(boxes.extent_z.data() + i);
+
+		__m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+
+		for (auto const & p : planes)
+		{
+			__m256 d = _mm256_add_ps(
+				_mm256_add_ps(_mm256_mul_ps(cx, _mm256_set1_ps(p.x)), _mm256_mul_ps(cy, _mm256_set1_ps(p.y))),
+				_mm256_add_ps(_mm256_mul_ps(cz, _mm256_set1_ps(p.z)), _mm256_set1_ps(p.w)));
+			__m256 r = _mm256_add_ps(
+				_mm256_add_ps(_mm256_mul_ps(ex, _mm256_set1_ps(std::abs(p.x))), _mm256_mul_ps(ey, _mm256_set1_ps(std::abs(p.y)))),
+				_mm256_mul_ps(ez, _mm256_set1_ps(std::abs(p.z))));
+			inside = _mm256_and_ps(inside, _mm256_cmp_ps(_mm256_add_ps(d, r), _mm256_setzero_ps(), _CMP_GE_OQ));
+		}
+
+		int mask = _mm256_movemask_ps(inside);
+		for (int j = 0; j < 8; ++j)
+			if (mask & (1 << j))
+				visible.push_back(i + j);
+	}
+#elif defined(BATCH_CULL_SSE2)
+	for (; i + 4 <= count; i += 4)
+	{
+		__m128 cx = _mm_loadu_ps(boxes.center_x.data() + i);
+		__m128 cy = _mm_loadu_ps(boxes.center_y.data() + i);
+		__m128 cz = _mm_loadu_ps(boxes.center_z.data() + i);
+		__m128 ex = _mm_loadu_ps(boxes.extent_x.data() + i);
+		__m128 ey = _mm_loadu_ps(boxes.extent_y.data() + i);
+		__m128 ez = _mm_loadu_ps(boxes.extent_z.data() + i);
+
+		__m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+
+		for (auto const & p : planes)
+		{
+			__m128 d = _mm_add_ps(
+				_mm_add_ps(_mm_mul_ps(cx, _mm_set1_ps(p.x)), _mm_mul_ps(cy, _mm_set1_ps(p.y))),
+				_mm_add_ps(_mm_mul_ps(cz, _mm_set1_ps(p.z)), _mm_set1_ps(p.w)));
+			__m128 r = _mm_add_ps(
+				_mm_add_ps(_mm_mul_ps(ex, _mm_set1_ps(std::abs(p.x))), _mm_mul_ps(ey, _mm_set1_ps(std::abs(p.y)))),
+				_mm_mul_ps(ez, _mm_set1_ps(std::abs(p.z))));
+			inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(d, r), _mm_setzero_ps()));
+		}
+
+		int mask = _mm_movemask_ps(inside);
+		for (int j = 0; j < 4; ++j)
+			if (mask & (1 << j))
+				visible.push_back(i + j);
+	}
+#endif
+
+	for (; i < count; ++i)
+	{
+		bool inside = true;
+		for (auto const & p : planes)
+		{
+			float d = boxes.center_x[i] * p.x + boxes.center_y[i] * p.y + boxes.center_z[i] * p.z + p.w;
+			float r = boxes.extent_x[i] * std::abs(p.x) + boxes.extent_y[i] * std::abs(p.y) + boxes.extent_z[i] * std::abs(p.z);
+			inside &= (d + r >= 0.f);
+		}
+		if (inside)
+			visible.push_back(i);
+	}
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+#include <glm/mat4x4.hpp>
+
+#include <array>
+#include <vector>
+#include <cstdint>
+
+// Axis-aligned boxes stored as structure of arrays, so that
+// the culling kernel can load several boxes at once
+struct aabb_soa
+{
+	std::vector<float> center_x, center_y, center_z;
+	std::vector<float> extent_x, extent_y, extent_z;
+
+	void push_back(glm::vec3 const & min, glm::vec3 const & max);
+
+	std::size_t size() const
+	{
+		return center_x.size();
+	}
+};
+
+// Planes (n, d) with dot(n, p) + d >= 0 for points inside the frustum, in the order
+// left, right, bottom, top, near, far; extracted directly from the matrix (Gribb & Hartmann)
+std::array<glm::vec4, 6> frustum_planes(glm::mat4 const & view_projection);
+
+// Writes the indices of the boxes that are not completely behind any of the planes.
+// Conservative: a box near a frustum corner may pass while lying outside,
+// unlike the exact SAT intersect()
+void cull_aabbs(std::array<glm::vec4, 6> const & planes, aabb_soa const & boxes, std::vector<std::uint32_t> & visible);
@@ -0,0 +1,107 @@
+// Culls the same random boxes against a few cameras with the SAT intersect() per box,
+// as the SAT culling mode does, and with cull_aabbs, and prints the time per box of
+// both. The batch test is conservative, so its visible list must contain the SAT one,
+// and the extra boxes are reported. The first argument replaces the box count
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <glm/vec3.hpp>
+#include <glm/mat4x4.hpp>
+#include <glm/ext/matrix_transform.hpp>
+#include <glm/ext/matrix_clip_space.hpp>
+
+#include "aabb.hpp"
+#include "frustum.hpp"
+#include "intersect.hpp"
+#include "batch_cull.hpp"
+
+template <typename Function>
+double time_ns(Function const & function)
+{
+	auto const start = std::chrono::steady_clock::now();
+	function();
+	return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char ** argv) try
+{
+	std::size_t const count = (argc > 1) ? std::stoul(argv[1]) : 100'000;
+	int const repeats = 10;
+
+	std::mt19937 rng(12345);
+	std::uniform_real_distribution<float> position(-100.f, 100.f);
+	std::uniform_real_distribution<float> size(0.1f, 2.f);
+
+	std::vector<glm::vec3> box_min, box_max;
+	aabb_soa boxes;
+	for (std::size_t i = 0; i < count; ++i)
+	{
+		glm::vec3 min(position(rng), position(rng), position(rng));
+		glm::vec3 max = min + glm::vec3(size(rng), size(rng), size(rng));
+		box_min.push_back(min);
+		box_max.push_back(max);
+		boxes.push_back(min, max);
+	}
+
+	glm::mat4 const projection = glm::perspective(glm::radians(60.f), 16.f / 9.f, 0.1f, 150.f);
+	glm::vec3 const targets[] = {{1.f, 0.f, 0.f}, {0.f, 0.f, -1.f}, {1.f, 1.f, 1.f}, {-0.3f, -0.8f, 0.5f}};
+
+	std::vector<std::uint32_t> sat_visible, batch_visible;
+	double sat_ns = 0.0, batch_ns = 0.0;
+	std::size_t sat_total = 0, extra_total = 0, missing_total = 0;
+
+	std::cout << count << " boxes" << std::endl;
+
+	for (auto const & target : targets)
+	{
+		glm::mat4 const view_projection = projection * glm::lookAt(glm::vec3(0.f), target, glm::vec3(0.f, 1.f, 0.f));
+
+		for (int r = 0; r < repeats; ++r)
+		{
+			sat_ns += time_ns([&]
+			{
+				frustum view_frustum(view_projection);
+				sat_visible.clear();
+				for (std::size_t i = 0; i < count; ++i)
+					if (intersect(view_frustum, aabb(box_min[i], box_max[i])))
+						sat_visible.push_back(i);
+			});
+
+			batch_ns += time_ns([&]{ cull_aabbs(frustum_planes(view_projection), boxes, batch_visible); });
+		}
+
+		// Both lists are sorted by index
+		std::vector<std::uint32_t> missing, extra;
+		std::set_difference(sat_visible.begin(), sat_visible.end(), batch_visible.begin(), batch_visible.end(), std::back_inserter(missing));
+		std::set_difference(batch_visible.begin(), batch_visible.end(), sat_visible.begin(), sat_visible.end(), std::back_inserter(extra));
+
+		std::cout << "  SAT " << sat_visible.size() << " visible, batch " << batch_visible.size() << " visible: "
+			<< missing.size() << " missing, " << extra.size() << " extra near the frustum corners" << std::endl;
+
+		sat_total += sat_visible.size();
+		missing_total += missing.size();
+		extra_total += extra.size();
+	}
+
+	double const tests = double(count) * repeats * std::size(targets);
+	std::cout << "SAT: " << sat_ns / tests << " ns/box, batch: " << batch_ns / tests << " ns/box, "
+		<< sat_ns / batch_ns << "x faster" << std::endl;
+
+	// The extra boxes only come from the corners, so they must stay a small fraction
+	if (missing_total > 0 || extra_total * 10 > sat_total)
+		throw std::runtime_error("Batch culling disagrees with SAT: " + std::to_string(missing_total) + " missing, " + std::to_string(extra_total) + " extra");
+
+	return EXIT_SUCCESS;
+}
+catch (std::exception const & e)
+{
+	std::cerr << e.what() << std::endl;
+	return EXIT_FAILURE;
+}
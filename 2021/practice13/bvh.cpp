@@ -0,0 +1,447 @@
+#include "bvh.hpp"
+
+#include <glm/common.hpp>
+#include <glm/geometric.hpp>
+#include <glm/vector_relational.hpp>
+
+#include <algorithm>
+#include <numeric>
+#include <limits>
+#include <cmath>
+
+namespace
+{
+
+	float area(glm::vec3 const & min, glm::vec3 const & max)
+	{
+		glm::vec3 d = max - min;
+		return 2.f * (d.x * d.y + d.y * d.z + d.z * d.x);
+	}
+
+	bool overlap(glm::vec3 const & min1, glm::vec3 const & max1, glm::vec3 const & min2, glm::vec3 const & max2)
+	{
+		return glm::all(glm::lessThanEqual(min1, max2)) && glm::all(glm::lessThanEqual(min2, max1));
+	}
+
+	bool ray_hits(glm::vec3 const & origin, glm::vec3 const & direction, float max_distance, glm::vec3 const & min, glm::vec3 const & max)
+	{
+		float t0 = 0.f;
+		float t1 = max_distance;
+
+		for (int i = 0; i < 3; ++i)
+		{
+			if (direction[i] == 0.f)
+			{
+				if (origin[i] < min[i] || origin[i] > max[i])
+					return false;
+				continue;
+			}
+
+			float inv = 1.f / direction[i];
+			float a = (min[i] - origin[i]) * inv;
+			float b = (max[i] - origin[i]) * inv;
+			if (a > b)
+				std::swap(a, b);
+
+			t0 = std::max(t0, a);
+			t1 = std::min(t1, b);
+			if (t0 > t1)
+				return false;
+		}
+
+		return true;
+	}
+
+	constexpr int sah_bins = 12;
+
+}
+
+std::uint32_t bvh::allocate()
+{
+	if (!free_nodes.empty())
+	{
+		std::uint32_t id = free_nodes.back();
+		free_nodes.pop_back();
+		return id;
+	}
+
+	nodes.emplace_back();
+	return nodes.size() - 1;
+}
+
+void bvh::release(std::uint32_t id)
+{
+	nodes[id] = node{};
+	free_nodes.push_back(id);
+}
+
+void bvh::refit_ancestors(std::uint32_t id)
+{
+	for (; id != null; id = nodes[id].parent)
+	{
+		node & n = nodes[id];
+		n.min = glm::min(nodes[n.left].min, nodes[n.right].min);
+		n.max = glm::max(nodes[n.left].max, nodes[n.right].max);
+	}
+}
+
+std::vector<std::uint32_t> bvh::build(std::vector<std::pair<glm::vec3, glm::vec3>> const & boxes)
+{
+	nodes.clear();
+	free_nodes.clear();
+	root = null;
+
+	std::vector<std::uint32_t> leaves(boxes.size(), null);
+	if (boxes.empty())
+		return leaves;
+
+	nodes.reserve(2 * boxes.size() - 1);
+
+	std::vector<std::uint32_t> objects(boxes.size());
+	std::iota(objects.begin(), objects.end(), 0);
+
+	root = build(boxes, leaves, objects.begin(), objects.end());
+	return leaves;
+}
+
+std::uint32_t bvh::build(std::vector<std::pair<glm::vec3, glm::vec3>> const & boxes, std::vector<std::uint32_t> & leaves,
+	std::vector<std::uint32_t>::iterator begin, std::vector<std::uint32_t>::iterator end)
+{
+	static constexpr float inf = std::numeric_limits<float>::infinity();
+
+	std::uint32_t id = allocate();
+
+	if (end - begin == 1)
+	{
+		nodes[id].min = boxes[*begin].first;
+		nodes[id].max = boxes[*begin].second;
+		nodes[id].object = *begin;
+		leaves[*begin] = id;
+		return id;
+	}
+
+	auto centroid = [&](std::uint32_t object)
+	{
+		return (boxes[object].first + boxes[object].second) / 2.f;
+	};
+
+	glm::vec3 centroid_min(inf), centroid_max(-inf);
+	for (auto it = begin; it != end; ++it)
+	{
+		centroid_min = glm::min(centroid_min, centroid(*it));
+		centroid_max = glm::max(centroid_max, centroid(*it));
+	}
+
+	// Pick the cheapest split between the bins along any axis,
+	// the cost of a split being area(left) * count(left) + area(right) * count(right)
+	int best_axis = -1;
+	int best_split = 0;
+	float best_cost = inf;
+
+	for (int axis = 0; axis < 3; ++axis)
+	{
+		float extent = centroid_max[axis] - centroid_min[axis];
+		if (extent <= 0.f)
+			continue;
+
+		std::array<glm::vec3, sah_bins> bin_min, bin_max;
+		std::array<std::size_t, sah_bins> bin_count{};
+		bin_min.fill(glm::vec3(inf));
+		bin_max.fill(glm::vec3(-inf));
+
+		for (auto it = begin; it != end; ++it)
+		{
+			int bin = std::min<int>(sah_bins - 1, (centroid(*it)[axis] - centroid_min[axis]) / extent * sah_bins);
+			bin_min[bin] = glm::min(bin_min[bin], boxes[*it].first);
+			bin_max[bin] = glm::max(bin_max[bin], boxes[*it].second);
+			++bin_count[bin];
+		}
+
+		// Right-side areas and counts for every split, accumulated from the end
+		std::array<float, sah_bins> right_cost;
+		glm::vec3 min(inf), max(-inf);
+		std::size_t count = 0;
+		for (int i = sah_bins - 1; i > 0; --i)
+		{
+			min = glm::min(min, bin_min[i]);
+			max = glm::max(max, bin_max[i]);
+			count += bin_count[i];
+			right_cost[i] = count > 0 ? area(min, max) * count : 0.f;
+		}
+
+		min = glm::vec3(inf);
+		max = glm::vec3(-inf);
+		count = 0;
+		for (int i = 1; i < sah_bins; ++i)
+		{
+			min = glm::min(min, bin_min[i - 1]);
+			max = glm::max(max, bin_max[i - 1]);
+			count += bin_count[i - 1];
+			if (count == 0 || count == std::size_t(end - begin))
+				continue;
+
+			float cost = area(min, max) * count + right_cost[i];
+			if (cost < best_cost)
+			{
+				best_cost = cost;
+				best_axis = axis;
+				best_split = i;
+			}
+		}
+	}
+
+	auto middle = begin + (end - begin) / 2;
+
+	if (best_axis >= 0)
+	{
+		float extent = centroid_max[best_axis] - centroid_min[best_axis];
+		middle = std::partition(begin, end, [&](std::uint32_t object)
+		{
+			int bin = std::min<int>(sah_bins - 1, (centroid(object)[best_axis] - centroid_min[best_axis]) / extent * sah_bins);
+			return bin < best_split;
+		});
+	}
+
+	// All the centroids coincide, or the partition didn't separate anything
+	if (middle == begin || middle == end)
+		middle = begin + (end - begin) / 2;
+
+	std::uint32_t left = build(boxes, leaves, begin, middle);
+	std::uint32_t right = build(boxes, leaves, middle, end);
+
+	node & n = nodes[id];
+	n.left = left;
+	n.right = right;
+	n.min = glm::min(nodes[left].min, nodes[right].min);
+	n.max = glm::max(nodes[left].max, nodes[right].max);
+	nodes[left].parent = id;
+	nodes[right].parent = id;
+
+	return id;
+}
+
+std::uint32_t bvh::insert(glm::vec3 const & min, glm::vec3 const & max, std::uint32_t object)
+{
+	std::uint32_t leaf = allocate();
+	nodes[leaf].min = min;
+	nodes[leaf].max = max;
+	nodes[leaf].object = object;
+
+	if (root == null)
+	{
+		root = leaf;
+		return leaf;
+	}
+
+	// Descend while creating a new parent deeper costs less than creating it here,
+	// the cost being the area of the new parent plus the growth of its ancestors
+	std::uint32_t sibling = root;
+	while (!nodes[sibling].is_leaf())
+	{
+		node const & n = nodes[sibling];
+
+		float combined = area(glm::min(n.min, min), glm::max(n.max, max));
+		float cost = 2.f * combined;
+		float inheritance = 2.f * (combined - area(n.min, n.max));
+
+		auto child_cost = [&](std::uint32_t child)
+		{
+			node const & c = nodes[child];
+			float cost = area(glm::min(c.min, min), glm::max(c.max, max)) + inheritance;
+			if (!c.is_leaf())
+				cost -= area(c.min, c.max);
+			return cost;
+		};
+
+		float left_cost = child_cost(n.left);
+		float right_cost = child_cost(n.right);
+
+		if (cost < left_cost && cost < right_cost)
+			break;
+
+		sibling = (left_cost < right_cost) ? n.left : n.right;
+	}
+
+	std::uint32_t old_parent = nodes[sibling].parent;
+	std::uint32_t new_parent = allocate();
+
+	nodes[new_parent].parent = old_parent;
+	nodes[new_parent].left = sibling;
+	nodes[new_parent].right = leaf;
+
+	if (old_parent == null)
+		root = new_parent;
+	else if (nodes[old_parent].left == sibling)
+		nodes[old_parent].left = new_parent;
+	else
+		nodes[old_parent].right = new_parent;
+
+	nodes[sibling].parent = new_parent;
+	nodes[leaf].parent = new_parent;
+
+	refit_ancestors(new_parent);
+
+	return leaf;
+}
+
+void bvh::remove(std::uint32_t leaf)
+{
+	std::uint32_t parent = nodes[leaf].parent;
+	release(leaf);
+
+	if (parent == null)
+	{
+		root = null;
+		return;
+	}
+
+	std::uint32_t grandparent = nodes[parent].parent;
+	std::uint32_t sibling = (nodes[parent].left == leaf) ? nodes[parent].right : nodes[parent].left;
+	release(parent);
+
+	nodes[sibling].parent = grandparent;
+
+	if (grandparent == null)
+	{
+		root = sibling;
+		return;
+	}
+
+	if (nodes[grandparent].left == parent)
+		nodes[grandparent].left = sibling;
+	else
+		nodes[grandparent].right = sibling;
+
+	refit_ancestors(grandparent);
+}
+
+void bvh::refit(std::uint32_t leaf, glm::vec3 const & min, glm::vec3 const & max)
+{
+	nodes[leaf].min = min;
+	nodes[leaf].max = max;
+	refit_ancestors(nodes[leaf].parent);
+}
+
+void bvh::cull(std::array<glm::vec4, 6> const & planes, std::vector<std::uint32_t> & result) const
+{
+	result.clear();
+	if (root == null)
+		return;
+
+	// Each node comes with a mask of the planes it may still cross;
+	// planes its parent is completely inside of are not tested again
+	static constexpr std::uint32_t all_planes = (1 << 6) - 1;
+
+	std::vector<std::pair<std::uint32_t, std::uint32_t>> stack;
+	std::vector<std::uint32_t> inside_stack;
+	stack.push_back({root, all_planes});
+
+	while (!stack.empty())
+	{
+		auto [id, mask] = stack.back();
+		stack.pop_back();
+
+		node const & n = nodes[id];
+
+		glm::vec3 center = (n.min + n.max) / 2.f;
+		glm::vec3 extent = (n.max - n.min) / 2.f;
+
+		bool outside = false;
+		for (int i = 0; i < 6 && !outside; ++i)
+		{
+			if (!(mask & (1 << i)))
+				continue;
+
+			glm::vec3 normal(planes[i]);
+			float d = glm::dot(normal, center) + planes[i].w;
+			float r = glm::dot(glm::abs(normal), extent);
+
+			if (d + r < 0.f)
+				outside = true;
+			else if (d - r >= 0.f)
+				mask &= ~(1 << i);
+		}
+
+		if (outside)
+			continue;
+
+		if (n.is_leaf())
+		{
+			result.push_back(n.object);
+			continue;
+		}
+
+		if (mask != 0)
+		{
+			stack.push_back({n.right, mask});
+			stack.push_back({n.left, mask});
+			continue;
+		}
+
+		// Completely inside: take the whole subtree
+		inside_stack.push_back(id);
+		while (!inside_stack.empty())
+		{
+			node const & m = nodes[inside_stack.back()];
+			inside_stack.pop_back();
+
+			if (m.is_leaf())
+				result.push_back(m.object);
+			else
+			{
+				inside_stack.push_back(m.right);
+				inside_stack.push_back(m.left);
+			}
+		}
+	}
+}
+
+void bvh::query(glm::vec3 const & min, glm::vec3 const & max, std::vector<std::uint32_t> & result) const
+{
+	result.clear();
+	if (root == null)
+		return;
+
+	std::vector<std::uint32_t> stack{root};
+	while (!stack.empty())
+	{
+		node const & n = nodes[stack.back()];
+		stack.pop_back();
+
+		if (!overlap(n.min, n.max, min, max))
+			continue;
+
+		if (n.is_leaf())
+			result.push_back(n.object);
+		else
+		{
+			stack.push_back(n.right);
+			stack.push_back(n.left);
+		}
+	}
+}
+
+void bvh::raycast(glm::vec3 const & origin, glm::vec3 const & direction, float max_distance, std::vector<std::uint32_t> & result) const
+{
+	result.clear();
+	if (root == null)
+		return;
+
+	std::vector<std::uint32_t> stack{root};
+	while (!stack.empty())
+	{
+		node const & n = nodes[stack.back()];
+		stack.pop_back();
+
+		if (!ray_hits(origin, direction, max_distance, n.min, n.max))
+			continue;
+
+		if (n.is_leaf())
+			result.push_back(n.object);
+		else
+		{
+			stack.push_back(n.right);
+			stack.push_back(n.left);
+		}
+	}
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+
+#include <array>
+#include <vector>
+#include <utility>
+#include <cstdint>
+
+// Dynamic AABB tree with one object per leaf. Nodes are addressed by indices
+// into a pool, so the indices returned by insert stay valid until removal
+struct bvh
+{
+	static constexpr std::uint32_t null = -1;
+
+	struct node
+	{
+		glm::vec3 min, max;
+		std::uint32_t parent = null;
+		// Both are null for leaves
+		std::uint32_t left = null, right = null;
+		// Leaves only
+		std::uint32_t object = null;
+
+		bool is_leaf() const
+		{
+			return left == null;
+		}
+	};
+
+	std::vector<node> nodes;
+	std::uint32_t root = null;
+
+	// Rebuilds the whole tree top-down with the binned surface area heuristic;
+	// object i gets the box boxes[i] and its leaf is returned at index i
+	std::vector<std::uint32_t> build(std::vector<std::pair<glm::vec3, glm::vec3>> const & boxes);
+
+	// Inserts a leaf next to the sibling which increases the total surface area the least
+	std::uint32_t insert(glm::vec3 const & min, glm::vec3 const & max, std::uint32_t object);
+	void remove(std::uint32_t leaf);
+
+	// Changes the box of a leaf and refits its ancestors, keeping the topology;
+	// fine for small motions, while objects moving far should be removed and reinserted
+	void refit(std::uint32_t leaf, glm::vec3 const & min, glm::vec3 const & max);
+
+	// Objects whose boxes are not completely outside any of the planes
+	// (see frustum_planes). Subtrees completely inside the planes are accepted without further tests
+	void cull(std::array<glm::vec4, 6> const & planes, std::vector<std::uint32_t> & result) const;
+
+	// Objects whose boxes overlap the box
+	void query(glm::vec3 const & min, glm::vec3 const & max, std::vector<std::uint32_t> & result) const;
+
+	// Objects whose boxes are hit by the ray within max_distance (in units of direction length)
+	void raycast(glm::vec3 const & origin, glm::vec3 const & direction, float max_distance, std::vector<std::uint32_t> & result) const;
+
+private:
+	std::vector<std::uint32_t> free_nodes;
+
+	std::uint32_t allocate();
+	void release(std::uint32_t id);
+	void refit_ancestors(std::uint32_t id);
+	std::uint32_t build(std::vector<std::pair<glm::vec3, glm::vec3>> const & boxes, std::vector<std::uint32_t> & leaves,
+		std::vector<std::uint32_t>::iterator begin, std::vector<std::uint32_t>::iterator end);
+};
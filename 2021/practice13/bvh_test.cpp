@@ -0,0 +1,313 @@
+// Compares the results of bvh::cull, query and raycast with brute force over random
+// boxes, after build and after each step of an update sequence: insert one by one,
+// remove half of the objects, reinsert a quarter of them, and refit the rest.
+// After every step the tree structure is checked too: parent links, boxes fitting
+// the children, and every node either reachable or on the free list. Reinserting
+// must reuse the freed nodes instead of growing the pool
+
+#include <algorithm>
+#include <array>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+#include <glm/mat4x4.hpp>
+#include <glm/common.hpp>
+#include <glm/geometric.hpp>
+#include <glm/ext/matrix_transform.hpp>
+#include <glm/ext/matrix_clip_space.hpp>
+
+#include "batch_cull.hpp"
+#include "bvh.hpp"
+
+std::mt19937 rng(12345);
+
+float uniform(float min, float max)
+{
+	return std::uniform_real_distribution<float>(min, max)(rng);
+}
+
+glm::vec3 random_point(float range)
+{
+	return {uniform(-range, range), uniform(-range, range), uniform(-range, range)};
+}
+
+struct object
+{
+	glm::vec3 min, max;
+	// null if the object is not in the tree
+	std::uint32_t leaf = bvh::null;
+};
+
+std::pair<glm::vec3, glm::vec3> random_box()
+{
+	glm::vec3 min = random_point(500.f);
+	return {min, min + glm::vec3(uniform(0.1f, 5.f), uniform(0.1f, 5.f), uniform(0.1f, 5.f))};
+}
+
+bool ray_hits(glm::vec3 const & origin, glm::vec3 const & direction, float max_distance, glm::vec3 const & min, glm::vec3 const & max)
+{
+	float t0 = 0.f;
+	float t1 = max_distance;
+
+	for (int i = 0; i < 3; ++i)
+	{
+		if (direction[i] == 0.f)
+		{
+			if (origin[i] < min[i] || origin[i] > max[i])
+				return false;
+			continue;
+		}
+
+		float inv = 1.f / direction[i];
+		float a = (min[i] - origin[i]) * inv;
+		float b = (max[i] - origin[i]) * inv;
+		if (a > b)
+			std::swap(a, b);
+
+		t0 = std::max(t0, a);
+		t1 = std::min(t1, b);
+		if (t0 > t1)
+			return false;
+	}
+
+	return true;
+}
+
+void check_structure(bvh const & tree, std::vector<object> const & objects)
+{
+	std::vector<bool> reached(tree.nodes.size(), false);
+	std::size_t leaves = 0;
+
+	if (tree.root != bvh::null)
+	{
+		if (tree.nodes[tree.root].parent != bvh::null)
+			throw std::runtime_error("The root has a parent");
+
+		std::vector<std::uint32_t> stack{tree.root};
+		while (!stack.empty())
+		{
+			std::uint32_t id = stack.back();
+			stack.pop_back();
+
+			if (reached[id])
+				throw std::runtime_error("Node " + std::to_string(id) + " is reached twice");
+			reached[id] = true;
+
+			bvh::node const & n = tree.nodes[id];
+			if (n.is_leaf())
+			{
+				if (n.right != bvh::null || n.object >= objects.size() || objects[n.object].leaf != id)
+					throw std::runtime_error("Leaf " + std::to_string(id) + " doesn't match its object");
+				if (n.min != objects[n.object].min || n.max != objects[n.object].max)
+					throw std::runtime_error("Leaf " + std::to_string(id) + " has a wrong box");
+				++leaves;
+				continue;
+			}
+
+			for (std::uint32_t child : {n.left, n.right})
+				if (child == bvh::null || tree.nodes[child].parent != id)
+					throw std::runtime_error("Node " + std::to_string(id) + " has a broken child link");
+
+			// Exactly the union, a larger box is not wrong but means a missed refit
+			bvh::node const & l = tree.nodes[n.left];
+			bvh::node const & r = tree.nodes[n.right];
+			if (n.min != glm::min(l.min, r.min) || n.max != glm::max(l.max, r.max))
+				throw std::runtime_error("Node " + std::to_string(id) + " doesn't fit its children");
+			stack.push_back(n.left);
+			stack.push_back(n.right);
+		}
+	}
+
+	std::size_t in_tree = std::count_if(objects.begin(), objects.end(), [](object const & o){ return o.leaf != bvh::null; });
+	if (leaves != in_tree)
+		throw std::runtime_error(std::to_string(leaves) + " leaves for " + std::to_string(in_tree) + " objects in the tree");
+
+	// A binary tree of n leaves has 2n - 1 nodes, the rest of the pool must be free
+	std::size_t reached_count = std::count(reached.begin(), reached.end(), true);
+	if (reached_count != (leaves > 0 ? 2 * leaves - 1 : 0))
+		throw std::runtime_error(std::to_string(reached_count) + " nodes for " + std::to_string(leaves) + " leaves");
+
+	// Freed nodes are reset, so a leaf with no object is a free one
+	std::size_t free_count = std::count_if(tree.nodes.begin(), tree.nodes.end(), [](bvh::node const & n){ return n.is_leaf() && n.object == bvh::null; });
+	if (reached_count + free_count != tree.nodes.size())
+		throw std::runtime_error(std::to_string(tree.nodes.size() - reached_count - free_count) + " nodes are neither in the tree nor free");
+}
+
+int compare(std::string const & step, bvh const & tree, std::vector<object> const & objects)
+{
+	check_structure(tree, objects);
+
+	int failures = 0;
+	std::vector<std::uint32_t> actual, expected;
+
+	auto report = [&](char const * kind, int i)
+	{
+		std::sort(actual.begin(), actual.end());
+		if (actual != expected)
+		{
+			if (failures == 0)
+				std::cerr << step << ": " << kind << " " << i << " returns " << actual.size() << " objects instead of " << expected.size() << std::endl;
+			++failures;
+		}
+	};
+
+	glm::mat4 const projection = glm::perspective(glm::radians(60.f), 16.f / 9.f, 0.1f, 400.f);
+	for (int i = 0; i < 20; ++i)
+	{
+		glm::vec3 eye = random_point(300.f);
+		glm::mat4 view = glm::lookAt(eye, eye + random_point(1.f), glm::vec3(0.f, 1.f, 0.f));
+		auto const planes = frustum_planes(projection * view);
+
+		tree.cull(planes, actual);
+
+		expected.clear();
+		for (std::uint32_t o = 0; o < objects.size(); ++o)
+		{
+			if (objects[o].leaf == bvh::null)
+				continue;
+
+			glm::vec3 center = (objects[o].min + objects[o].max) / 2.f;
+			glm::vec3 extent = (objects[o].max - objects[o].min) / 2.f;
+			bool inside = true;
+			for (auto const & p : planes)
+				inside &= (glm::dot(glm::vec3(p), center) + p.w + glm::dot(glm::abs(glm::vec3(p)), extent) >= 0.f);
+			if (inside)
+				expected.push_back(o);
+		}
+		report("cull", i);
+	}
+
+	for (int i = 0; i < 100; ++i)
+	{
+		glm::vec3 min = random_point(500.f);
+		glm::vec3 max = min + glm::vec3(uniform(0.f, 50.f), uniform(0.f, 50.f), uniform(0.f, 50.f));
+
+		tree.query(min, max, actual);
+
+		expected.clear();
+		for (std::uint32_t o = 0; o < objects.size(); ++o)
+			if (objects[o].leaf != bvh::null && glm::all(glm::lessThanEqual(objects[o].min, max)) && glm::all(glm::lessThanEqual(min, objects[o].max)))
+				expected.push_back(o);
+		report("query", i);
+	}
+
+	for (int i = 0; i < 100; ++i)
+	{
+		glm::vec3 origin = random_point(500.f);
+		glm::vec3 direction = random_point(1.f);
+		// Some rays parallel to the axes
+		if (i % 4 == 0)
+			direction[i % 3] = 0.f;
+		float max_distance = uniform(100.f, 2000.f);
+
+		tree.raycast(origin, direction, max_distance, actual);
+
+		expected.clear();
+		for (std::uint32_t o = 0; o < objects.size(); ++o)
+			if (objects[o].leaf != bvh::null && ray_hits(origin, direction, max_distance, objects[o].min, objects[o].max))
+				expected.push_back(o);
+		report("raycast", i);
+	}
+
+	std::cout << step << ": " << std::count_if(objects.begin(), objects.end(), [](object const & o){ return o.leaf != bvh::null; })
+		<< " objects, " << tree.nodes.size() << " nodes in the pool, " << failures << " failures" << std::endl;
+
+	return failures;
+}
+
+int main() try
+{
+	std::size_t const count = 100'000;
+
+	std::vector<object> objects(count);
+	std::vector<std::pair<glm::vec3, glm::vec3>> boxes(count);
+	for (std::size_t i = 0; i < count; ++i)
+	{
+		boxes[i] = random_box();
+		objects[i].min = boxes[i].first;
+		objects[i].max = boxes[i].second;
+	}
+
+	int failures = 0;
+
+	bvh tree;
+	{
+		auto leaves = tree.build(boxes);
+		for (std::size_t i = 0; i < count; ++i)
+			objects[i].leaf = leaves[i];
+		failures += compare("build", tree, objects);
+	}
+
+	{
+		bvh inserted;
+		std::vector<object> inserted_objects = objects;
+		for (std::uint32_t i = 0; i < count; ++i)
+			inserted_objects[i].leaf = inserted.insert(objects[i].min, objects[i].max, i);
+		failures += compare("insert", inserted, inserted_objects);
+	}
+
+	std::vector<std::uint32_t> order(count);
+	for (std::uint32_t i = 0; i < count; ++i)
+		order[i] = i;
+	std::shuffle(order.begin(), order.end(), rng);
+
+	std::vector<std::uint32_t> const removed(order.begin(), order.begin() + count / 2);
+	std::vector<std::uint32_t> const kept(order.begin() + count / 2, order.end());
+
+	for (auto i : removed)
+	{
+		tree.remove(objects[i].leaf);
+		objects[i].leaf = bvh::null;
+	}
+	failures += compare("remove half", tree, objects);
+
+	// Reinserted with new boxes, reusing the freed nodes
+	std::size_t const pool_size = tree.nodes.size();
+	for (std::size_t k = 0; k < count / 4; ++k)
+	{
+		std::uint32_t i = removed[k];
+		std::tie(objects[i].min, objects[i].max) = random_box();
+		objects[i].leaf = tree.insert(objects[i].min, objects[i].max, i);
+	}
+	failures += compare("reinsert a quarter", tree, objects);
+	if (tree.nodes.size() != pool_size)
+	{
+		std::cerr << "The pool grew from " << pool_size << " to " << tree.nodes.size() << " nodes" << std::endl;
+		++failures;
+	}
+
+	for (auto i : kept)
+	{
+		glm::vec3 offset = random_point(2.f);
+		objects[i].min += offset;
+		objects[i].max += offset;
+		tree.refit(objects[i].leaf, objects[i].min, objects[i].max);
+	}
+	failures += compare("refit the rest", tree, objects);
+
+	// Down to an empty tree and back
+	for (auto & o : objects)
+		if (o.leaf != bvh::null)
+		{
+			tree.remove(o.leaf);
+			o.leaf = bvh::null;
+		}
+	failures += compare("remove all", tree, objects);
+
+	objects[0].leaf = tree.insert(objects[0].min, objects[0].max, 0);
+	failures += compare("insert one", tree, objects);
+
+	return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+catch (std::exception const & e)
+{
+	std::cerr << e.what() << std::endl;
+	return EXIT_FAILURE;
+}
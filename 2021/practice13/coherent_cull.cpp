@@ -0,0 +1,107 @@
+#include "coherent_cull.hpp"
+
+#include <glm/geometric.hpp>
+#include <glm/matrix.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+void coherent_culler::cull(glm::mat4 const & view, glm::mat4 const & projection, aabb_soa const & boxes, std::vector<std::uint32_t> & visible)
+{
+	visible.clear();
+
+	glm::mat4 const inverse_view = glm::inverse(view);
+	glm::vec3 const camera_position(inverse_view[3]);
+	glm::mat3 const camera_rotation(view);
+
+	if (!has_previous_ || projection != projection_ || objects_.size() != boxes.size())
+	{
+		objects_.assign(boxes.size(), object_state{});
+		total_translation_ = 0.f;
+		total_rotation_ = 0.f;
+	}
+	else
+	{
+		total_translation_ += glm::length(camera_position - camera_position_);
+
+		// Angle of the relative rotation: its skew-symmetric part has length 2 sin(angle)
+		// and its trace is 1 + 2 cos(angle). The acos of the trace alone loses the small
+		// angles of a slowly turning camera in float, rounding them down to zero
+		glm::mat3 relative = camera_rotation * glm::transpose(camera_rotation_);
+		glm::vec3 skew(relative[1][2] - relative[2][1], relative[2][0] - relative[0][2], relative[0][1] - relative[1][0]);
+		total_rotation_ += std::atan2(glm::length(skew), relative[0][0] + relative[1][1] + relative[2][2] - 1.f);
+	}
+
+	has_previous_ = true;
+	projection_ = projection;
+	camera_position_ = camera_position;
+	camera_rotation_ = camera_rotation;
+
+	// Normalized, so that plane values are distances, which the slack is compared against
+	auto planes = frustum_planes(projection * view);
+	for (auto & p : planes)
+		p /= glm::length(glm::vec3(p));
+
+	stats_ = {};
+	stats_.objects = boxes.size();
+
+	for (std::uint32_t i = 0; i < boxes.size(); ++i)
+	{
+		object_state & state = objects_[i];
+
+		glm::vec3 const center(boxes.center_x[i], boxes.center_y[i], boxes.center_z[i]);
+		glm::vec3 const extent(boxes.extent_x[i], boxes.extent_y[i], boxes.extent_z[i]);
+
+		if (state.slack >= 0.f)
+		{
+			// A plane moves by at most the camera translation plus the distance
+			// to the camera times the rotation angle; the distance to the camera
+			// itself is bounded by the current one plus the translation since then
+			float translation = total_translation_ - state.translation;
+			float rotation = total_rotation_ - state.rotation;
+			float distance = glm::length(center - camera_position) + glm::length(extent) + translation;
+
+			if (translation + distance * rotation < state.slack)
+			{
+				visible.push_back(i);
+				++stats_.skipped;
+				continue;
+			}
+		}
+
+		bool outside = false;
+		float slack = std::numeric_limits<float>::infinity();
+
+		for (int k = 0; k < 6 && !outside; ++k)
+		{
+			// Start from the plane that rejected the object last time
+			int plane = (state.last_plane + k) % 6;
+			auto const & p = planes[plane];
+
+			float d = glm::dot(glm::vec3(p), center) + p.w;
+			float r = glm::dot(glm::abs(glm::vec3(p)), extent);
+			++stats_.plane_tests;
+
+			if (d + r < 0.f)
+			{
+				outside = true;
+				state.last_plane = plane;
+			}
+			else
+				slack = std::min(slack, d - r);
+		}
+
+		if (outside)
+		{
+			state.slack = -1.f;
+			continue;
+		}
+
+		visible.push_back(i);
+
+		state.slack = slack;
+		state.translation = total_translation_;
+		state.rotation = total_rotation_;
+	}
+}
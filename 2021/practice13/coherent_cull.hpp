@@ -0,0 +1,63 @@
+#pragma once
+
+#include "batch_cull.hpp"
+
+#include <glm/mat3x3.hpp>
+#include <glm/mat4x4.hpp>
+
+#include <vector>
+#include <cstdint>
+
+struct coherent_culling_stats
+{
+	std::size_t objects = 0;
+	// Box-plane tests done during the last frame
+	std::size_t plane_tests = 0;
+	// Objects accepted without any test, being deep enough inside the frustum
+	std::size_t skipped = 0;
+
+	float tests_per_object() const
+	{
+		return objects > 0 ? float(plane_tests) / objects : 0.f;
+	}
+};
+
+// Frustum culling exploiting frame-to-frame coherence of a smoothly moving camera:
+//  - the plane that rejected an object last frame is tested first, as it most likely rejects it again
+//  - an object found completely inside the frustum remembers its distance to the closest plane,
+//    and is accepted without tests until the camera has moved or turned enough to possibly reach it
+// The result is the same as with cull_aabbs, up to rounding for boxes touching a plane.
+// Changing the projection or the box count resets the cache
+struct coherent_culler
+{
+	void cull(glm::mat4 const & view, glm::mat4 const & projection, aabb_soa const & boxes, std::vector<std::uint32_t> & visible);
+
+	coherent_culling_stats const & stats() const
+	{
+		return stats_;
+	}
+
+private:
+	struct object_state
+	{
+		std::uint8_t last_plane = 0;
+		// Negative unless the object was completely inside at the moment of the last test
+		float slack = -1.f;
+		// Camera motion accumulators at the moment of the last test
+		float translation = 0.f;
+		float rotation = 0.f;
+	};
+
+	std::vector<object_state> objects_;
+	coherent_culling_stats stats_;
+
+	bool has_previous_ = false;
+	glm::mat4 projection_;
+	glm::vec3 camera_position_;
+	glm::mat3 camera_rotation_;
+
+	// Total distance traveled and angle turned by the camera, as upper bounds for
+	// how far the frustum planes may have moved since any earlier frame
+	float total_translation_ = 0.f;
+	float total_rotation_ = 0.f;
+};
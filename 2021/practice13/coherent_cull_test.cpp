@@ -0,0 +1,139 @@
+// Runs coherent_culler along slow camera pans, turning by as little per frame as the
+// demo does without vsync, and checks that every frame's visible list equals the one
+// of cull_aabbs. A box accepted by its slack while the frustum has moved past it
+// shows up as an extra visible box. Boxes touching a plane may go either way, as the
+// two paths round differently, so differences within a tolerance of a plane are allowed
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <glm/vec3.hpp>
+#include <glm/mat4x4.hpp>
+#include <glm/geometric.hpp>
+#include <glm/ext/matrix_transform.hpp>
+#include <glm/ext/matrix_clip_space.hpp>
+#include <glm/ext/scalar_constants.hpp>
+
+#include "batch_cull.hpp"
+#include "coherent_cull.hpp"
+
+struct camera_path
+{
+	char const * name;
+	// Per frame
+	float turn;
+	float move;
+	int frames;
+};
+
+// Distance from the box to the plane it is furthest outside of, negative if it is inside all of them
+float distance_outside(std::array<glm::vec4, 6> const & planes, aabb_soa const & boxes, std::uint32_t i)
+{
+	glm::vec3 const center(boxes.center_x[i], boxes.center_y[i], boxes.center_z[i]);
+	glm::vec3 const extent(boxes.extent_x[i], boxes.extent_y[i], boxes.extent_z[i]);
+
+	float result = -std::numeric_limits<float>::infinity();
+	for (auto const & p : planes)
+	{
+		float const length = glm::length(glm::vec3(p));
+		result = std::max(result, -(glm::dot(glm::vec3(p), center) + p.w + glm::dot(glm::abs(glm::vec3(p)), extent)) / length);
+	}
+	return result;
+}
+
+int main() try
+{
+	std::mt19937 rng(12345);
+	std::uniform_real_distribution<float> position(-200.f, 200.f);
+	std::uniform_real_distribution<float> size(0.1f, 2.f);
+
+	// The instance grid of the demo, and boxes far away where a small angle moves the planes a lot
+	aabb_soa boxes;
+	for (int x = -32; x < 32; ++x)
+		for (int z = -32; z < 32; ++z)
+			boxes.push_back(glm::vec3(x - 0.4f, 0.f, z - 0.4f), glm::vec3(x + 0.4f, 0.8f, z + 0.4f));
+	for (int i = 0; i < 4096; ++i)
+	{
+		glm::vec3 min(position(rng), position(rng) / 4.f, position(rng));
+		boxes.push_back(min, min + glm::vec3(size(rng), size(rng), size(rng)));
+	}
+
+	glm::mat4 const projection = glm::perspective(glm::pi<float>() / 2.f, 16.f / 9.f, 0.01f, 500.f);
+
+	camera_path const paths[] =
+	{
+		{"turning 1e-3 rad per frame", 1e-3f, 0.f, 2000},
+		{"turning 3e-4 rad per frame", 3e-4f, 0.f, 4000},
+		{"turning 1e-4 rad per frame", 1e-4f, 0.f, 4000},
+		{"turning 2e-4 rad per frame while walking", 2e-4f, 1e-3f, 4000},
+	};
+
+	float const tolerance = 1e-4f;
+
+	std::vector<std::uint32_t> expected, actual, difference;
+	int failures = 0;
+
+	for (auto const & path : paths)
+	{
+		coherent_culler culler;
+		glm::vec3 camera_position(0.f, 0.5f, 0.f);
+		float camera_rotation = 0.f;
+		std::size_t mismatched_frames = 0, skipped = 0, objects = 0;
+
+		for (int frame = 0; frame < path.frames; ++frame)
+		{
+			camera_rotation += path.turn;
+			camera_position += path.move * glm::vec3(-std::sin(camera_rotation), 0.f, std::cos(camera_rotation));
+
+			glm::mat4 view(1.f);
+			view = glm::rotate(view, camera_rotation, {0.f, 1.f, 0.f});
+			view = glm::translate(view, -camera_position);
+
+			auto const planes = frustum_planes(projection * view);
+			cull_aabbs(planes, boxes, expected);
+			culler.cull(view, projection, boxes, actual);
+
+			skipped += culler.stats().skipped;
+			objects += culler.stats().objects;
+
+			difference.clear();
+			std::set_symmetric_difference(expected.begin(), expected.end(), actual.begin(), actual.end(), std::back_inserter(difference));
+
+			bool mismatch = false;
+			for (auto i : difference)
+			{
+				float const distance = distance_outside(planes, boxes, i);
+				if (std::abs(distance) <= tolerance)
+					continue;
+
+				if (mismatched_frames == 0)
+					std::cerr << path.name << ": frame " << frame << ", box " << i << " is " << (distance > 0.f ? "visible" : "culled")
+						<< " while " << std::abs(distance) << " " << (distance > 0.f ? "outside" : "inside") << " the frustum" << std::endl;
+				mismatch = true;
+			}
+			if (mismatch)
+				++mismatched_frames;
+		}
+
+		std::cout << path.name << ": " << path.frames << " frames, " << mismatched_frames << " differ from cull_aabbs, "
+			<< (100.0 * skipped / objects) << "% of the boxes accepted without tests" << std::endl;
+
+		if (mismatched_frames > 0)
+			++failures;
+	}
+
+	return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+catch (std::exception const & e)
+{
+	std::cerr << e.what() << std::endl;
+	return EXIT_FAILURE;
+}
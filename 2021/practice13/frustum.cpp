@@ -1,6 +1,9 @@
 #include "frustum.hpp"
 
 #include <glm/geometric.hpp>
+#include <glm/common.hpp>
+
+#include <limits>
 
 frustum::frustum(glm::mat4 const & view_projection)
 {
@@ -44,4 +47,25 @@ frustum::frustum(glm::mat4 const & view_projection)
 		e(2, 6),
 		e(3, 7),
 	};
+
+	static constexpr float inf = std::numeric_limits<float>::infinity();
+
+	for (std::size_t i = 0; i < face_normals.size(); ++i)
+	{
+		face_projections[i] = {inf, -inf};
+		for (auto const & p : vertices)
+		{
+			float v = glm::dot(p, face_normals[i]);
+			face_projections[i].first = std::min(face_projections[i].first, v);
+			face_projections[i].second = std::max(face_projections[i].second, v);
+		}
+	}
+
+	min = glm::vec3(inf);
+	max = glm::vec3(-inf);
+	for (auto const & p : vertices)
+	{
+		min = glm::min(min, p);
+		max = glm::max(max, p);
+	}
 }
@@ -4,6 +4,7 @@
 #include <glm/mat4x4.hpp>
 
 #include <array>
+#include <utility>
 
 struct frustum
 {
@@ -11,5 +12,10 @@ struct frustum
 	std::array<glm::vec3, 5> face_normals;
 	std::array<glm::vec3, 6> edge_directions;
 
+	// Projections of the vertices onto the own face normals and the coordinate axes,
+	// computed once for all the intersection tests against this frustum
+	std::array<std::pair<float, float>, 5> face_projections;
+	glm::vec3 min, max;
+
 	frustum(glm::mat4 const & view_projection);
 };
@@ -1,10 +1,15 @@
 #pragma once
 
+#include "aabb.hpp"
+#include "obb.hpp"
+#include "frustum.hpp"
+
 #include <glm/vec3.hpp>
 #include <glm/geometric.hpp>
 
 #include <limits>
 #include <utility>
+#include <type_traits>
 #include <cmath>
 
 template <typename Body>
@@ -25,17 +30,38 @@ std::pair<float, float> project(Body const & b, glm::vec3 const & n)
 	return {min, max};
 }
 
+// Projections of boxes don't need to go through all the vertices:
+// for an aabb, the extreme vertices are picked by the signs of the axis
+// components, which gives exactly the same result as project()
+inline std::pair<float, float> project_box(aabb const & b, glm::vec3 const & n)
+{
+	glm::vec3 lo{n.x >= 0.f ? b.min.x : b.max.x, n.y >= 0.f ? b.min.y : b.max.y, n.z >= 0.f ? b.min.z : b.max.z};
+	glm::vec3 hi{n.x >= 0.f ? b.max.x : b.min.x, n.y >= 0.f ? b.max.y : b.min.y, n.z >= 0.f ? b.max.z : b.min.z};
+	return {glm::dot(lo, n), glm::dot(hi, n)};
+}
+
+inline std::pair<float, float> project_box(obb const & b, glm::vec3 const & n)
+{
+	float c = glm::dot(b.center, n);
+	float r = b.half_extents.x * std::abs(glm::dot(b.axes[0], n))
+		+ b.half_extents.y * std::abs(glm::dot(b.axes[1], n))
+		+ b.half_extents.z * std::abs(glm::dot(b.axes[2], n));
+	return {c - r, c + r};
+}
+
+inline bool overlap(std::pair<float, float> const & p1, std::pair<float, float> const & p2)
+{
+	return (p1.first <= p2.second) && (p2.first <= p1.second);
+}
+
 template <typename Body1, typename Body2>
 bool intersect_along(Body1 const & b1, Body2 const & b2, glm::vec3 const & n)
 {
-	auto [min1, max1] = project(b1, n);
-	auto [min2, max2] = project(b2, n);
-
-	return (min1 <= max2) && (min2 <= max1);
+	return overlap(project(b1, n), project(b2, n));
 }
 
 template <typename Body1, typename Body2>
-bool intersect(Body1 const & b1, Body2 const & b2)
+bool intersect_generic(Body1 const & b1, Body2 const & b2)
 {
 	for (auto const & n : b1.face_normals)
 	{
@@ -61,3 +87,72 @@ bool intersect(Body1 const & b1, Body2 const & b2)
 
 	return true;
 }
+
+// All the axes are the coordinate ones (cross products of the edges are
+// either them or zero), so the test is just a comparison of the ranges
+inline bool intersect_boxes(aabb const & b1, aabb const & b2)
+{
+	for (int i = 0; i < 3; ++i)
+	{
+		if (!overlap({b1.min[i], b1.max[i]}, {b2.min[i], b2.max[i]}))
+			return false;
+	}
+
+	return true;
+}
+
+template <typename Box>
+bool intersect_box_frustum(Box const & b, frustum const & f)
+{
+	for (int i = 0; i < 3; ++i)
+	{
+		if constexpr (std::is_same_v<Box, aabb>)
+		{
+			if (!overlap({b.min[i], b.max[i]}, {f.min[i], f.max[i]}))
+				return false;
+		}
+		else
+		{
+			if (!overlap(b.face_projections[i], project(f, b.face_normals[i])))
+				return false;
+		}
+	}
+
+	for (std::size_t i = 0; i < f.face_normals.size(); ++i)
+	{
+		if (!overlap(project_box(b, f.face_normals[i]), f.face_projections[i]))
+			return false;
+	}
+
+	for (auto const & e1 : b.edge_directions)
+	{
+		for (auto const & e2 : f.edge_directions)
+		{
+			glm::vec3 n = glm::cross(e1, e2);
+
+			// Parallel edges give no axis; every projection onto zero overlaps anyway
+			if (n == glm::vec3(0.f))
+				continue;
+
+			if (!overlap(project_box(b, n), project(f, n)))
+				return false;
+		}
+	}
+
+	return true;
+}
+
+// Picks a specialized test for the pairs of bodies it knows about,
+// falling back to the generic separating axis test otherwise
+template <typename Body1, typename Body2>
+bool intersect(Body1 const & b1, Body2 const & b2)
+{
+	if constexpr (std::is_same_v<Body1, aabb> && std::is_same_v<Body2, aabb>)
+		return intersect_boxes(b1, b2);
+	else if constexpr ((std::is_same_v<Body1, aabb> || std::is_same_v<Body1, obb>) && std::is_same_v<Body2, frustum>)
+		return intersect_box_frustum(b1, b2);
+	else if constexpr (std::is_same_v<Body1, frustum> && (std::is_same_v<Body2, aabb> || std::is_same_v<Body2, obb>))
+		return intersect_box_frustum(b2, b1);
+	else
+		return intersect_generic(b1, b2);
+}
@@ -0,0 +1,157 @@
+// Compares the specialized intersect() with intersect_generic() on random bodies.
+// Besides the general positions, it generates the cases where the specialized
+// tests drop axes: axis-aligned frusta and boxes, touching boxes, flat and point boxes
+
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <string>
+
+#include <glm/vec3.hpp>
+#include <glm/mat3x3.hpp>
+#include <glm/mat4x4.hpp>
+#include <glm/ext/matrix_transform.hpp>
+#include <glm/ext/matrix_clip_space.hpp>
+#include <glm/ext/scalar_constants.hpp>
+
+#include "aabb.hpp"
+#include "obb.hpp"
+#include "frustum.hpp"
+#include "intersect.hpp"
+
+std::mt19937 rng(12345);
+
+float uniform(float min, float max)
+{
+	return std::uniform_real_distribution<float>(min, max)(rng);
+}
+
+int uniform_int(int min, int max)
+{
+	return std::uniform_int_distribution<int>(min, max)(rng);
+}
+
+glm::vec3 random_point(float range)
+{
+	return {uniform(-range, range), uniform(-range, range), uniform(-range, range)};
+}
+
+// Integer corners make touching boxes compare exactly in both paths,
+// and zero sizes make flat and point boxes
+aabb random_aabb()
+{
+	glm::vec3 min, max;
+	if (uniform_int(0, 1))
+	{
+		for (int i = 0; i < 3; ++i)
+		{
+			min[i] = float(uniform_int(-4, 4));
+			max[i] = min[i] + float(uniform_int(0, 3));
+		}
+	}
+	else
+	{
+		min = random_point(8.f);
+		max = min + glm::vec3(uniform(0.f, 6.f), uniform(0.f, 6.f), uniform(0.f, 6.f));
+		if (uniform_int(0, 3) == 0)
+		{
+			int const flat = uniform_int(0, 2);
+			max[flat] = min[flat];
+		}
+	}
+	return aabb(min, max);
+}
+
+glm::mat3 random_rotation()
+{
+	switch (uniform_int(0, 3))
+	{
+	case 0:
+		return glm::mat3(1.f);
+	case 1:
+		// A quarter turn, still axis-aligned but with permuted axes
+		return glm::mat3(glm::rotate(glm::mat4(1.f), glm::pi<float>() / 2.f, glm::vec3(0.f, 0.f, 1.f)));
+	default:
+		return glm::mat3(glm::rotate(glm::mat4(1.f), uniform(0.f, 2.f * glm::pi<float>()), glm::normalize(random_point(1.f) + glm::vec3(1e-3f))));
+	}
+}
+
+obb random_obb()
+{
+	glm::vec3 half_extents(uniform(0.f, 3.f), uniform(0.f, 3.f), uniform(0.f, 3.f));
+	if (uniform_int(0, 3) == 0)
+		half_extents[uniform_int(0, 2)] = 0.f;
+	return obb(random_point(8.f), random_rotation(), half_extents);
+}
+
+frustum random_frustum()
+{
+	glm::vec3 eye = random_point(4.f);
+	glm::vec3 direction;
+	if (uniform_int(0, 1))
+	{
+		// Looking along a coordinate axis, so that the frustum edges are parallel to the box ones
+		direction = glm::vec3(0.f);
+		direction[uniform_int(0, 2)] = uniform_int(0, 1) ? 1.f : -1.f;
+	}
+	else
+		direction = glm::normalize(random_point(1.f) + glm::vec3(1e-3f));
+
+	glm::vec3 up = (std::abs(direction.y) > 0.9f) ? glm::vec3(0.f, 0.f, 1.f) : glm::vec3(0.f, 1.f, 0.f);
+	glm::mat4 view = glm::lookAt(eye, eye + direction, up);
+	glm::mat4 projection = glm::perspective(uniform(0.3f, 1.5f), uniform(0.5f, 2.f), uniform(0.1f, 1.f), uniform(2.f, 12.f));
+	return frustum(projection * view);
+}
+
+template <typename Body1, typename Body2>
+void compare(char const * name, Body1 const & b1, Body2 const & b2, std::size_t & hits, std::size_t & mismatches)
+{
+	bool const specialized = intersect(b1, b2);
+	if (specialized != intersect_generic(b1, b2))
+	{
+		if (mismatches < 10)
+			std::cerr << name << ": specialized test says " << specialized << ", generic one says " << !specialized << std::endl;
+		++mismatches;
+	}
+	if (specialized)
+		++hits;
+}
+
+int main() try
+{
+	std::size_t const pairs = 100'000;
+	std::size_t mismatches = 0;
+
+	std::size_t aabb_aabb_hits = 0;
+	std::size_t aabb_frustum_hits = 0;
+	std::size_t frustum_aabb_hits = 0;
+	std::size_t obb_frustum_hits = 0;
+
+	for (std::size_t i = 0; i < pairs; ++i)
+	{
+		aabb box = random_aabb();
+		obb oriented = random_obb();
+		frustum f = random_frustum();
+
+		compare("aabb/aabb", box, random_aabb(), aabb_aabb_hits, mismatches);
+		compare("aabb/frustum", box, f, aabb_frustum_hits, mismatches);
+		compare("frustum/aabb", f, box, frustum_aabb_hits, mismatches);
+		compare("obb/frustum", oriented, f, obb_frustum_hits, mismatches);
+	}
+
+	std::cout << pairs << " pairs of each kind, intersecting: aabb/aabb " << aabb_aabb_hits << ", aabb/frustum " << aabb_frustum_hits
+		<< ", frustum/aabb " << frustum_aabb_hits << ", obb/frustum " << obb_frustum_hits << "; " << mismatches << " mismatches" << std::endl;
+
+	// Both outcomes must show up, otherwise the generated cases test nothing
+	for (std::size_t hits : {aabb_aabb_hits, aabb_frustum_hits, frustum_aabb_hits, obb_frustum_hits})
+		if (hits == 0 || hits == pairs)
+			throw std::runtime_error("Degenerate random cases: " + std::to_string(hits) + " of " + std::to_string(pairs) + " pairs intersect");
+
+	return (mismatches == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+catch (std::exception const & e)
+{
+	std::cerr << e.what() << std::endl;
+	return EXIT_FAILURE;
+}
@@ -14,7 +14,9 @@
 #include <fstream>
 #include <chrono>
 #include <vector>
+#include <future>
 #include <map>
+#include <algorithm>
 
 #include <glm/vec3.hpp>
 #include <glm/vec4.hpp>
@@ -27,6 +29,10 @@
 #include "frustum.hpp"
 #include "mesh_utils.hpp"
 #include "intersect.hpp"
+#include "simplify.hpp"
+#include "batch_cull.hpp"
+#include "bvh.hpp"
+#include "coherent_cull.hpp"
 
 std::string to_string(std::string_view str)
 {
@@ -48,17 +54,16 @@ R"(#version 330 core
 
 uniform mat4 view;
 uniform mat4 projection;
-uniform vec3 offset;
-
 layout (location = 0) in vec3 in_position;
 layout (location = 1) in vec3 in_normal;
+layout (location = 2) in vec3 in_offset;
 
 out vec3 normal;
 
 void main()
 {
 	normal = in_normal;
-	gl_Position = projection * view * vec4(in_position + offset, 1.0);
+	gl_Position = projection * view * vec4(in_position + in_offset, 1.0);
 }
 )";
 
@@ -115,8 +120,32 @@ GLuint create_program(Shaders ... shaders) {
 	return result;
 }
 
-int main() try
+// Usage: practice13 [--handmade-lods | mesh.obj]
+// By default the LOD chain is generated from bunny0.obj with the simplifier; --handmade-lods
+// loads bunny1..5.obj instead, and a mesh path generates the LODs from that mesh
+int main(int argc, char ** argv) try
 {
+	bool generate_lods = true;
+	std::string mesh_path = PRACTICE_SOURCE_DIRECTORY "/bunny0.obj";
+	bool custom_mesh = false;
+
+	for (int i = 1; i < argc; ++i)
+	{
+		std::string_view arg = argv[i];
+		if (arg == "--handmade-lods")
+			generate_lods = false;
+		else if (!arg.starts_with("--") && !custom_mesh)
+		{
+			mesh_path = arg;
+			custom_mesh = true;
+		}
+		else
+			throw std::runtime_error("Usage: " + std::string(argv[0]) + " [--handmade-lods | mesh.obj]");
+	}
+
+	if (custom_mesh && !generate_lods)
+		throw std::runtime_error("Handmade LODs only exist for bunny0.obj");
+
 	if (SDL_Init(SDL_INIT_VIDEO) != 0)
 		sdl2_fail("SDL_Init: ");
 
@@ -131,7 +160,7 @@ int main() try
 	SDL_GL_SetAttribute(SDL_GL_BLUE_SIZE, 8);
 	SDL_GL_SetAttribute(SDL_GL_DEPTH_SIZE, 24);
 
-	SDL_Window * window = SDL_CreateWindow("Graphics course practice 12",
+	SDL_Window * window = SDL_CreateWindow("Graphics course practice 13",
 		SDL_WINDOWPOS_CENTERED,
 		SDL_WINDOWPOS_CENTERED,
 		800, 600,
@@ -147,6 +176,9 @@ int main() try
 	if (!gl_context)
 		sdl2_fail("SDL_GL_CreateContext: ");
 
+	// Frame times are only meaningful without vsync
+	SDL_GL_SetSwapInterval(0);
+
 	if (auto result = glewInit(); result != GLEW_NO_ERROR)
 		glew_fail("glewInit: ", result);
 
@@ -161,33 +193,143 @@ int main() try
 
 	GLuint view_location = glGetUniformLocation(program, "view");
 	GLuint projection_location = glGetUniformLocation(program, "projection");
-	GLuint offset_location = glGetUniformLocation(program, "offset");
 	GLuint light_dir_location = glGetUniformLocation(program, "light_dir");
 
-	std::vector<vertex> vertices;
-	std::vector<std::uint32_t> indices;
+	std::vector<std::pair<std::vector<vertex>, std::vector<std::uint32_t>>> lods;
+	{
+		std::ifstream in(mesh_path);
+		if (!in)
+			throw std::runtime_error("Failed to open " + mesh_path);
+		lods.push_back(load_obj(in, custom_mesh ? 1.f : 4.f));
+	}
+
+	// Other meshes are scaled to about the size of the bunny and centered, to fit the instance grid
+	if (custom_mesh)
+	{
+		auto [min, max] = bbox(lods[0].first);
+		float const size = std::max({max.x - min.x, max.y - min.y, max.z - min.z});
+		if (!(size > 0.f))
+			throw std::runtime_error(mesh_path + " has no extent");
+
+		glm::vec3 const center = (min + max) / 2.f;
+		for (auto & v : lods[0].first)
+			v.position = (v.position - center) * (0.6f / size);
+	}
+
+	if (generate_lods)
+	{
+		std::vector<simplify_options> levels;
+		for (std::size_t target = lods[0].second.size() / 3 / 2; levels.size() < 5; target /= 2)
+			levels.push_back({target});
+
+		auto start = std::chrono::high_resolution_clock::now();
+		for (auto & lod : build_lod_chain(lods[0].first, lods[0].second, levels))
+			lods.push_back(std::move(lod));
+		auto duration = std::chrono::duration_cast<std::chrono::duration<float>>(std::chrono::high_resolution_clock::now() - start).count();
+		std::cout << "Generated " << levels.size() << " LODs of " << mesh_path << " in " << duration * 1000.f << " ms" << std::endl;
+	}
+	else
+	{
+		for (int i = 1; i <= 5; ++i)
+		{
+			std::ifstream in(PRACTICE_SOURCE_DIRECTORY "/bunny" + std::to_string(i) + ".obj");
+			lods.push_back(load_obj(in, 4.f));
+		}
+	}
+
+	// Deviation of each LOD from the full mesh in world units, to estimate its screen-space error
+	std::vector<float> lod_errors(lods.size());
+	{
+		std::vector<std::future<float>> futures;
+		for (auto const & [vertices, indices] : lods)
+			futures.push_back(std::async(std::launch::async, simplification_error, std::cref(lods[0].first), std::cref(vertices), std::cref(indices)));
+		for (std::size_t i = 0; i < lods.size(); ++i)
+			lod_errors[i] = futures[i].get();
+	}
+
+	auto [bbox_min, bbox_max] = bbox(lods[0].first);
+	glm::vec3 const bbox_center = (bbox_min + bbox_max) / 2.f;
+	float const bbox_radius = glm::length(bbox_max - bbox_min) / 2.f;
+
+	std::vector<glm::vec3> instance_offsets;
+	for (int x = -32; x < 32; ++x)
+		for (int z = -32; z < 32; ++z)
+			instance_offsets.push_back({x * 1.f, 0.f, z * 1.f});
+
+	aabb_soa instance_boxes;
+	for (auto const & offset : instance_offsets)
+		instance_boxes.push_back(bbox_min + offset, bbox_max + offset);
+
+	bvh instance_tree;
 	{
-		std::ifstream in(PRACTICE_SOURCE_DIRECTORY "/bunny0.obj");
-		std::tie(vertices, indices) = load_obj(in, 4.f);
+		std::vector<std::pair<glm::vec3, glm::vec3>> boxes;
+		for (auto const & offset : instance_offsets)
+			boxes.push_back({bbox_min + offset, bbox_max + offset});
+		instance_tree.build(boxes);
 	}
-	fill_normals(vertices, indices);
 
-	GLuint vao, vbo, ebo;
-	glGenVertexArrays(1, &vao);
-	glBindVertexArray(vao);
+	// Offsets of the instances to draw this frame, grouped by LOD
+	GLuint instance_vbo;
+	glGenBuffers(1, &instance_vbo);
+
+	std::vector<GLuint> lod_vaos(lods.size());
+	std::vector<std::size_t> lod_index_counts(lods.size());
+	glGenVertexArrays(lod_vaos.size(), lod_vaos.data());
 
-	glGenBuffers(1, &vbo);
-	glBindBuffer(GL_ARRAY_BUFFER, vbo);
-	glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(vertices[0]), vertices.data(), GL_STATIC_DRAW);
+	for (std::size_t i = 0; i < lods.size(); ++i)
+	{
+		auto & [vertices, indices] = lods[i];
+		fill_normals(vertices, indices);
+		lod_index_counts[i] = indices.size();
+
+		glBindVertexArray(lod_vaos[i]);
+
+		GLuint vbo, ebo;
+		glGenBuffers(1, &vbo);
+		glBindBuffer(GL_ARRAY_BUFFER, vbo);
+		glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(vertices[0]), vertices.data(), GL_STATIC_DRAW);
+
+		glGenBuffers(1, &ebo);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(indices[0]), indices.data(), GL_STATIC_DRAW);
+
+		glEnableVertexAttribArray(0);
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(vertex), nullptr);
+		glEnableVertexAttribArray(1);
+		glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(vertex), (void*)(12));
+
+		glBindBuffer(GL_ARRAY_BUFFER, instance_vbo);
+		glEnableVertexAttribArray(2);
+		glVertexAttribDivisor(2, 1);
+	}
+
+	// Coarsest LOD allowed is the one whose error projects to at most this many pixels
+	float const max_screen_error = 1.f;
+	// With LOD selection turned off, every instance is drawn at LOD0 without culling
+	bool lod_selection = true;
+	enum class culling_mode
+	{
+		sat,
+		batch,
+		tree,
+		coherent,
+	};
 
-	glGenBuffers(1, &ebo);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(indices[0]), indices.data(), GL_STATIC_DRAW);
+	// SAT intersect() per instance, the SIMD plane test per instance, hierarchically with the BVH,
+	// or per instance with the planes cached from the previous frame
+	culling_mode culling = culling_mode::tree;
+	char const * culling_mode_names[] = {"SAT", "batch", "BVH", "coherent"};
 
-	glEnableVertexAttribArray(0);
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(vertex), nullptr);
-	glEnableVertexAttribArray(1);
-	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(vertex), (void*)(12));
+	coherent_culler instance_culler;
+
+	std::vector<std::uint32_t> visible_instances;
+
+	std::vector<std::vector<glm::vec3>> lod_instances(lods.size());
+	std::vector<glm::vec3> visible_offsets;
+
+	float stats_time = 0.f;
+	float stats_culling_time = 0.f;
+	std::size_t stats_frames = 0;
 
 	auto last_frame_start = std::chrono::high_resolution_clock::now();
 
@@ -221,6 +363,10 @@ int main() try
 			button_down[event.key.keysym.sym] = true;
 			if (event.key.keysym.sym == SDLK_SPACE)
 				paused = !paused;
+			if (event.key.keysym.sym == SDLK_l)
+				lod_selection = !lod_selection;
+			if (event.key.keysym.sym == SDLK_b)
+				culling = culling_mode((int(culling) + 1) % 4);
 			break;
 		case SDL_KEYUP:
 			button_down[event.key.keysym.sym] = false;
@@ -283,8 +429,102 @@ int main() try
 		glUniformMatrix4fv(projection_location, 1, GL_FALSE, reinterpret_cast<float *>(&projection));
 		glUniform3fv(light_dir_location, 1, reinterpret_cast<float *>(&light_dir));
 
-		glBindVertexArray(vao);
-		glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, nullptr);
+		for (auto & instances : lod_instances)
+			instances.clear();
+
+		if (lod_selection)
+		{
+			auto culling_start = std::chrono::high_resolution_clock::now();
+
+			switch (culling)
+			{
+			case culling_mode::sat:
+			{
+				frustum view_frustum(projection * view);
+
+				visible_instances.clear();
+				for (std::uint32_t i = 0; i < instance_offsets.size(); ++i)
+					if (intersect(view_frustum, aabb(bbox_min + instance_offsets[i], bbox_max + instance_offsets[i])))
+						visible_instances.push_back(i);
+				break;
+			}
+			case culling_mode::batch:
+				cull_aabbs(frustum_planes(projection * view), instance_boxes, visible_instances);
+				break;
+			case culling_mode::tree:
+				instance_tree.cull(frustum_planes(projection * view), visible_instances);
+				break;
+			case culling_mode::coherent:
+				instance_culler.cull(view, projection, instance_boxes, visible_instances);
+				break;
+			}
+
+			stats_culling_time += std::chrono::duration_cast<std::chrono::duration<float>>(std::chrono::high_resolution_clock::now() - culling_start).count();
+
+			// Projected size of a unit at unit distance, in pixels
+			float const pixels_per_unit = height / (2.f * std::tan(glm::pi<float>() / 4.f));
+
+			for (auto i : visible_instances)
+			{
+				glm::vec3 const & offset = instance_offsets[i];
+
+				float distance = std::max(near, glm::length(bbox_center + offset - camera_position) - bbox_radius);
+
+				std::size_t lod = 0;
+				while (lod + 1 < lods.size() && lod_errors[lod + 1] * pixels_per_unit / distance <= max_screen_error)
+					++lod;
+
+				lod_instances[lod].push_back(offset);
+			}
+		}
+		else
+			lod_instances[0] = instance_offsets;
+
+		visible_offsets.clear();
+		for (auto const & instances : lod_instances)
+			visible_offsets.insert(visible_offsets.end(), instances.begin(), instances.end());
+
+		glBindBuffer(GL_ARRAY_BUFFER, instance_vbo);
+		glBufferData(GL_ARRAY_BUFFER, visible_offsets.size() * sizeof(visible_offsets[0]), visible_offsets.data(), GL_STREAM_DRAW);
+
+		std::size_t first_instance = 0;
+		for (std::size_t i = 0; i < lods.size(); ++i)
+		{
+			if (lod_instances[i].empty())
+				continue;
+
+			// No base instance in OpenGL 3.3, so point the instance attribute at this LOD's range
+			glBindVertexArray(lod_vaos[i]);
+			glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (void*)(first_instance * sizeof(glm::vec3)));
+			glDrawElementsInstanced(GL_TRIANGLES, lod_index_counts[i], GL_UNSIGNED_INT, nullptr, lod_instances[i].size());
+
+			first_instance += lod_instances[i].size();
+		}
+
+		stats_time += dt;
+		++stats_frames;
+		if (stats_time >= 0.5f)
+		{
+			std::ostringstream title;
+			title << "Graphics course practice 13: " << (stats_time / stats_frames * 1000.f) << " ms/frame, "
+				<< visible_offsets.size() << "/" << instance_offsets.size() << " instances";
+			if (lod_selection)
+			{
+				title << ", " << culling_mode_names[int(culling)] << " culling " << (stats_culling_time / stats_frames * 1000.f) << " ms";
+				if (culling == culling_mode::coherent)
+					title << " (" << instance_culler.stats().tests_per_object() << " tests/instance, " << instance_culler.stats().skipped << " skipped)";
+				title << ", per LOD:";
+				for (auto const & instances : lod_instances)
+					title << " " << instances.size();
+			}
+			else
+				title << " at LOD0";
+			SDL_SetWindowTitle(window, title.str().c_str());
+
+			stats_time = 0.f;
+			stats_culling_time = 0.f;
+			stats_frames = 0;
+		}
 
 		SDL_GL_SwapWindow(window);
 	}
@@ -0,0 +1,25 @@
+#include "obb.hpp"
+
+#include <glm/geometric.hpp>
+
+obb::obb(glm::vec3 const & center, glm::mat3 const & rotation, glm::vec3 const & half_extents)
+	: center(center)
+	, axes{rotation[0], rotation[1], rotation[2]}
+	, half_extents(half_extents)
+	, face_normals(axes)
+	, edge_directions(axes)
+{
+	for (std::size_t i = 0; i < 8; ++i)
+	{
+		vertices[i] = center;
+		vertices[i] += ((i & 1) ? 1.f : -1.f) * half_extents.x * axes[0];
+		vertices[i] += ((i & 2) ? 1.f : -1.f) * half_extents.y * axes[1];
+		vertices[i] += ((i & 4) ? 1.f : -1.f) * half_extents.z * axes[2];
+	}
+
+	for (std::size_t i = 0; i < 3; ++i)
+	{
+		float c = glm::dot(center, axes[i]);
+		face_projections[i] = {c - half_extents[i], c + half_extents[i]};
+	}
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <glm/vec3.hpp>
+#include <glm/mat3x3.hpp>
+
+#include <array>
+#include <utility>
+
+struct obb
+{
+	// The columns of rotation are the box axes, which must be orthonormal
+	obb(glm::vec3 const & center, glm::mat3 const & rotation, glm::vec3 const & half_extents);
+
+	glm::vec3 center;
+	std::array<glm::vec3, 3> axes;
+	glm::vec3 half_extents;
+
+	std::array<glm::vec3, 8> vertices;
+	std::array<glm::vec3, 3> face_normals;
+	std::array<glm::vec3, 3> edge_directions;
+
+	// Projections onto the own face normals
+	std::array<std::pair<float, float>, 3> face_projections;
+};
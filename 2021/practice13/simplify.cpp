@@ -0,0 +1,514 @@
+#include "simplify.hpp"
+#include "bvh.hpp"
+
+#include <glm/common.hpp>
+#include <glm/geometric.hpp>
+#include <glm/matrix.hpp>
+#include <glm/mat3x3.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <future>
+#include <limits>
+#include <map>
+#include <queue>
+
+namespace
+{
+
+	// Symmetric 4x4 matrix Q, error(v) = (v, 1)^T Q (v, 1)
+	struct quadric
+	{
+		// aa, ab, ac, ad, bb, bc, bd, cc, cd, dd
+		std::array<double, 10> q{};
+
+		static quadric plane(glm::dvec3 const & n, double d, double weight)
+		{
+			quadric r;
+			r.q = {
+				n.x * n.x, n.x * n.y, n.x * n.z, n.x * d,
+				n.y * n.y, n.y * n.z, n.y * d,
+				n.z * n.z, n.z * d,
+				d * d,
+			};
+			for (auto & x : r.q)
+				x *= weight;
+			return r;
+		}
+
+		quadric & operator += (quadric const & other)
+		{
+			for (std::size_t i = 0; i < q.size(); ++i)
+				q[i] += other.q[i];
+			return *this;
+		}
+
+		double error(glm::dvec3 const & v) const
+		{
+			return q[0] * v.x * v.x + 2.0 * q[1] * v.x * v.y + 2.0 * q[2] * v.x * v.z + 2.0 * q[3] * v.x
+				+ q[4] * v.y * v.y + 2.0 * q[5] * v.y * v.z + 2.0 * q[6] * v.y
+				+ q[7] * v.z * v.z + 2.0 * q[8] * v.z
+				+ q[9];
+		}
+
+		// The point minimizing the error, if the system is well-conditioned
+		bool optimum(glm::dvec3 & result) const
+		{
+			glm::dmat3 a(
+				q[0], q[1], q[2],
+				q[1], q[4], q[5],
+				q[2], q[5], q[7]);
+
+			double det = glm::determinant(a);
+			if (std::abs(det) < 1e-12)
+				return false;
+
+			result = -(glm::inverse(a) * glm::dvec3(q[3], q[6], q[8]));
+			return true;
+		}
+	};
+
+	// Border edges get constraint planes this many times stronger than triangle planes
+	constexpr double border_weight = 1000.0;
+
+	struct collapse
+	{
+		double cost;
+		// v1 is merged into v0, which moves to target
+		std::uint32_t v0, v1;
+		glm::dvec3 target;
+		// Versions of the vertices at the time of evaluation; outdated candidates are skipped
+		std::uint32_t version0, version1;
+
+		bool operator < (collapse const & other) const
+		{
+			// std::priority_queue is a max-heap
+			return cost > other.cost;
+		}
+	};
+
+	struct simplifier
+	{
+		std::vector<glm::dvec3> positions;
+		std::vector<quadric> quadrics;
+		std::vector<bool> locked;
+		std::vector<bool> removed;
+		std::vector<std::uint32_t> version;
+
+		std::vector<std::array<std::uint32_t, 3>> triangles;
+		std::vector<bool> deleted;
+		std::vector<std::vector<std::uint32_t>> adjacency;
+
+		std::size_t live_triangles = 0;
+
+		std::priority_queue<collapse> queue;
+
+		simplifier(std::vector<vertex> const & vertices, std::vector<std::uint32_t> const & indices)
+		{
+			std::size_t const vertex_count = vertices.size();
+
+			positions.resize(vertex_count);
+			for (std::size_t i = 0; i < vertex_count; ++i)
+				positions[i] = glm::dvec3(vertices[i].position);
+
+			quadrics.resize(vertex_count);
+			locked.assign(vertex_count, false);
+			removed.assign(vertex_count, false);
+			version.assign(vertex_count, 0);
+			adjacency.resize(vertex_count);
+
+			// Seams: split vertices must stay together, so none of them moves
+			{
+				std::map<std::array<float, 3>, std::uint32_t> first;
+				for (std::uint32_t i = 0; i < vertex_count; ++i)
+				{
+					auto const & p = vertices[i].position;
+					auto [it, inserted] = first.insert({{p.x, p.y, p.z}, i});
+					if (!inserted)
+					{
+						locked[i] = true;
+						locked[it->second] = true;
+					}
+				}
+			}
+
+			for (std::size_t i = 0; i + 2 < indices.size(); i += 3)
+			{
+				std::array<std::uint32_t, 3> t{indices[i], indices[i + 1], indices[i + 2]};
+				if (t[0] == t[1] || t[1] == t[2] || t[2] == t[0])
+					continue;
+
+				std::uint32_t id = triangles.size();
+				triangles.push_back(t);
+				for (auto v : t)
+					adjacency[v].push_back(id);
+
+				glm::dvec3 n = glm::cross(positions[t[1]] - positions[t[0]], positions[t[2]] - positions[t[0]]);
+				double length = glm::length(n);
+				if (length == 0.0)
+					continue;
+				n /= length;
+
+				auto q = quadric::plane(n, -glm::dot(n, positions[t[0]]), 1.0);
+				for (auto v : t)
+					quadrics[v] += q;
+			}
+
+			deleted.assign(triangles.size(), false);
+			live_triangles = triangles.size();
+
+			// An edge is a border iff exactly one triangle has it
+			std::map<std::pair<std::uint32_t, std::uint32_t>, std::pair<int, std::uint32_t>> edge_use;
+			for (std::uint32_t t = 0; t < triangles.size(); ++t)
+			{
+				for (int i = 0; i < 3; ++i)
+				{
+					std::uint32_t a = triangles[t][i];
+					std::uint32_t b = triangles[t][(i + 1) % 3];
+					auto & use = edge_use[std::minmax(a, b)];
+					++use.first;
+					use.second = t;
+				}
+			}
+
+			for (auto const & [edge, use] : edge_use)
+			{
+				if (use.first != 1)
+					continue;
+
+				auto const & t = triangles[use.second];
+				glm::dvec3 n = glm::cross(positions[t[1]] - positions[t[0]], positions[t[2]] - positions[t[0]]);
+				glm::dvec3 e = positions[edge.second] - positions[edge.first];
+
+				glm::dvec3 side = glm::cross(e, n);
+				double length = glm::length(side);
+				if (length == 0.0)
+					continue;
+				side /= length;
+
+				auto q = quadric::plane(side, -glm::dot(side, positions[edge.first]), border_weight * glm::dot(e, e));
+				quadrics[edge.first] += q;
+				quadrics[edge.second] += q;
+			}
+
+			for (auto const & [edge, use] : edge_use)
+				push(edge.first, edge.second);
+		}
+
+		void push(std::uint32_t a, std::uint32_t b)
+		{
+			if (locked[a] && locked[b])
+				return;
+
+			// Never move a locked vertex
+			if (locked[a])
+				std::swap(a, b);
+
+			collapse c;
+			c.v0 = b;
+			c.v1 = a;
+			c.version0 = version[b];
+			c.version1 = version[a];
+
+			quadric q = quadrics[a];
+			q += quadrics[b];
+
+			if (locked[b])
+				c.target = positions[b];
+			else if (!q.optimum(c.target))
+			{
+				// Fall back to the best of the endpoints and the midpoint
+				c.target = positions[b];
+				for (auto const & p : {positions[a], (positions[a] + positions[b]) * 0.5})
+					if (q.error(p) < q.error(c.target))
+						c.target = p;
+			}
+
+			c.cost = std::max(0.0, q.error(c.target));
+			queue.push(c);
+		}
+
+		std::uint32_t other_than(std::array<std::uint32_t, 3> const & t, std::uint32_t v, std::size_t k) const
+		{
+			std::size_t i = std::find(t.begin(), t.end(), v) - t.begin();
+			return t[(i + 1 + k) % 3];
+		}
+
+		// Moving the vertex must not flip any of its triangles which survive the collapse
+		bool flips(std::uint32_t moved, std::uint32_t other, glm::dvec3 const & target) const
+		{
+			for (auto t : adjacency[moved])
+			{
+				auto const & tri = triangles[t];
+				if (std::find(tri.begin(), tri.end(), other) != tri.end())
+					continue;
+
+				glm::dvec3 p1 = positions[other_than(tri, moved, 0)];
+				glm::dvec3 p2 = positions[other_than(tri, moved, 1)];
+
+				glm::dvec3 before = glm::cross(p1 - positions[moved], p2 - positions[moved]);
+				glm::dvec3 after = glm::cross(p1 - target, p2 - target);
+
+				if (glm::dot(before, after) <= 0.0)
+					return true;
+			}
+			return false;
+		}
+
+		// Link condition: the edge's endpoints must not share neighbours
+		// other than the opposite vertices of the edge's triangles
+		bool keeps_manifold(std::uint32_t v0, std::uint32_t v1) const
+		{
+			std::vector<std::uint32_t> n0, n1;
+			std::size_t edge_triangles = 0;
+
+			for (auto t : adjacency[v0])
+				for (auto v : triangles[t])
+					if (v != v0)
+						n0.push_back(v);
+
+			for (auto t : adjacency[v1])
+			{
+				auto const & tri = triangles[t];
+				if (std::find(tri.begin(), tri.end(), v0) != tri.end())
+					++edge_triangles;
+				for (auto v : tri)
+					if (v != v1)
+						n1.push_back(v);
+			}
+
+			std::sort(n0.begin(), n0.end());
+			n0.erase(std::unique(n0.begin(), n0.end()), n0.end());
+			std::sort(n1.begin(), n1.end());
+			n1.erase(std::unique(n1.begin(), n1.end()), n1.end());
+
+			std::vector<std::uint32_t> common;
+			std::set_intersection(n0.begin(), n0.end(), n1.begin(), n1.end(), std::back_inserter(common));
+
+			return common.size() <= edge_triangles;
+		}
+
+		void run(simplify_options const & options)
+		{
+			while (live_triangles > options.target_triangle_count && !queue.empty())
+			{
+				collapse c = queue.top();
+				queue.pop();
+
+				if (removed[c.v0] || removed[c.v1] || version[c.v0] != c.version0 || version[c.v1] != c.version1)
+					continue;
+
+				if (c.cost > options.max_error)
+					break;
+
+				if (!keeps_manifold(c.v0, c.v1) || flips(c.v0, c.v1, c.target) || flips(c.v1, c.v0, c.target))
+					continue;
+
+				apply(c);
+			}
+		}
+
+		void apply(collapse const & c)
+		{
+			positions[c.v0] = c.target;
+			quadrics[c.v0] += quadrics[c.v1];
+			removed[c.v1] = true;
+			++version[c.v0];
+			++version[c.v1];
+
+			for (auto t : adjacency[c.v1])
+			{
+				auto & tri = triangles[t];
+				if (std::find(tri.begin(), tri.end(), c.v0) != tri.end())
+				{
+					deleted[t] = true;
+					--live_triangles;
+					for (auto v : tri)
+						if (v != c.v1)
+						{
+							auto & adj = adjacency[v];
+							adj.erase(std::find(adj.begin(), adj.end(), t));
+						}
+				}
+				else
+				{
+					*std::find(tri.begin(), tri.end(), c.v1) = c.v0;
+					adjacency[c.v0].push_back(t);
+				}
+			}
+			adjacency[c.v1].clear();
+
+			std::vector<std::uint32_t> neighbours;
+			for (auto t : adjacency[c.v0])
+				for (auto v : triangles[t])
+					if (v != c.v0)
+						neighbours.push_back(v);
+
+			std::sort(neighbours.begin(), neighbours.end());
+			neighbours.erase(std::unique(neighbours.begin(), neighbours.end()), neighbours.end());
+
+			for (auto v : neighbours)
+				push(c.v0, v);
+		}
+	};
+
+	// Ericson, Real-Time Collision Detection, 5.1.5
+	glm::vec3 closest_point(glm::vec3 const & p, glm::vec3 const & a, glm::vec3 const & b, glm::vec3 const & c)
+	{
+		glm::vec3 ab = b - a;
+		glm::vec3 ac = c - a;
+		glm::vec3 ap = p - a;
+
+		float d1 = glm::dot(ab, ap);
+		float d2 = glm::dot(ac, ap);
+		if (d1 <= 0.f && d2 <= 0.f)
+			return a;
+
+		glm::vec3 bp = p - b;
+		float d3 = glm::dot(ab, bp);
+		float d4 = glm::dot(ac, bp);
+		if (d3 >= 0.f && d4 <= d3)
+			return b;
+
+		float vc = d1 * d4 - d3 * d2;
+		if (vc <= 0.f && d1 >= 0.f && d3 <= 0.f)
+			return a + ab * (d1 / (d1 - d3));
+
+		glm::vec3 cp = p - c;
+		float d5 = glm::dot(ab, cp);
+		float d6 = glm::dot(ac, cp);
+		if (d6 >= 0.f && d5 <= d6)
+			return c;
+
+		float vb = d5 * d2 - d1 * d6;
+		if (vb <= 0.f && d2 >= 0.f && d6 <= 0.f)
+			return a + ac * (d2 / (d2 - d6));
+
+		float va = d3 * d6 - d5 * d4;
+		if (va <= 0.f && (d4 - d3) >= 0.f && (d5 - d6) >= 0.f)
+			return b + (c - b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6)));
+
+		float denom = 1.f / (va + vb + vc);
+		return a + ab * (vb * denom) + ac * (vc * denom);
+	}
+
+}
+
+std::pair<std::vector<vertex>, std::vector<std::uint32_t>> simplify(std::vector<vertex> const & vertices, std::vector<std::uint32_t> const & indices, simplify_options const & options)
+{
+	simplifier s(vertices, indices);
+	s.run(options);
+
+	std::vector<vertex> result_vertices;
+	std::vector<std::uint32_t> result_indices;
+
+	static constexpr std::uint32_t unused = -1;
+	std::vector<std::uint32_t> remap(vertices.size(), unused);
+
+	for (std::size_t t = 0; t < s.triangles.size(); ++t)
+	{
+		if (s.deleted[t])
+			continue;
+
+		for (auto v : s.triangles[t])
+		{
+			if (remap[v] == unused)
+			{
+				remap[v] = result_vertices.size();
+				vertex & r = result_vertices.emplace_back(vertices[v]);
+				r.position = glm::vec3(s.positions[v]);
+			}
+			result_indices.push_back(remap[v]);
+		}
+	}
+
+	return {result_vertices, result_indices};
+}
+
+std::vector<std::pair<std::vector<vertex>, std::vector<std::uint32_t>>> build_lod_chain(std::vector<vertex> const & vertices, std::vector<std::uint32_t> const & indices, std::vector<simplify_options> const & levels)
+{
+	std::vector<std::future<std::pair<std::vector<vertex>, std::vector<std::uint32_t>>>> futures;
+	for (auto const & options : levels)
+		futures.push_back(std::async(std::launch::async, simplify, std::cref(vertices), std::cref(indices), std::cref(options)));
+
+	std::vector<std::pair<std::vector<vertex>, std::vector<std::uint32_t>>> result;
+	for (auto & f : futures)
+		result.push_back(f.get());
+	return result;
+}
+
+float simplification_error(std::vector<vertex> const & original, std::vector<vertex> const & vertices, std::vector<std::uint32_t> const & indices)
+{
+	std::size_t const triangle_count = indices.size() / 3;
+	if (triangle_count == 0)
+		return original.empty() ? 0.f : std::numeric_limits<float>::infinity();
+
+	auto triangle_closest_point = [&](std::uint32_t t, glm::vec3 const & p)
+	{
+		return closest_point(p, vertices[indices[3 * t]].position, vertices[indices[3 * t + 1]].position, vertices[indices[3 * t + 2]].position);
+	};
+
+	bvh tree;
+	{
+		std::vector<std::pair<glm::vec3, glm::vec3>> boxes(triangle_count);
+		for (std::size_t t = 0; t < triangle_count; ++t)
+		{
+			glm::vec3 const & a = vertices[indices[3 * t]].position;
+			glm::vec3 const & b = vertices[indices[3 * t + 1]].position;
+			glm::vec3 const & c = vertices[indices[3 * t + 2]].position;
+			boxes[t] = {glm::min(a, glm::min(b, c)), glm::max(a, glm::max(b, c))};
+		}
+		tree.build(boxes);
+	}
+
+	auto box_distance = [&](bvh::node const & n, glm::vec3 const & p)
+	{
+		glm::vec3 d = glm::max(glm::max(n.min - p, p - n.max), glm::vec3(0.f));
+		return glm::dot(d, d);
+	};
+
+	float result = 0.f;
+	std::vector<std::uint32_t> stack;
+
+	for (auto const & v : original)
+	{
+		// Depth-first, nearer child first, skipping subtrees further than the nearest triangle
+		// found so far. A vertex closer than the current maximum can't increase it, so its search
+		// stops at the first triangle that close
+		float best = std::numeric_limits<float>::infinity();
+		stack.assign(1, tree.root);
+		while (!stack.empty() && best > result)
+		{
+			bvh::node const & n = tree.nodes[stack.back()];
+			stack.pop_back();
+
+			if (box_distance(n, v.position) >= best)
+				continue;
+
+			if (n.is_leaf())
+			{
+				glm::vec3 p = triangle_closest_point(n.object, v.position);
+				best = std::min(best, glm::dot(p - v.position, p - v.position));
+				continue;
+			}
+
+			float left = box_distance(tree.nodes[n.left], v.position);
+			float right = box_distance(tree.nodes[n.right], v.position);
+			if (left < right)
+			{
+				stack.push_back(n.right);
+				stack.push_back(n.left);
+			}
+			else
+			{
+				stack.push_back(n.left);
+				stack.push_back(n.right);
+			}
+		}
+
+		result = std::max(result, best);
+	}
+
+	return std::sqrt(result);
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include "mesh_utils.hpp"
+
+#include <limits>
+#include <utility>
+#include <vector>
+
+struct simplify_options
+{
+	// Stop as soon as the mesh has at most this many triangles...
+	std::size_t target_triangle_count = 0;
+	// ...or when every remaining edge collapse would introduce a larger error,
+	// measured as the sum of squared distances to the planes of the original triangles
+	float max_error = std::numeric_limits<float>::infinity();
+};
+
+// Quadric error metric edge collapse simplification (Garland & Heckbert).
+// Border edges are kept in place by strong constraint planes; vertices sharing
+// a position with another vertex (i.e. attribute seams) are never moved.
+// Normals of the result are the ones of the surviving vertices, so they
+// probably need fill_normals afterwards
+std::pair<std::vector<vertex>, std::vector<std::uint32_t>> simplify(std::vector<vertex> const & vertices, std::vector<std::uint32_t> const & indices, simplify_options const & options);
+
+// Simplifies the mesh with each of the options in parallel, every level
+// starting from the original mesh, so errors don't accumulate along the chain
+std::vector<std::pair<std::vector<vertex>, std::vector<std::uint32_t>>> build_lod_chain(std::vector<vertex> const & vertices, std::vector<std::uint32_t> const & indices, std::vector<simplify_options> const & levels);
+
+// One-sided Hausdorff distance from the original mesh vertices to the simplified
+// surface: how far the simplified mesh deviates from the original, in model units.
+// The nearest triangles are searched in a bvh of the simplified mesh
+float simplification_error(std::vector<vertex> const & original, std::vector<vertex> const & vertices, std::vector<std::uint32_t> const & indices);
@@ -0,0 +1,164 @@
+#include "depth_sort.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <numeric>
+
+namespace
+{
+
+    constexpr int radix_bits = 8;
+    constexpr std::size_t radix_size = std::size_t(1) << radix_bits;
+
+    // Elements per radix sort job, each with its own histogram
+    constexpr std::size_t block_size = std::size_t(1) << 16;
+
+    // Maps floats to unsigned integers of the same order
+    std::uint32_t sortable_key(float value)
+    {
+        std::uint32_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        return (bits & 0x80000000u) ? ~bits : (bits | 0x80000000u);
+    }
+
+}
+
+void depth_sorter::sort(particle_system const & particles, glm::vec3 const & camera_position, job_system & jobs)
+{
+    std::size_t const n = particles.count();
+    stats_ = {};
+
+    // Farthest first, so larger distances get smaller keys
+    particle_keys_.resize(n);
+    jobs.parallel_for(n, block_size, [&](std::size_t begin, std::size_t end)
+    {
+        for (std::size_t i = begin; i < end; ++i)
+        {
+            float const dx = particles.position_x[i] - camera_position.x;
+            float const dy = particles.position_y[i] - camera_position.y;
+            float const dz = particles.position_z[i] - camera_position.z;
+            particle_keys_[i] = ~sortable_key(dx * dx + dy * dy + dz * dz);
+        }
+    });
+
+    bool const has_order = order_.size() == n;
+    if (!has_order)
+    {
+        order_.resize(n);
+        std::iota(order_.begin(), order_.end(), 0);
+    }
+
+    // Keys in last frame's order, which any sort can start from
+    keys_.resize(n);
+    jobs.parallel_for(n, block_size, [&](std::size_t begin, std::size_t end)
+    {
+        for (std::size_t i = begin; i < end; ++i)
+            keys_[i] = particle_keys_[order_[i]];
+    });
+
+    if (has_order && coherence_skip_ > 0)
+        --coherence_skip_;
+    else if (has_order)
+    {
+        // A couple of moves per particle are still much cheaper than the radix passes.
+        // Even when giving up, keys and indices were moved together, so the radix sort
+        // just continues from there
+        if (insertion_sort(2 * n))
+        {
+            stats_.coherent = true;
+            coherence_backoff_ = 0;
+            return;
+        }
+
+        coherence_backoff_ = std::clamp(coherence_backoff_ * 2, 1, 32);
+        coherence_skip_ = coherence_backoff_;
+    }
+
+    radix_sort(jobs);
+}
+
+bool depth_sorter::insertion_sort(std::size_t max_moves)
+{
+    std::size_t moves = 0;
+
+    for (std::size_t i = 1; i < keys_.size(); ++i)
+    {
+        std::uint32_t const key = keys_[i];
+        std::uint32_t const index = order_[i];
+
+        std::size_t j = i;
+        for (; j > 0 && keys_[j - 1] > key; --j)
+        {
+            keys_[j] = keys_[j - 1];
+            order_[j] = order_[j - 1];
+        }
+        keys_[j] = key;
+        order_[j] = index;
+
+        moves += i - j;
+        if (moves > max_moves)
+            return false;
+    }
+
+    return true;
+}
+
+void depth_sorter::radix_sort(job_system & jobs)
+{
+    std::size_t const n = keys_.size();
+    std::size_t const block_count = (n + block_size - 1) / block_size;
+
+    keys_scratch_.resize(n);
+    order_scratch_.resize(n);
+    histograms_.resize(block_count * radix_size);
+
+    for (int shift = 0; shift < 32; shift += radix_bits)
+    {
+        std::fill(histograms_.begin(), histograms_.end(), 0);
+
+        jobs.parallel_for(block_count, 1, [&](std::size_t block, std::size_t)
+        {
+            std::uint32_t * histogram = histograms_.data() + block * radix_size;
+            std::size_t const end = std::min(n, (block + 1) * block_size);
+            for (std::size_t i = block * block_size; i < end; ++i)
+                ++histogram[(keys_[i] >> shift) & (radix_size - 1)];
+        });
+
+        // Turn the counts into scatter offsets, digit-major and block-minor, which keeps the sort stable.
+        // A pass where every key has the same digit wouldn't change anything
+        bool single_digit = false;
+        std::uint32_t offset = 0;
+        for (std::size_t digit = 0; digit < radix_size; ++digit)
+        {
+            std::uint32_t const digit_start = offset;
+            for (std::size_t block = 0; block < block_count; ++block)
+            {
+                std::uint32_t & entry = histograms_[block * radix_size + digit];
+                std::uint32_t const count = entry;
+                entry = offset;
+                offset += count;
+            }
+            if (offset - digit_start == n)
+                single_digit = true;
+        }
+
+        if (single_digit)
+            continue;
+
+        jobs.parallel_for(block_count, 1, [&](std::size_t block, std::size_t)
+        {
+            std::uint32_t * offsets = histograms_.data() + block * radix_size;
+            std::size_t const end = std::min(n, (block + 1) * block_size);
+            for (std::size_t i = block * block_size; i < end; ++i)
+            {
+                std::uint32_t const position = offsets[(keys_[i] >> shift) & (radix_size - 1)]++;
+                keys_scratch_[position] = keys_[i];
+                order_scratch_[position] = order_[i];
+            }
+        });
+
+        keys_.swap(keys_scratch_);
+        order_.swap(order_scratch_);
+        ++stats_.radix_passes;
+    }
+}
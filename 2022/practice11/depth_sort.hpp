@@ -0,0 +1,47 @@
+#pragma once
+
+#include "job_system.hpp"
+#include "particle_system.hpp"
+
+#include <glm/vec3.hpp>
+
+#include <cstdint>
+#include <vector>
+
+struct depth_sort_stats
+{
+    // Whether last frame's order was close enough to be fixed by insertion sort
+    bool coherent = false;
+    // Radix passes actually done, passes with a single digit value are skipped
+    int radix_passes = 0;
+};
+
+// Orders particles back to front for alpha blending, producing indices for an index
+// buffer, so the particle arrays themselves are never shuffled. Keys are the squared
+// distances to the camera mapped to integers with the same order. While the camera and
+// the particles move smoothly, last frame's order stays nearly sorted and a bounded
+// insertion sort finishes it; otherwise a parallel LSD radix sort takes over
+struct depth_sorter
+{
+    void sort(particle_system const & particles, glm::vec3 const & camera_position, job_system & jobs);
+
+    // Particle indices, farthest first
+    std::vector<std::uint32_t> const & order() const { return order_; }
+
+    depth_sort_stats const & stats() const { return stats_; }
+
+private:
+    std::vector<std::uint32_t> particle_keys_;
+    std::vector<std::uint32_t> keys_, keys_scratch_;
+    std::vector<std::uint32_t> order_, order_scratch_;
+    std::vector<std::uint32_t> histograms_;
+    depth_sort_stats stats_;
+
+    // After insertion sort gives up, the next attempts are skipped for a while, growing
+    // while it keeps failing, so that incoherent motion costs little more than radix sort
+    int coherence_backoff_ = 0;
+    int coherence_skip_ = 0;
+
+    bool insertion_sort(std::size_t max_moves);
+    void radix_sort(job_system & jobs);
+};
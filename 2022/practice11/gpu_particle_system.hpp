@@ -0,0 +1,69 @@
+#pragma once
+
+#include "particle_system.hpp"
+
+#include <GL/glew.h>
+
+#include <array>
+#include <cstdint>
+
+// Interleaved particle state as stored in the GPU buffers
+struct gpu_particle
+{
+    float position_x, position_y, position_z;
+    float velocity_x, velocity_y, velocity_z;
+    float age;
+    float lifetime;
+    float size;
+    // RGBA8
+    std::uint32_t color;
+};
+
+// Particle simulation with transform feedback: the state lives in two buffers, and
+// every update runs a vertex shader integrator over one of them, capturing the result
+// into the other. Integration and respawn repeat particle_system::update exactly,
+// up to the precision of the GPU math functions
+struct gpu_particle_system
+{
+    gpu_particle_system();
+    ~gpu_particle_system();
+
+    gpu_particle_system(gpu_particle_system const &) = delete;
+    gpu_particle_system & operator = (gpu_particle_system const &) = delete;
+
+    // Takes over the state, the parameters and the frame counter of the CPU system
+    void upload(particle_system const & particles);
+
+    // Copies the state back into a CPU system of the same size
+    void download(particle_system & particles) const;
+
+    void update(float dt);
+
+    std::size_t count() const { return count_; }
+
+    // Holds count() gpu_particle values (and the padding of the CPU arrays) after the last update
+    GLuint buffer() const { return buffers_[current_]; }
+
+    particle_parameters parameters;
+
+private:
+    GLuint program_;
+    std::array<GLuint, 2> buffers_;
+    std::array<GLuint, 2> vaos_;
+    int current_ = 0;
+
+    std::size_t count_ = 0;
+    std::size_t padded_count_ = 0;
+    std::uint32_t frame_ = 0;
+
+    GLint dt_location_;
+    GLint damping_location_;
+    GLint velocity_change_location_;
+    GLint frame_location_;
+    GLint emitter_position_location_;
+    GLint emitter_radius_location_;
+    GLint speed_range_location_;
+    GLint spread_location_;
+    GLint lifetime_range_location_;
+    GLint size_range_location_;
+};
@@ -12,9 +12,12 @@
 #include <iostream>
 #include <chrono>
 #include <vector>
-#include <random>
+#include <algorithm>
 #include <map>
 #include <cmath>
+#include <sstream>
+#include <cstring>
+#include <cstddef>
 
 #define GLM_FORCE_SWIZZLE
 #define GLM_ENABLE_EXPERIMENTAL
@@ -27,6 +30,11 @@
 #include <glm/gtx/string_cast.hpp>
 
 #include "obj_parser.hpp"
+#include "particle_system.hpp"
+#include "stream_buffer.hpp"
+#include "gpu_particle_system.hpp"
+#include "depth_sort.hpp"
+#include "spatial_grid.hpp"
 #include "stb_image.h"
 
 std::string to_string(std::string_view str)
@@ -47,11 +55,21 @@ void glew_fail(std::string_view message, GLenum error)
 const char vertex_shader_source[] =
 R"(#version 330 core
 
-layout (location = 0) in vec3 in_position;
+// Particle attributes come from separate arrays
+layout (location = 0) in float in_position_x;
+layout (location = 1) in float in_position_y;
+layout (location = 2) in float in_position_z;
+layout (location = 3) in float in_size;
+layout (location = 4) in vec4 in_color;
+
+out float size;
+out vec4 color;
 
 void main()
 {
-    gl_Position = vec4(in_position, 1.0);
+    gl_Position = vec4(in_position_x, in_position_y, in_position_z, 1.0);
+    size = in_size;
+    color = in_color;
 }
 )";
 
@@ -62,14 +80,23 @@ uniform mat4 model;
 uniform mat4 view;
 uniform mat4 projection;
 uniform vec3 camera_position;
+// Pixels per world unit at unit distance
+uniform float point_scale;
 
 layout (points) in;
 layout (points, max_vertices = 1) out;
 
+in float size[];
+in vec4 color[];
+
+out vec4 point_color;
+
 void main()
 {
     vec3 center = gl_in[0].gl_Position.xyz;
     gl_Position = projection * view * model * vec4(center, 1.0);
+    gl_PointSize = max(1.0, size[0] * point_scale / gl_Position.w);
+    point_color = color[0];
     EmitVertex();
     EndPrimitive();
 }
@@ -79,11 +106,66 @@ void main()
 const char fragment_shader_source[] =
 R"(#version 330 core
 
+uniform sampler2D particle_texture;
+
+in vec4 point_color;
+
+layout (location = 0) out vec4 out_color;
+
+void main()
+{
+    out_color = vec4(point_color.rgb, point_color.a * texture(particle_texture, gl_PointCoord).r);
+}
+)";
+
+const char quad_vertex_shader_source[] =
+R"(#version 330 core
+
+uniform mat4 model;
+uniform mat4 view;
+uniform mat4 projection;
+// Pixels per world unit at unit distance
+uniform float point_scale;
+
+// Per instance, from the same arrays as the points
+layout (location = 0) in float in_position_x;
+layout (location = 1) in float in_position_y;
+layout (location = 2) in float in_position_z;
+layout (location = 3) in float in_size;
+layout (location = 4) in vec4 in_color;
+
+out vec2 texcoord;
+out vec4 point_color;
+
+// Triangle strip corners, so that no per-vertex buffer is needed
+const vec2 corners[4] = vec2[4](vec2(-1.0, -1.0), vec2(1.0, -1.0), vec2(-1.0, 1.0), vec2(1.0, 1.0));
+
+void main()
+{
+    vec4 center = view * model * vec4(in_position_x, in_position_y, in_position_z, 1.0);
+    // As large as the points, which are at least a pixel wide
+    float half_size = 0.5 * max(in_size, -center.z / point_scale);
+    vec2 corner = corners[gl_VertexID];
+    gl_Position = projection * (center + vec4(corner * half_size, 0.0, 0.0));
+    // Flipped like gl_PointCoord
+    texcoord = vec2(corner.x, -corner.y) * 0.5 + 0.5;
+    point_color = in_color;
+}
+)";
+
+const char quad_fragment_shader_source[] =
+R"(#version 330 core
+
+uniform sampler2D particle_texture;
+
+in vec2 texcoord;
+in vec4 point_color;
+
 layout (location = 0) out vec4 out_color;
 
 void main()
 {
-    out_color = vec4(1.0, 0.0, 0.0, 1.0);
+    out_color = vec4(point_color.rgb, point_color.a * texture(particle_texture, texcoord).r);
 }
 )";
 
@@ -126,11 +208,6 @@ GLuint create_program(Shaders ... shaders)
     return result;
 }
 
-struct particle
-{
-    glm::vec3 position;
-};
-
 int main() try
 {
     if (SDL_Init(SDL_INIT_VIDEO) != 0)
@@ -178,31 +255,98 @@ int main() try
     GLuint view_location = glGetUniformLocation(program, "view");
     GLuint projection_location = glGetUniformLocation(program, "projection");
     GLuint camera_position_location = glGetUniformLocation(program, "camera_position");
+    GLuint point_scale_location = glGetUniformLocation(program, "point_scale");
+    GLuint particle_texture_location = glGetUniformLocation(program, "particle_texture");
 
-    std::default_random_engine rng;
+    auto quad_vertex_shader = create_shader(GL_VERTEX_SHADER, quad_vertex_shader_source);
+    auto quad_fragment_shader = create_shader(GL_FRAGMENT_SHADER, quad_fragment_shader_source);
+    auto quad_program = create_program(quad_vertex_shader, quad_fragment_shader);
 
-    std::vector<particle> particles(256);
-    for (auto & p : particles)
-    {
-        p.position.x = std::uniform_real_distribution<float>{-1.f, 1.f}(rng);
-        p.position.y = 0.f;
-        p.position.z = std::uniform_real_distribution<float>{-1.f, 1.f}(rng);
-    }
+    GLuint quad_model_location = glGetUniformLocation(quad_program, "model");
+    GLuint quad_view_location = glGetUniformLocation(quad_program, "view");
+    GLuint quad_projection_location = glGetUniformLocation(quad_program, "projection");
+    GLuint quad_point_scale_location = glGetUniformLocation(quad_program, "point_scale");
+    GLuint quad_particle_texture_location = glGetUniformLocation(quad_program, "particle_texture");
+
+    job_system jobs;
+    std::size_t const particle_capacity = 1'000'000;
+    particle_system particles(particle_capacity);
+
+    // E switches from respawning to emitters on the CPU: a fountain with a constant
+    // rate, and a wide burst at the press of B. Dead particles are removed instead
+    particle_emitter fountain;
+    fountain.rate = 500'000.f;
+
+    particle_emitter burst;
+    burst.parameters.emitter_position = {0.5f, 1.f, 0.f};
+    burst.parameters.spread = 2.f;
+    burst.parameters.min_speed = 0.5f;
+    burst.parameters.max_speed = 1.5f;
+
+    particle_emitter * const emitters[] = {&fountain, &burst};
 
-    GLuint vao, vbo;
+    GLuint vao;
     glGenVertexArrays(1, &vao);
     glBindVertexArray(vao);
 
-    glGenBuffers(1, &vbo);
-    glBindBuffer(GL_ARRAY_BUFFER, vbo);
-
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(particle), (void*)(0));
+    for (GLuint i = 0; i < 5; ++i)
+        glEnableVertexAttribArray(i);
+
+    // Every frame the particle arrays are written one after another, in the order
+    // of their attribute locations, into the next region of the buffer
+    stream_buffer particle_buffer(GL_ARRAY_BUFFER);
+
+    // Blended particles are drawn back to front through sorted indices, streamed the
+    // same way; the element array binding is part of the VAO, so it stays bound. S toggles sorting
+    depth_sorter sorter;
+    stream_buffer index_buffer(GL_ELEMENT_ARRAY_BUFFER);
+    bool sorted = true;
+
+    // N makes the CPU particles push each other apart, found through the spatial grid
+    spatial_grid grid;
+    bool separation = false;
+    float const separation_radius = 0.01f;
+    float const separation_strength = 1.f;
+
+    // G switches the simulation between the CPU and transform feedback, handing the state over
+    gpu_particle_system gpu_particles;
+    bool gpu_simulation = false;
+
+    // Q switches from points expanded by the geometry shader to instanced quads, with the
+    // particle arrays as per-instance attributes. C alternates them every frame, to compare
+    // their frame and draw (GPU timer query) times side by side
+    enum renderer_type { geometry_shader_renderer, instanced_quad_renderer, renderer_count };
+    char const * renderer_names[renderer_count] = {"geometry shader", "instanced quads"};
+    int renderer = geometry_shader_renderer;
+    bool compare_renderers = false;
+    int last_renderer = -1;
+
+    // A query is only restarted once its result has been read
+    GLuint draw_queries[renderer_count];
+    glGenQueries(renderer_count, draw_queries);
+    bool draw_query_pending[renderer_count] = {};
 
     const std::string project_root = PROJECT_ROOT;
     const std::string particle_texture_path = project_root + "/particle.png";
 
-    glPointSize(5.f);
+    GLuint particle_texture;
+    {
+        int texture_width, texture_height, channels;
+        auto pixels = stbi_load(particle_texture_path.c_str(), &texture_width, &texture_height, &channels, 4);
+        if (!pixels)
+            throw std::runtime_error("Failed to load " + particle_texture_path);
+
+        glGenTextures(1, &particle_texture);
+        glBindTexture(GL_TEXTURE_2D, particle_texture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, texture_width, texture_height, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glGenerateMipmap(GL_TEXTURE_2D);
+
+        stbi_image_free(pixels);
+    }
+
+    glEnable(GL_PROGRAM_POINT_SIZE);
 
     auto last_frame_start = std::chrono::high_resolution_clock::now();
 
@@ -218,6 +362,18 @@ int main() try
 
     bool paused = false;
 
+    float stats_time = 0.f;
+    float stats_update_time = 0.f;
+    float stats_upload_time = 0.f;
+    float stats_sort_time = 0.f;
+    float stats_separation_time = 0.f;
+    std::size_t stats_coherent_frames = 0;
+    float stats_renderer_frame_time[renderer_count] = {};
+    std::size_t stats_renderer_frames[renderer_count] = {};
+    float stats_renderer_draw_time[renderer_count] = {};
+    std::size_t stats_renderer_draws[renderer_count] = {};
+    std::size_t stats_frames = 0;
+
     bool running = true;
     while (running)
     {
@@ -239,6 +395,31 @@ int main() try
             button_down[event.key.keysym.sym] = true;
             if (event.key.keysym.sym == SDLK_SPACE)
                 paused = !paused;
+            if (event.key.keysym.sym == SDLK_s)
+                sorted = !sorted;
+            if (event.key.keysym.sym == SDLK_n)
+                separation = !separation;
+            if (event.key.keysym.sym == SDLK_q)
+                renderer = (renderer + 1) % renderer_count;
+            if (event.key.keysym.sym == SDLK_c)
+                compare_renderers = !compare_renderers;
+            if (event.key.keysym.sym == SDLK_e && !gpu_simulation)
+            {
+                particles.respawn = !particles.respawn;
+                if (particles.respawn)
+                    particles.resize(particle_capacity);
+            }
+            if (event.key.keysym.sym == SDLK_b)
+                burst.burst(200'000);
+            // Transform feedback only respawns
+            if (event.key.keysym.sym == SDLK_g && particles.respawn)
+            {
+                gpu_simulation = !gpu_simulation;
+                if (gpu_simulation)
+                    gpu_particles.upload(particles);
+                else
+                    gpu_particles.download(particles);
+            }
             break;
         case SDL_KEYUP:
             button_down[event.key.keysym.sym] = false;
@@ -253,6 +434,34 @@ int main() try
         last_frame_start = now;
         time += dt;
 
+        // The frame that just ended
+        if (last_renderer >= 0)
+        {
+            stats_renderer_frame_time[last_renderer] += dt;
+            ++stats_renderer_frames[last_renderer];
+        }
+
+        for (int i = 0; i < renderer_count; ++i)
+        {
+            if (!draw_query_pending[i])
+                continue;
+
+            GLint available;
+            glGetQueryObjectiv(draw_queries[i], GL_QUERY_RESULT_AVAILABLE, &available);
+            if (!available)
+                continue;
+
+            GLuint64 nanoseconds;
+            glGetQueryObjectui64v(draw_queries[i], GL_QUERY_RESULT, &nanoseconds);
+            stats_renderer_draw_time[i] += nanoseconds * 1e-9f;
+            ++stats_renderer_draws[i];
+            draw_query_pending[i] = false;
+        }
+
+        if (compare_renderers)
+            renderer = (renderer + 1) % renderer_count;
+        bool const instanced = (renderer == instanced_quad_renderer);
+
         if (button_down[SDLK_UP])
             camera_distance -= 3.f * dt;
         if (button_down[SDLK_DOWN])
@@ -263,8 +472,36 @@ int main() try
         if (button_down[SDLK_RIGHT])
             camera_rotation += 3.f * dt;
 
+        if (!paused)
+        {
+            auto update_start = std::chrono::high_resolution_clock::now();
+            // Long frames (e.g. window dragging) would throw particles far away
+            if (gpu_simulation)
+                gpu_particles.update(std::min(dt, 0.05f));
+            else
+            {
+                particles.update(std::min(dt, 0.05f), jobs);
+                if (!particles.respawn)
+                    for (auto * emitter : emitters)
+                        particles.emit(*emitter, std::min(dt, 0.05f));
+            }
+            stats_update_time += std::chrono::duration_cast<std::chrono::duration<float>>(std::chrono::high_resolution_clock::now() - update_start).count();
+
+            if (separation && !gpu_simulation)
+            {
+                auto separation_start = std::chrono::high_resolution_clock::now();
+                grid.build(particles, separation_radius, jobs);
+                apply_separation(particles, grid, separation_radius, separation_strength, std::min(dt, 0.05f), jobs);
+                stats_separation_time += std::chrono::duration_cast<std::chrono::duration<float>>(std::chrono::high_resolution_clock::now() - separation_start).count();
+            }
+        }
+
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
         glEnable(GL_DEPTH_TEST);
+        glEnable(GL_BLEND);
+        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+        // Sorted or not, blended particles mustn't hide each other
+        glDepthMask(GL_FALSE);
 
         float near = 0.1f;
         float far = 100.f;
@@ -280,18 +517,183 @@ int main() try
 
         glm::vec3 camera_position = (glm::inverse(view) * glm::vec4(0.f, 0.f, 0.f, 1.f)).xyz();
 
-        glBindBuffer(GL_ARRAY_BUFFER, vbo);
-        glBufferData(GL_ARRAY_BUFFER, particles.size() * sizeof(particle), particles.data(), GL_STATIC_DRAW);
+        float point_scale = projection[1][1] * height / 2.f;
+
+        // Positions only live on the GPU with transform feedback, so that path isn't sorted
+        bool const sort_particles = sorted && !gpu_simulation;
+        if (sort_particles)
+        {
+            auto sort_start = std::chrono::high_resolution_clock::now();
+
+            sorter.sort(particles, camera_position, jobs);
+            if (sorter.stats().coherent)
+                ++stats_coherent_frames;
+
+            // Indices can't reorder instances, so quads get the arrays gathered in order instead
+            if (!instanced && !sorter.order().empty())
+            {
+                auto const & order = sorter.order();
+                glBindVertexArray(vao);
+                void * indices = index_buffer.map(order.size() * sizeof(std::uint32_t));
+                std::memcpy(indices, order.data(), order.size() * sizeof(std::uint32_t));
+                index_buffer.unmap();
+            }
+
+            stats_sort_time += std::chrono::duration_cast<std::chrono::duration<float>>(std::chrono::high_resolution_clock::now() - sort_start).count();
+        }
+
+        auto upload_start = std::chrono::high_resolution_clock::now();
+
+        std::size_t const particle_array_size = particles.count() * sizeof(float);
+        // The emitters may leave no particles at all, then there is nothing to upload or draw
+        if (!gpu_simulation && particles.count() > 0)
+        {
+            char * data = static_cast<char *>(particle_buffer.map(5 * particle_array_size));
+
+            // All the arrays have 4-byte elements
+            void const * arrays[5] = {particles.position_x.data(), particles.position_y.data(), particles.position_z.data(), particles.size.data(), particles.color.data()};
+            bool const gather = sort_particles && instanced;
+            jobs.parallel_for(5, 1, [&](std::size_t begin, std::size_t end)
+            {
+                for (std::size_t i = begin; i < end; ++i)
+                {
+                    if (gather)
+                    {
+                        auto source = static_cast<std::uint32_t const *>(arrays[i]);
+                        auto destination = reinterpret_cast<std::uint32_t *>(data + i * particle_array_size);
+                        auto const & order = sorter.order();
+                        for (std::size_t j = 0; j < order.size(); ++j)
+                            destination[j] = source[order[j]];
+                    }
+                    else
+                        std::memcpy(data + i * particle_array_size, arrays[i], particle_array_size);
+                }
+            });
+
+            particle_buffer.unmap();
+        }
+
+        stats_upload_time += std::chrono::duration_cast<std::chrono::duration<float>>(std::chrono::high_resolution_clock::now() - upload_start).count();
+
+        if (instanced)
+        {
+            glUseProgram(quad_program);
 
-        glUseProgram(program);
+            glUniformMatrix4fv(quad_model_location, 1, GL_FALSE, reinterpret_cast<float *>(&model));
+            glUniformMatrix4fv(quad_view_location, 1, GL_FALSE, reinterpret_cast<float *>(&view));
+            glUniformMatrix4fv(quad_projection_location, 1, GL_FALSE, reinterpret_cast<float *>(&projection));
+            glUniform1f(quad_point_scale_location, point_scale);
+            glUniform1i(quad_particle_texture_location, 0);
+        }
+        else
+        {
+            glUseProgram(program);
+
+            glUniformMatrix4fv(model_location, 1, GL_FALSE, reinterpret_cast<float *>(&model));
+            glUniformMatrix4fv(view_location, 1, GL_FALSE, reinterpret_cast<float *>(&view));
+            glUniformMatrix4fv(projection_location, 1, GL_FALSE, reinterpret_cast<float *>(&projection));
+            glUniform3fv(camera_position_location, 1, reinterpret_cast<float *>(&camera_position));
+            glUniform1f(point_scale_location, point_scale);
+            glUniform1i(particle_texture_location, 0);
+        }
 
-        glUniformMatrix4fv(model_location, 1, GL_FALSE, reinterpret_cast<float *>(&model));
-        glUniformMatrix4fv(view_location, 1, GL_FALSE, reinterpret_cast<float *>(&view));
-        glUniformMatrix4fv(projection_location, 1, GL_FALSE, reinterpret_cast<float *>(&projection));
-        glUniform3fv(camera_position_location, 1, reinterpret_cast<float *>(&camera_position));
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, particle_texture);
 
         glBindVertexArray(vao);
-        glDrawArrays(GL_POINTS, 0, particles.size());
+
+        for (GLuint i = 0; i < 5; ++i)
+            glVertexAttribDivisor(i, instanced ? 1 : 0);
+
+        bool const timed = !draw_query_pending[renderer];
+        if (timed)
+            glBeginQuery(GL_TIME_ELAPSED, draw_queries[renderer]);
+
+        if (gpu_simulation)
+        {
+            // Straight from the transform feedback output
+            glBindBuffer(GL_ARRAY_BUFFER, gpu_particles.buffer());
+            glVertexAttribPointer(0, 1, GL_FLOAT, GL_FALSE, sizeof(gpu_particle), reinterpret_cast<void *>(offsetof(gpu_particle, position_x)));
+            glVertexAttribPointer(1, 1, GL_FLOAT, GL_FALSE, sizeof(gpu_particle), reinterpret_cast<void *>(offsetof(gpu_particle, position_y)));
+            glVertexAttribPointer(2, 1, GL_FLOAT, GL_FALSE, sizeof(gpu_particle), reinterpret_cast<void *>(offsetof(gpu_particle, position_z)));
+            glVertexAttribPointer(3, 1, GL_FLOAT, GL_FALSE, sizeof(gpu_particle), reinterpret_cast<void *>(offsetof(gpu_particle, size)));
+            glVertexAttribPointer(4, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(gpu_particle), reinterpret_cast<void *>(offsetof(gpu_particle, color)));
+
+            if (instanced)
+                glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, gpu_particles.count());
+            else
+                glDrawArrays(GL_POINTS, 0, gpu_particles.count());
+        }
+        else if (particles.count() > 0)
+        {
+            // The region changes every frame, and the buffer is still bound by map
+            std::size_t const base = particle_buffer.offset();
+            for (GLuint i = 0; i < 4; ++i)
+                glVertexAttribPointer(i, 1, GL_FLOAT, GL_FALSE, 0, reinterpret_cast<void *>(base + i * particle_array_size));
+            glVertexAttribPointer(4, 4, GL_UNSIGNED_BYTE, GL_TRUE, 0, reinterpret_cast<void *>(base + 4 * particle_array_size));
+
+            if (instanced)
+                glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, particles.count());
+            else if (sort_particles)
+            {
+                glDrawElements(GL_POINTS, particles.count(), GL_UNSIGNED_INT, reinterpret_cast<void *>(index_buffer.offset()));
+                index_buffer.fence();
+            }
+            else
+                glDrawArrays(GL_POINTS, 0, particles.count());
+            particle_buffer.fence();
+        }
+
+        if (timed)
+        {
+            glEndQuery(GL_TIME_ELAPSED);
+            draw_query_pending[renderer] = true;
+        }
+        last_renderer = renderer;
+
+        glDepthMask(GL_TRUE);
+
+        stats_time += dt;
+        ++stats_frames;
+        if (stats_time >= 0.5f)
+        {
+            std::ostringstream title;
+            title << "Graphics course practice 11: " << (stats_time / stats_frames * 1000.f) << " ms/frame, " << particles.count() << " particles";
+            if (!particles.respawn)
+                title << " from emitters";
+            if (gpu_simulation)
+                title << " simulated on the GPU";
+            else
+                title << " updated in " << (stats_update_time / stats_frames * 1000.f) << " ms ("
+                    << (stats_update_time / stats_frames * 1e9f / particles.count()) << " ns/particle) on " << jobs.thread_count() << " threads"
+                    << ", uploaded in " << (stats_upload_time / stats_frames * 1000.f) << " ms"
+                    << " (fence waits " << (particle_buffer.wait_time() * 1000.f) << " ms total)";
+            if (separation && !gpu_simulation)
+                title << ", separated in " << (stats_separation_time / stats_frames * 1000.f) << " ms";
+            if (sorted && !gpu_simulation)
+                title << ", sorted in " << (stats_sort_time / stats_frames * 1000.f) << " ms ("
+                    << stats_coherent_frames << "/" << stats_frames << " frames coherent)";
+            for (int i = 0; i < renderer_count; ++i)
+                if (stats_renderer_frames[i] > 0 && stats_renderer_draws[i] > 0)
+                    title << ", " << renderer_names[i] << ": " << (stats_renderer_frame_time[i] / stats_renderer_frames[i] * 1000.f) << " ms/frame, "
+                        << (stats_renderer_draw_time[i] / stats_renderer_draws[i] * 1000.f) << " ms draw";
+            SDL_SetWindowTitle(window, title.str().c_str());
+
+            stats_time = 0.f;
+            stats_update_time = 0.f;
+            stats_upload_time = 0.f;
+            stats_sort_time = 0.f;
+            stats_separation_time = 0.f;
+            stats_coherent_frames = 0;
+            for (int i = 0; i < renderer_count; ++i)
+            {
+                stats_renderer_frame_time[i] = 0.f;
+                stats_renderer_frames[i] = 0;
+                stats_renderer_draw_time[i] = 0.f;
+                stats_renderer_draws[i] = 0;
+            }
+            stats_frames = 0;
+        }
 
         SDL_GL_SwapWindow(window);
     }
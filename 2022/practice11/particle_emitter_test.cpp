@@ -0,0 +1,126 @@
+// Runs particle_system as a fixed-capacity pool fed by emitters, with bursts that
+// overflow the capacity, and checks that emission never allocates and that the
+// capacity never changes. The global operator new is replaced to count allocations
+
+#include <atomic>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include <stdexcept>
+#include <string>
+
+#include "job_system.hpp"
+#include "particle_system.hpp"
+
+std::atomic<std::size_t> allocation_count{0};
+
+void * operator new(std::size_t size)
+{
+    ++allocation_count;
+    if (void * p = std::malloc(size > 0 ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+void * operator new(std::size_t size, std::align_val_t alignment)
+{
+    ++allocation_count;
+    std::size_t const a = std::size_t(alignment);
+#ifdef _MSC_VER
+    void * p = _aligned_malloc(size > 0 ? size : 1, a);
+#else
+    // aligned_alloc wants a nonzero multiple of the alignment
+    void * p = std::aligned_alloc(a, (size + a) / a * a);
+#endif
+    if (p)
+        return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void * p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void * p, std::size_t) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void * p, std::align_val_t) noexcept
+{
+#ifdef _MSC_VER
+    _aligned_free(p);
+#else
+    std::free(p);
+#endif
+}
+
+void operator delete(void * p, std::size_t, std::align_val_t alignment) noexcept
+{
+    operator delete(p, alignment);
+}
+
+int main() try
+{
+    std::size_t const capacity = 200'000;
+    int const frames = 600;
+
+    // No worker threads, so that nothing else allocates while emitting
+    job_system jobs(0);
+
+    particle_system particles(0);
+    particles.respawn = false;
+    particles.reserve(capacity);
+    std::size_t const reserved = particles.capacity();
+
+    // About 150k particles alive from the fountain alone, so the bursts overflow the capacity
+    particle_emitter fountain;
+    fountain.rate = 100'000.f;
+
+    particle_emitter burst;
+    burst.parameters.spread = 2.f;
+
+    std::size_t emit_allocations = 0;
+    std::size_t emitted = 0;
+    std::size_t full_frames = 0;
+
+    for (int frame = 0; frame < frames; ++frame)
+    {
+        float const dt = 1.f / 60.f + 0.002f * std::sin(frame * 0.3f);
+
+        // Removes the dead particles
+        particles.update(dt, jobs);
+
+        for (std::size_t i = 0; i < particles.count(); ++i)
+            if (!(particles.age[i] < particles.lifetime[i]))
+                throw std::runtime_error("Dead particle left at " + std::to_string(i) + " on frame " + std::to_string(frame));
+
+        if (frame % 100 == 0)
+            burst.burst(capacity / 2);
+
+        std::size_t const allocations_before = allocation_count;
+        emitted += particles.emit(fountain, dt);
+        emitted += particles.emit(burst, dt);
+        emit_allocations += allocation_count - allocations_before;
+
+        if (particles.count() == particles.capacity())
+            ++full_frames;
+
+        if (particles.capacity() != reserved)
+            throw std::runtime_error("Capacity changed from " + std::to_string(reserved) + " to " + std::to_string(particles.capacity()) + " on frame " + std::to_string(frame));
+        if (particles.count() > particles.capacity())
+            throw std::runtime_error("Count " + std::to_string(particles.count()) + " exceeds the capacity on frame " + std::to_string(frame));
+    }
+
+    std::cout << frames << " frames at capacity " << reserved << ": " << emitted << " particles emitted, "
+        << full_frames << " frames at full capacity, " << emit_allocations << " allocations in emit" << std::endl;
+
+    return (emit_allocations == 0 && full_frames > 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+catch (std::exception const & e)
+{
+    std::cerr << e.what() << std::endl;
+    return EXIT_FAILURE;
+}
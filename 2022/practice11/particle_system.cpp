@@ -0,0 +1,247 @@
+#include "particle_system.hpp"
+
+#include <glm/geometric.hpp>
+#include <glm/ext/scalar_constants.hpp>
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define PARTICLE_SYSTEM_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+
+    std::uint32_t hash(std::uint32_t x)
+    {
+        x ^= x >> 16;
+        x *= 0x7feb352du;
+        x ^= x >> 15;
+        x *= 0x846ca68bu;
+        x ^= x >> 16;
+        return x;
+    }
+
+    // Stateless random numbers in [0, 1), each from the hash of the previous one
+    struct random_sequence
+    {
+        std::uint32_t state;
+
+        float operator()()
+        {
+            state = hash(state);
+            return (state >> 8) * (1.f / 16777216.f);
+        }
+    };
+
+    float mix(float a, float b, float t)
+    {
+        return a + (b - a) * t;
+    }
+
+}
+
+particle_system::particle_system(std::size_t count, particle_parameters const & parameters)
+    : parameters(parameters)
+{
+    resize(count);
+}
+
+void particle_system::reserve(std::size_t capacity)
+{
+    std::size_t const padded_capacity = (capacity + simd_width - 1) / simd_width * simd_width;
+    if (padded_capacity <= position_x.size())
+        return;
+
+    for (auto * array : {&position_x, &position_y, &position_z, &velocity_x, &velocity_y, &velocity_z, &age, &lifetime, &size})
+        array->resize(padded_capacity);
+    color.resize(padded_capacity);
+}
+
+void particle_system::resize(std::size_t count)
+{
+    std::size_t const old_count = count_;
+    std::size_t const padded_count = (count + simd_width - 1) / simd_width * simd_width;
+
+    reserve(count);
+    count_ = count;
+
+    std::uint32_t const seed = hash(frame_ ^ 0x5bd1e995u);
+    random_sequence random{seed};
+    for (std::size_t i = old_count; i < padded_count; ++i)
+    {
+        spawn(i, seed, parameters);
+        age[i] = random() * lifetime[i];
+    }
+}
+
+void particle_system::update(float dt, job_system & jobs, std::size_t chunk_size)
+{
+    ++frame_;
+
+    // The padding of the last live SIMD group is updated too, the rest of the capacity isn't
+    std::size_t const padded_count = (count_ + simd_width - 1) / simd_width * simd_width;
+    jobs.parallel_for(padded_count, chunk_size, [this, dt](std::size_t begin, std::size_t end)
+    {
+        update_range(dt, begin, end);
+    });
+
+    if (!respawn)
+        remove_dead();
+}
+
+void particle_system::remove_dead()
+{
+    for (std::size_t i = 0; i < count_;)
+    {
+        if (age[i] < lifetime[i])
+        {
+            ++i;
+            continue;
+        }
+
+        // The moved particle may be dead too, so i is checked again
+        std::size_t const last = --count_;
+        for (auto * array : {&position_x, &position_y, &position_z, &velocity_x, &velocity_y, &velocity_z, &age, &lifetime, &size})
+            (*array)[i] = (*array)[last];
+        color[i] = color[last];
+    }
+}
+
+std::size_t particle_system::emit(particle_emitter & emitter, float dt)
+{
+    emitter.accumulator_ += emitter.rate * dt;
+    std::size_t const rate_count = std::size_t(emitter.accumulator_);
+    emitter.accumulator_ -= float(rate_count);
+
+    std::size_t const count = std::min(rate_count + emitter.burst_, capacity() - count_);
+    emitter.burst_ = 0;
+
+    // Slots are never reused within a frame, so the index and the frame keep the particles apart
+    std::uint32_t const seed = hash(frame_ ^ 0x27d4eb2fu);
+    for (std::size_t i = count_; i < count_ + count; ++i)
+        spawn(i, seed, emitter.parameters);
+
+    count_ += count;
+    return count;
+}
+
+void particle_system::update_range(float dt, std::size_t begin, std::size_t end)
+{
+    std::uint32_t const seed = hash(frame_);
+    bool const respawn_dead = respawn;
+
+    // Exact decay over the step, to stay stable for any dt
+    float const damping = std::exp(-parameters.drag * dt);
+    glm::vec3 const dv = parameters.gravity * dt;
+
+    std::size_t i = begin;
+
+#if defined(__AVX__)
+    __m256 const dt8 = _mm256_set1_ps(dt);
+    __m256 const damping8 = _mm256_set1_ps(damping);
+    __m256 const dvx = _mm256_set1_ps(dv.x);
+    __m256 const dvy = _mm256_set1_ps(dv.y);
+    __m256 const dvz = _mm256_set1_ps(dv.z);
+
+    for (; i + 8 <= end; i += 8)
+    {
+        __m256 vx = _mm256_mul_ps(_mm256_add_ps(_mm256_load_ps(&velocity_x[i]), dvx), damping8);
+        __m256 vy = _mm256_mul_ps(_mm256_add_ps(_mm256_load_ps(&velocity_y[i]), dvy), damping8);
+        __m256 vz = _mm256_mul_ps(_mm256_add_ps(_mm256_load_ps(&velocity_z[i]), dvz), damping8);
+        _mm256_store_ps(&velocity_x[i], vx);
+        _mm256_store_ps(&velocity_y[i], vy);
+        _mm256_store_ps(&velocity_z[i], vz);
+
+        _mm256_store_ps(&position_x[i], _mm256_add_ps(_mm256_load_ps(&position_x[i]), _mm256_mul_ps(vx, dt8)));
+        _mm256_store_ps(&position_y[i], _mm256_add_ps(_mm256_load_ps(&position_y[i]), _mm256_mul_ps(vy, dt8)));
+        _mm256_store_ps(&position_z[i], _mm256_add_ps(_mm256_load_ps(&position_z[i]), _mm256_mul_ps(vz, dt8)));
+
+        __m256 a = _mm256_add_ps(_mm256_load_ps(&age[i]), dt8);
+        _mm256_store_ps(&age[i], a);
+
+        // Dead particles are rare, so they are respawned one by one
+        int dead = respawn_dead ? _mm256_movemask_ps(_mm256_cmp_ps(a, _mm256_load_ps(&lifetime[i]), _CMP_GE_OQ)) : 0;
+        for (std::size_t k = 0; dead != 0; ++k, dead >>= 1)
+            if (dead & 1)
+                spawn(i + k, seed, parameters);
+    }
+#elif defined(PARTICLE_SYSTEM_SSE2)
+    __m128 const dt4 = _mm_set1_ps(dt);
+    __m128 const damping4 = _mm_set1_ps(damping);
+    __m128 const dvx = _mm_set1_ps(dv.x);
+    __m128 const dvy = _mm_set1_ps(dv.y);
+    __m128 const dvz = _mm_set1_ps(dv.z);
+
+    for (; i + 4 <= end; i += 4)
+    {
+        __m128 vx = _mm_mul_ps(_mm_add_ps(_mm_load_ps(&velocity_x[i]), dvx), damping4);
+        __m128 vy = _mm_mul_ps(_mm_add_ps(_mm_load_ps(&velocity_y[i]), dvy), damping4);
+        __m128 vz = _mm_mul_ps(_mm_add_ps(_mm_load_ps(&velocity_z[i]), dvz), damping4);
+        _mm_store_ps(&velocity_x[i], vx);
+        _mm_store_ps(&velocity_y[i], vy);
+        _mm_store_ps(&velocity_z[i], vz);
+
+        _mm_store_ps(&position_x[i], _mm_add_ps(_mm_load_ps(&position_x[i]), _mm_mul_ps(vx, dt4)));
+        _mm_store_ps(&position_y[i], _mm_add_ps(_mm_load_ps(&position_y[i]), _mm_mul_ps(vy, dt4)));
+        _mm_store_ps(&position_z[i], _mm_add_ps(_mm_load_ps(&position_z[i]), _mm_mul_ps(vz, dt4)));
+
+        __m128 a = _mm_add_ps(_mm_load_ps(&age[i]), dt4);
+        _mm_store_ps(&age[i], a);
+
+        // Dead particles are rare, so they are respawned one by one
+        int dead = respawn_dead ? _mm_movemask_ps(_mm_cmpge_ps(a, _mm_load_ps(&lifetime[i]))) : 0;
+        for (std::size_t k = 0; dead != 0; ++k, dead >>= 1)
+            if (dead & 1)
+                spawn(i + k, seed, parameters);
+    }
+#endif
+
+    for (; i < end; ++i)
+    {
+        velocity_x[i] = (velocity_x[i] + dv.x) * damping;
+        velocity_y[i] = (velocity_y[i] + dv.y) * damping;
+        velocity_z[i] = (velocity_z[i] + dv.z) * damping;
+
+        position_x[i] += velocity_x[i] * dt;
+        position_y[i] += velocity_y[i] * dt;
+        position_z[i] += velocity_z[i] * dt;
+
+        age[i] += dt;
+        if (respawn_dead && age[i] >= lifetime[i])
+            spawn(i, seed, parameters);
+    }
+}
+
+void particle_system::spawn(std::size_t i, std::uint32_t seed, particle_parameters const & p)
+{
+    random_sequence random{hash(std::uint32_t(i) * 0x9e3779b9u ^ seed)};
+
+    float const angle = 2.f * glm::pi<float>() * random();
+    float const radius = p.emitter_radius * std::sqrt(random());
+    position_x[i] = p.emitter_position.x + radius * std::cos(angle);
+    position_y[i] = p.emitter_position.y;
+    position_z[i] = p.emitter_position.z + radius * std::sin(angle);
+
+    // Separate statements fix the order of the random numbers, which the GPU version repeats
+    float const spread_x = p.spread * (2.f * random() - 1.f);
+    float const spread_z = p.spread * (2.f * random() - 1.f);
+    glm::vec3 direction = glm::normalize(glm::vec3(spread_x, 1.f, spread_z));
+    glm::vec3 velocity = direction * mix(p.min_speed, p.max_speed, random());
+    velocity_x[i] = velocity.x;
+    velocity_y[i] = velocity.y;
+    velocity_z[i] = velocity.z;
+
+    age[i] = 0.f;
+    lifetime[i] = mix(p.min_lifetime, p.max_lifetime, random());
+    size[i] = mix(p.min_size, p.max_size, random());
+
+    // Fire-like colors: red to yellow
+    std::uint32_t const green = 64 + std::uint32_t(191.f * random());
+    std::uint32_t const blue = std::uint32_t(64.f * random());
+    color[i] = 255u | (green << 8) | (blue << 16) | (255u << 24);
+}
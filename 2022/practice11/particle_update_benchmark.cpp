@@ -0,0 +1,63 @@
+// Times particle_system::update on a million particles with a single thread and
+// with all of them, and prints the time per particle. The frame count can be
+// given as the first argument. Both runs must end in bit-identical particles
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+
+#include "job_system.hpp"
+#include "particle_system.hpp"
+
+std::size_t const particle_count = 1'000'000;
+float const dt = 1.f / 60.f;
+
+particle_system run(job_system & jobs, int frames)
+{
+    particle_system particles(particle_count);
+
+    // Warms up the caches and the workers
+    for (int frame = 0; frame < 10; ++frame)
+        particles.update(dt, jobs);
+
+    auto const start = std::chrono::steady_clock::now();
+    for (int frame = 0; frame < frames; ++frame)
+        particles.update(dt, jobs);
+    double const ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+
+    std::cout << jobs.thread_count() << " thread(s): " << ns / frames / particle_count << " ns/particle, "
+        << ns / frames / 1e6 << " ms per frame" << std::endl;
+
+    return particles;
+}
+
+bool same(aligned_vector<float> const & a, aligned_vector<float> const & b)
+{
+    return a.size() == b.size() && std::memcmp(a.data(), b.data(), a.size() * sizeof(float)) == 0;
+}
+
+int main(int argc, char ** argv) try
+{
+    int const frames = (argc > 1) ? std::stoi(argv[1]) : 200;
+
+    std::cout << particle_count << " particles, " << frames << " frames" << std::endl;
+
+    job_system single(0);
+    particle_system const a = run(single, frames);
+
+    job_system all;
+    particle_system const b = run(all, frames);
+
+    if (!same(a.position_x, b.position_x) || !same(a.position_y, b.position_y) || !same(a.position_z, b.position_z) || !same(a.age, b.age))
+        throw std::runtime_error("Single and multithreaded updates differ");
+
+    return EXIT_SUCCESS;
+}
+catch (std::exception const & e)
+{
+    std::cerr << e.what() << std::endl;
+    return EXIT_FAILURE;
+}
@@ -0,0 +1,135 @@
+#include "spatial_grid.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <utility>
+
+namespace
+{
+
+    constexpr std::size_t block_size = std::size_t(1) << 14;
+
+}
+
+void spatial_grid::build(particle_system const & particles, float cell_size, job_system & jobs)
+{
+    std::size_t const n = particles.count();
+
+    cell_size_ = cell_size;
+    inverse_cell_size_ = 1.f / cell_size;
+
+    // About one bucket per particle keeps both the collisions and the table small
+    std::size_t const bucket_count = std::bit_ceil(std::max<std::size_t>(n, 1));
+    bucket_mask_ = std::uint32_t(bucket_count - 1);
+
+    particle_bucket_.resize(n);
+    bucket_start_.resize(bucket_count + 1);
+    bucket_fill_.resize(bucket_count);
+    index_.resize(n);
+    position_x_.resize(n);
+    position_y_.resize(n);
+    position_z_.resize(n);
+
+    jobs.parallel_for(bucket_count + 1, block_size, [&](std::size_t begin, std::size_t end)
+    {
+        std::fill(bucket_start_.begin() + begin, bucket_start_.begin() + end, 0);
+    });
+
+    jobs.parallel_for(n, block_size, [&](std::size_t begin, std::size_t end)
+    {
+        for (std::size_t i = begin; i < end; ++i)
+        {
+            std::uint32_t const b = bucket(cell(particles.position_x[i]), cell(particles.position_y[i]), cell(particles.position_z[i]));
+            particle_bucket_[i] = b;
+            std::atomic_ref<std::uint32_t>(bucket_start_[b]).fetch_add(1, std::memory_order_relaxed);
+        }
+    });
+
+    // Exclusive prefix sum of the counts: sums of blocks, then the blocks themselves
+    std::size_t const block_count = (bucket_count + block_size - 1) / block_size;
+    block_sums_.resize(block_count);
+
+    jobs.parallel_for(block_count, 1, [&](std::size_t block, std::size_t)
+    {
+        std::uint32_t sum = 0;
+        for (std::size_t b = block * block_size, end = std::min(bucket_count, b + block_size); b < end; ++b)
+            sum += bucket_start_[b];
+        block_sums_[block] = sum;
+    });
+
+    std::uint32_t total = 0;
+    for (auto & sum : block_sums_)
+        total += std::exchange(sum, total);
+
+    jobs.parallel_for(block_count, 1, [&](std::size_t block, std::size_t)
+    {
+        std::uint32_t offset = block_sums_[block];
+        for (std::size_t b = block * block_size, end = std::min(bucket_count, b + block_size); b < end; ++b)
+        {
+            bucket_fill_[b] = offset;
+            offset += std::exchange(bucket_start_[b], offset);
+        }
+    });
+    bucket_start_[bucket_count] = total;
+
+    // The scatter order within a bucket depends on the thread scheduling, so every bucket
+    // is then sorted by particle index: otherwise the queries which stop early, like
+    // apply_separation, would see different neighbors from run to run
+    jobs.parallel_for(n, block_size, [&](std::size_t begin, std::size_t end)
+    {
+        for (std::size_t i = begin; i < end; ++i)
+        {
+            std::uint32_t const slot = std::atomic_ref<std::uint32_t>(bucket_fill_[particle_bucket_[i]]).fetch_add(1, std::memory_order_relaxed);
+            index_[slot] = std::uint32_t(i);
+        }
+    });
+
+    jobs.parallel_for(bucket_count, block_size, [&](std::size_t begin, std::size_t end)
+    {
+        for (std::size_t b = begin; b < end; ++b)
+        {
+            std::uint32_t const first = bucket_start_[b], last = bucket_start_[b + 1];
+            if (last - first > 1)
+                std::sort(index_.begin() + first, index_.begin() + last);
+
+            for (std::uint32_t slot = first; slot < last; ++slot)
+            {
+                std::uint32_t const i = index_[slot];
+                position_x_[slot] = particles.position_x[i];
+                position_y_[slot] = particles.position_y[i];
+                position_z_[slot] = particles.position_z[i];
+            }
+        }
+    });
+}
+
+void apply_separation(particle_system & particles, spatial_grid const & grid, float radius, float strength, float dt,
+    job_system & jobs, std::size_t max_neighbors)
+{
+    // Slot order, so that consecutive queries touch the same buckets
+    jobs.parallel_for(grid.count(), block_size, [&](std::size_t begin, std::size_t end)
+    {
+        for (std::size_t slot = begin; slot < end; ++slot)
+        {
+            glm::vec3 push(0.f);
+            std::size_t neighbors = 0;
+
+            grid.for_each_neighbor(grid.position(slot), radius, [&](std::size_t other, glm::vec3 const & offset, float distance_squared)
+            {
+                // Coinciding particles have no direction to be pushed in
+                if (other == slot || distance_squared == 0.f)
+                    return true;
+
+                float const distance = std::sqrt(distance_squared);
+                push += offset * ((radius - distance) / (radius * distance));
+                return ++neighbors < max_neighbors;
+            });
+
+            std::uint32_t const i = grid.index(slot);
+            particles.velocity_x[i] += push.x * strength * dt;
+            particles.velocity_y[i] += push.y * strength * dt;
+            particles.velocity_z[i] += push.z * strength * dt;
+        }
+    });
+}
@@ -0,0 +1,97 @@
+#include "stream_buffer.hpp"
+
+#include <chrono>
+#include <stdexcept>
+
+stream_buffer::stream_buffer(GLenum target, std::size_t region_size)
+    : target_(target)
+{
+    glGenBuffers(1, &id_);
+    allocate(region_size);
+}
+
+stream_buffer::~stream_buffer()
+{
+    for (auto fence : fences_)
+        if (fence)
+            glDeleteSync(fence);
+    glDeleteBuffers(1, &id_);
+}
+
+void stream_buffer::allocate(std::size_t region_size)
+{
+    // Fresh storage, nothing reads it yet
+    for (auto & fence : fences_)
+    {
+        if (fence)
+            glDeleteSync(fence);
+        fence = nullptr;
+    }
+
+    region_size_ = region_size;
+    glBindBuffer(target_, id_);
+    glBufferData(target_, region_size_ * region_count, nullptr, GL_STREAM_DRAW);
+}
+
+void * stream_buffer::map(std::size_t size)
+{
+    // glMapBufferRange fails on an empty range
+    if (size == 0)
+        return nullptr;
+
+    if (size > region_size_)
+        // Some headroom, so that slowly growing data doesn't reallocate every frame
+        allocate(size + size / 2);
+
+    region_ = (region_ + 1) % region_count;
+
+    if (GLsync & fence = fences_[region_])
+    {
+        auto wait_start = std::chrono::high_resolution_clock::now();
+
+        // Flush on the first try only, or the wait may never end
+        GLbitfield flags = GL_SYNC_FLUSH_COMMANDS_BIT;
+        while (true)
+        {
+            GLenum result = glClientWaitSync(fence, flags, 1'000'000);
+            if (result == GL_ALREADY_SIGNALED || result == GL_CONDITION_SATISFIED)
+                break;
+            if (result == GL_WAIT_FAILED)
+                throw std::runtime_error("glClientWaitSync failed");
+            flags = 0;
+        }
+
+        wait_time_ += std::chrono::duration_cast<std::chrono::duration<float>>(std::chrono::high_resolution_clock::now() - wait_start).count();
+
+        glDeleteSync(fence);
+        fence = nullptr;
+    }
+
+    glBindBuffer(target_, id_);
+    void * data = glMapBufferRange(target_, offset(), size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+    if (!data)
+        throw std::runtime_error("glMapBufferRange failed");
+
+    mapped_ = true;
+    fence_pending_ = true;
+    return data;
+}
+
+void stream_buffer::unmap()
+{
+    if (!mapped_)
+        return;
+
+    glBindBuffer(target_, id_);
+    glUnmapBuffer(target_);
+    mapped_ = false;
+}
+
+void stream_buffer::fence()
+{
+    if (!fence_pending_)
+        return;
+
+    fences_[region_] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    fence_pending_ = false;
+}
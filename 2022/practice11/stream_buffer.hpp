@@ -0,0 +1,54 @@
+#pragma once
+
+#include <GL/glew.h>
+
+#include <array>
+#include <cstddef>
+
+// Buffer for data rewritten every frame, split into a ring of regions.
+// Each frame maps the next region unsynchronized, so neither the storage
+// is reallocated nor the driver waits for the draws reading the previous
+// frames; instead a fence per region guarantees the GPU is done with a
+// region before it is overwritten, which only happens if the CPU runs
+// more than region_count frames ahead
+struct stream_buffer
+{
+    static constexpr std::size_t region_count = 3;
+
+    explicit stream_buffer(GLenum target, std::size_t region_size = 0);
+    ~stream_buffer();
+
+    stream_buffer(stream_buffer const &) = delete;
+    stream_buffer & operator = (stream_buffer const &) = delete;
+
+    GLuint id() const { return id_; }
+
+    // Byte offset of the currently mapped region, for attribute pointers and draw calls
+    std::size_t offset() const { return region_ * region_size_; }
+
+    // Moves on to the next region and maps size bytes of it, binding the buffer to
+    // its target. Grows the storage (the only reallocation) if size doesn't fit.
+    // Mapping zero bytes returns nullptr and leaves the buffer as it is, then unmap
+    // and fence do nothing
+    void * map(std::size_t size);
+    void unmap();
+
+    // Must follow the draw calls reading the current region
+    void fence();
+
+    // Total time spent waiting for fences, in seconds
+    float wait_time() const { return wait_time_; }
+
+private:
+    GLenum target_;
+    GLuint id_ = 0;
+    std::size_t region_size_ = 0;
+    std::size_t region_ = region_count - 1;
+    std::array<GLsync, region_count> fences_{};
+    // Whether the current region was mapped since the last unmap and fence
+    bool mapped_ = false;
+    bool fence_pending_ = false;
+    float wait_time_ = 0.f;
+
+    void allocate(std::size_t region_size);
+};
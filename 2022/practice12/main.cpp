@@ -16,6 +16,9 @@
 #include <random>
 #include <map>
 #include <cmath>
+#include <algorithm>
+#include <iterator>
+#include <sstream>
 
 #define GLM_FORCE_SWIZZLE
 #define GLM_ENABLE_EXPERIMENTAL
@@ -28,6 +31,7 @@
 #include <glm/gtx/string_cast.hpp>
 
 #include "obj_parser.hpp"
+#include "macro_grid.hpp"
 #include "stb_image.h"
 
 std::string to_string(std::string_view str)
@@ -73,6 +77,19 @@ uniform vec3 light_direction;
 uniform vec3 bbox_min;
 uniform vec3 bbox_max;
 
+uniform sampler3D density_texture;
+// Min and max density of every macro cell
+uniform sampler3D macro_texture;
+// Macro cells per unit of texture coordinates
+uniform vec3 macro_scale;
+uniform bool skip_empty;
+// Distance between samples, half a voxel
+uniform float step_size;
+
+uniform float absorption;
+uniform vec3 light_color;
+uniform vec3 ambient_light;
+
 layout (location = 0) out vec4 out_color;
 
 void sort(inout float x, inout float y)
@@ -111,9 +128,103 @@ const float PI = 3.1415926535;
 
 in vec3 position;
 
+// Texture coordinates of a point
+vec3 volume_coords(vec3 p)
+{
+    return (p - bbox_min) / (bbox_max - bbox_min);
+}
+
+// Index of the first sample (at origin + direction * (i + 0.5) * step_size) at or
+// after sample i outside of empty macro cells. The samples stay the same as without
+// skipping, so the result is exactly the same, as an empty cell contributes nothing
+int skip_empty_cells(vec3 origin, vec3 direction, int i, int sample_count)
+{
+    vec3 cell_origin = volume_coords(origin) * macro_scale;
+    vec3 cell_direction = direction / (bbox_max - bbox_min) * macro_scale;
+    // Axis-parallel rays never leave the cell across the axes they are parallel to
+    cell_direction = mix(cell_direction, vec3(1e-6), equal(cell_direction, vec3(0.0)));
+
+    while (i < sample_count)
+    {
+        float t = (float(i) + 0.5) * step_size;
+        vec3 cell = floor(cell_origin + cell_direction * t);
+        // Samples just outside the volume read its boundary, as the density texture is clamped
+        ivec3 texel = clamp(ivec3(cell), ivec3(0), textureSize(macro_texture, 0) - 1);
+        if (texelFetch(macro_texture, texel, 0).g > 0.0)
+            break;
+
+        vec3 cell_exit = (cell + step(vec3(0.0), cell_direction) - cell_origin) / cell_direction;
+        i = max(i + 1, int(ceil(vmin(cell_exit) / step_size - 0.5)));
+    }
+
+    return i;
+}
+
+// Transmittance from a point towards the light
+float light_transmittance(vec3 origin)
+{
+    vec2 t = intersect_bbox(origin, light_direction);
+    int sample_count = int(ceil(max(t.y, 0.0) / step_size));
+
+    float optical_depth = 0.0;
+    for (int i = 0; i < sample_count; ++i)
+    {
+        if (skip_empty)
+        {
+            i = skip_empty_cells(origin, light_direction, i, sample_count);
+            if (i == sample_count)
+                break;
+        }
+
+        vec3 p = origin + light_direction * (float(i) + 0.5) * step_size;
+        optical_depth += absorption * texture(density_texture, volume_coords(p)).r * step_size;
+
+        if (optical_depth > 5.0)
+            break;
+    }
+
+    return exp(-optical_depth);
+}
+
 void main()
 {
-    out_color = vec4(1.0, 0.5, 0.5, 1.0);
+    vec3 direction = normalize(position - camera_position);
+    vec2 t = intersect_bbox(camera_position, direction);
+    t.x = max(t.x, 0.0);
+
+    vec3 origin = camera_position + direction * t.x;
+    int sample_count = int(ceil((t.y - t.x) / step_size));
+
+    vec3 color = vec3(0.0);
+    float transmittance = 1.0;
+
+    for (int i = 0; i < sample_count; ++i)
+    {
+        if (skip_empty)
+        {
+            i = skip_empty_cells(origin, direction, i, sample_count);
+            if (i == sample_count)
+                break;
+        }
+
+        vec3 p = origin + direction * (float(i) + 0.5) * step_size;
+        float density = texture(density_texture, volume_coords(p)).r;
+        if (density == 0.0)
+            continue;
+
+        // Single scattering of everything absorbed
+        float alpha = 1.0 - exp(-absorption * density * step_size);
+        vec3 light = ambient_light + light_color * light_transmittance(p);
+        color += transmittance * alpha * light;
+        transmittance *= 1.0 - alpha;
+
+        // Nothing behind would be visible
+        if (transmittance < 0.01)
+            break;
+    }
+
+    float alpha = 1.0 - transmittance;
+    out_color = vec4(color / max(alpha, 1e-4), alpha);
 }
 )";
 
@@ -236,6 +347,14 @@ int main() try
     GLuint bbox_max_location = glGetUniformLocation(program, "bbox_max");
     GLuint camera_position_location = glGetUniformLocation(program, "camera_position");
     GLuint light_direction_location = glGetUniformLocation(program, "light_direction");
+    GLuint density_texture_location = glGetUniformLocation(program, "density_texture");
+    GLuint macro_texture_location = glGetUniformLocation(program, "macro_texture");
+    GLuint macro_scale_location = glGetUniformLocation(program, "macro_scale");
+    GLuint skip_empty_location = glGetUniformLocation(program, "skip_empty");
+    GLuint step_size_location = glGetUniformLocation(program, "step_size");
+    GLuint absorption_location = glGetUniformLocation(program, "absorption");
+    GLuint light_color_location = glGetUniformLocation(program, "light_color");
+    GLuint ambient_light_location = glGetUniformLocation(program, "ambient_light");
 
     GLuint vao, vbo, ebo;
     glGenVertexArrays(1, &vao);
@@ -254,10 +373,75 @@ int main() try
 
     const std::string project_root = PROJECT_ROOT;
     const std::string cloud_data_path = project_root + "/cloud.data";
+    const std::string bunny_data_path = project_root + "/bunny.data";
 
     const glm::vec3 cloud_bbox_min{-2.f, -1.f, -1.f};
     const glm::vec3 cloud_bbox_max{ 2.f,  1.f,  1.f};
 
+    const glm::vec3 bunny_bbox_min{-1.f, -1.f, -1.f};
+    const glm::vec3 bunny_bbox_max{ 1.f,  1.f,  1.f};
+
+    // Voxels per side of a macro cell
+    const int macro_cell_size = 4;
+
+    struct volume
+    {
+        std::string name;
+        glm::vec3 bbox_min, bbox_max;
+        glm::ivec3 size;
+        GLuint texture = 0;
+        glm::ivec3 macro_size{0};
+        GLuint macro_texture = 0;
+        float macro_build_time = 0.f;
+    };
+
+    auto load_volume = [&](std::string name, std::string const & path, glm::ivec3 const & size, glm::vec3 const & bbox_min, glm::vec3 const & bbox_max)
+    {
+        std::ifstream input(path, std::ios::binary);
+        std::vector<std::uint8_t> voxels((std::istreambuf_iterator<char>(input)), std::istreambuf_iterator<char>());
+        if (voxels.size() != std::size_t(size.x) * size.y * size.z)
+            throw std::runtime_error("Failed to load " + path);
+
+        volume result{std::move(name), bbox_min, bbox_max, size};
+
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+        glGenTextures(1, &result.texture);
+        glBindTexture(GL_TEXTURE_3D, result.texture);
+        glTexImage3D(GL_TEXTURE_3D, 0, GL_R8, size.x, size.y, size.z, 0, GL_RED, GL_UNSIGNED_BYTE, voxels.data());
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+
+        auto build_start = std::chrono::high_resolution_clock::now();
+        macro_grid grid = build_macro_grid(voxels.data(), size, 1, macro_cell_size);
+        result.macro_build_time = std::chrono::duration_cast<std::chrono::duration<float>>(std::chrono::high_resolution_clock::now() - build_start).count();
+        result.macro_size = grid.size;
+
+        glGenTextures(1, &result.macro_texture);
+        glBindTexture(GL_TEXTURE_3D, result.macro_texture);
+        glTexImage3D(GL_TEXTURE_3D, 0, GL_RG8, grid.size.x, grid.size.y, grid.size.z, 0, GL_RG, GL_UNSIGNED_BYTE, grid.min_max.data());
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+        return result;
+    };
+
+    // V switches the volumes, K switches empty space skipping
+    volume volumes[] =
+    {
+        load_volume("cloud", cloud_data_path, {128, 64, 64}, cloud_bbox_min, cloud_bbox_max),
+        load_volume("bunny", bunny_data_path, {64, 64, 64}, bunny_bbox_min, bunny_bbox_max),
+    };
+    int current_volume = 0;
+    bool skip_empty = true;
+
+    for (auto const & v : volumes)
+        std::cout << v.name << ": macro grid " << v.macro_size.x << "x" << v.macro_size.y << "x" << v.macro_size.z
+            << " built in " << (v.macro_build_time * 1000.f) << " ms" << std::endl;
+
     auto last_frame_start = std::chrono::high_resolution_clock::now();
 
     float time = 0.f;
@@ -271,6 +455,9 @@ int main() try
 
     bool paused = false;
 
+    float stats_time = 0.f;
+    std::size_t stats_frames = 0;
+
     bool running = true;
     while (running)
     {
@@ -292,6 +479,10 @@ int main() try
             button_down[event.key.keysym.sym] = true;
             if (event.key.keysym.sym == SDLK_SPACE)
                 paused = !paused;
+            if (event.key.keysym.sym == SDLK_v)
+                current_volume = (current_volume + 1) % std::size(volumes);
+            if (event.key.keysym.sym == SDLK_k)
+                skip_empty = !skip_empty;
             break;
         case SDL_KEYUP:
             button_down[event.key.keysym.sym] = false;
@@ -350,17 +541,50 @@ int main() try
 
         glm::vec3 light_direction = glm::normalize(glm::vec3(std::cos(time), 1.f, std::sin(time)));
 
+        volume const & v = volumes[current_volume];
+
+        glm::vec3 const voxel_size = (v.bbox_max - v.bbox_min) / glm::vec3(v.size);
+        float const step_size = 0.5f * std::min({voxel_size.x, voxel_size.y, voxel_size.z});
+        glm::vec3 const macro_scale = glm::vec3(v.size) / float(macro_cell_size);
+
         glUseProgram(program);
         glUniformMatrix4fv(view_location, 1, GL_FALSE, reinterpret_cast<float *>(&view));
         glUniformMatrix4fv(projection_location, 1, GL_FALSE, reinterpret_cast<float *>(&projection));
-        glUniform3fv(bbox_min_location, 1, reinterpret_cast<const float *>(&cloud_bbox_min));
-        glUniform3fv(bbox_max_location, 1, reinterpret_cast<const float *>(&cloud_bbox_max));
+        glUniform3fv(bbox_min_location, 1, reinterpret_cast<const float *>(&v.bbox_min));
+        glUniform3fv(bbox_max_location, 1, reinterpret_cast<const float *>(&v.bbox_max));
         glUniform3fv(camera_position_location, 1, reinterpret_cast<float *>(&camera_position));
         glUniform3fv(light_direction_location, 1, reinterpret_cast<float *>(&light_direction));
+        glUniform1i(density_texture_location, 0);
+        glUniform1i(macro_texture_location, 1);
+        glUniform3fv(macro_scale_location, 1, reinterpret_cast<const float *>(&macro_scale));
+        glUniform1i(skip_empty_location, skip_empty);
+        glUniform1f(step_size_location, step_size);
+        glUniform1f(absorption_location, 10.f);
+        glUniform3f(light_color_location, 1.f, 0.95f, 0.85f);
+        glUniform3f(ambient_light_location, 0.3f, 0.35f, 0.45f);
+
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_3D, v.texture);
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_3D, v.macro_texture);
 
         glBindVertexArray(vao);
         glDrawElements(GL_TRIANGLES, std::size(cube_indices), GL_UNSIGNED_INT, nullptr);
 
+        stats_time += dt;
+        ++stats_frames;
+        if (stats_time >= 0.5f)
+        {
+            std::ostringstream title;
+            title << "Graphics course practice 12: " << (stats_time / stats_frames * 1000.f) << " ms/frame, " << v.name
+                << ", empty space skipping " << (skip_empty ? "on" : "off")
+                << " (macro grid built in " << (v.macro_build_time * 1000.f) << " ms)";
+            SDL_SetWindowTitle(window, title.str().c_str());
+
+            stats_time = 0.f;
+            stats_frames = 0;
+        }
+
         SDL_GL_SwapWindow(window);
     }
 
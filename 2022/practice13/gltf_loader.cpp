@@ -74,6 +74,25 @@ gltf_model load_gltf(std::filesystem::path const & path)
         };
     };
 
+    auto parse_vector = [&](auto const & array)
+    {
+        return glm::vec3{
+            array[0].GetFloat(),
+            array[1].GetFloat(),
+            array[2].GetFloat(),
+        };
+    };
+
+    // POSITION accessors are required to have min and max
+    auto parse_bounds = [&](int index)
+    {
+        auto accessor = document["accessors"].GetArray()[index].GetObject();
+        return std::make_pair(
+            parse_vector(accessor["min"]),
+            parse_vector(accessor["max"])
+        );
+    };
+
     for (auto const & mesh : document["meshes"].GetArray())
     {
         auto & result_mesh = result.meshes.emplace_back();
@@ -91,6 +110,8 @@ gltf_model load_gltf(std::filesystem::path const & path)
         result_mesh.joints = parse_accessor(attributes["JOINTS_0"].GetInt());
         result_mesh.weights = parse_accessor(attributes["WEIGHTS_0"].GetInt());
 
+        std::tie(result_mesh.min, result_mesh.max) = parse_bounds(attributes["POSITION"].GetInt());
+
         auto const & material = document["materials"].GetArray()[primitives[0]["material"].GetInt()];
 
         result_mesh.material.two_sided = material.HasMember("doubleSided") && material["doubleSided"].GetBool();
@@ -79,6 +79,9 @@ struct gltf_model
         accessor texcoord;
         accessor joints;
         accessor weights;
+
+        glm::vec3 min;
+        glm::vec3 max;
     };
 
     std::vector<char> buffer;
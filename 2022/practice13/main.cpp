@@ -16,6 +16,8 @@
 #include <random>
 #include <map>
 #include <cmath>
+#include <sstream>
+#include <limits>
 
 #define GLM_FORCE_SWIZZLE
 #define GLM_ENABLE_EXPERIMENTAL
@@ -29,6 +31,9 @@
 
 #include "gltf_loader.hpp"
 #include "stb_image.h"
+#include "aabb.hpp"
+#include "frustum.hpp"
+#include "intersect.hpp"
 
 std::string to_string(std::string_view str)
 {
@@ -200,6 +205,9 @@ int main() try
         GLuint vao;
         gltf_model::accessor indices;
         gltf_model::material material;
+        // Bounding box of the positions, in model space
+        glm::vec3 min;
+        glm::vec3 max;
     };
 
     auto setup_attribute = [](int index, gltf_model::accessor const & accessor, bool integer = false)
@@ -228,6 +236,8 @@ int main() try
         setup_attribute(4, mesh.weights);
 
         result.material = mesh.material;
+        result.min = mesh.min;
+        result.max = mesh.max;
     }
 
     std::map<std::string, GLuint> textures;
@@ -269,6 +279,10 @@ int main() try
 
     bool paused = false;
 
+    float stats_time = 0.f;
+    std::size_t stats_frames = 0;
+    std::size_t stats_culled = 0;
+
     bool running = true;
     while (running)
     {
@@ -351,6 +365,23 @@ int main() try
         glUniformMatrix4fv(projection_location, 1, GL_FALSE, reinterpret_cast<float *>(&projection));
         glUniform3fv(light_direction_location, 1, reinterpret_cast<float *>(&light_direction));
 
+        frustum view_frustum(projection * view);
+
+        // World-space box around the model-space one
+        auto world_bounds = [&](mesh const & mesh)
+        {
+            glm::vec3 min(std::numeric_limits<float>::infinity());
+            glm::vec3 max(-std::numeric_limits<float>::infinity());
+            for (int i = 0; i < 8; ++i)
+            {
+                glm::vec3 corner{(i & 1) ? mesh.max.x : mesh.min.x, (i & 2) ? mesh.max.y : mesh.min.y, (i & 4) ? mesh.max.z : mesh.min.z};
+                glm::vec3 p = glm::vec3(model * glm::vec4(corner, 1.f));
+                min = glm::min(min, p);
+                max = glm::max(max, p);
+            }
+            return aabb(min, max);
+        };
+
         auto draw_meshes = [&](bool transparent)
         {
             for (auto const & mesh : meshes)
@@ -358,6 +389,12 @@ int main() try
                 if (mesh.material.transparent != transparent)
                     continue;
 
+                if (!intersect(view_frustum, world_bounds(mesh)))
+                {
+                    ++stats_culled;
+                    continue;
+                }
+
                 if (mesh.material.two_sided)
                     glDisable(GL_CULL_FACE);
                 else
@@ -391,6 +428,20 @@ int main() try
         draw_meshes(true);
         glDepthMask(GL_TRUE);
 
+        stats_time += dt;
+        ++stats_frames;
+        if (stats_time >= 0.5f)
+        {
+            std::ostringstream title;
+            title << "Graphics course practice 13: " << (stats_time / stats_frames * 1000.f) << " ms/frame, culled "
+                << (float(stats_culled) / stats_frames) << "/" << meshes.size() << " meshes";
+            SDL_SetWindowTitle(window, title.str().c_str());
+
+            stats_time = 0.f;
+            stats_frames = 0;
+            stats_culled = 0;
+        }
+
         SDL_GL_SwapWindow(window);
     }
 
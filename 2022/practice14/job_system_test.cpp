@@ -0,0 +1,147 @@
+// Throws from jobs of a job_system and checks that wait rethrows the first exception
+// only after every job of the counter has finished, that the counter can be used again
+// afterwards, and that an exception from a nested job reaches the outermost wait.
+// Runs on a single thread and with workers; a job that is never counted as done hangs it
+
+#include <atomic>
+#include <cstdlib>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+
+#include "job_system.hpp"
+
+int run(job_system & jobs)
+{
+    int failures = 0;
+
+    auto expect_throw = [&](char const * name, auto const & function, std::string const & message)
+    {
+        try
+        {
+            function();
+            std::cerr << "  " << name << ": nothing thrown" << std::endl;
+            ++failures;
+        }
+        catch (std::runtime_error const & e)
+        {
+            if (std::string(e.what()).find(message) != 0)
+            {
+                std::cerr << "  " << name << ": caught \"" << e.what() << "\" instead of \"" << message << "\"" << std::endl;
+                ++failures;
+            }
+        }
+    };
+
+    auto expect = [&](char const * name, bool condition)
+    {
+        if (!condition)
+        {
+            std::cerr << "  " << name << std::endl;
+            ++failures;
+        }
+    };
+
+    // One of many jobs throws
+    {
+        job_counter counter;
+        std::atomic<int> finished{0};
+
+        expect_throw("one job throws", [&]
+        {
+            for (int i = 0; i < 100; ++i)
+                jobs.run(counter, [&, i]
+                {
+                    if (i == 37)
+                        throw std::runtime_error("job 37");
+                    ++finished;
+                });
+            jobs.wait(counter);
+        }, "job 37");
+
+        expect("the other jobs finished before wait threw", finished == 99);
+
+        // The exception is cleared, so the counter works as new
+        for (int i = 0; i < 10; ++i)
+            jobs.run(counter, [&]{ ++finished; });
+        jobs.wait(counter);
+        expect("the counter is reusable", finished == 109);
+    }
+
+    // Several jobs throw, only one exception comes out
+    {
+        job_counter counter;
+        expect_throw("several jobs throw", [&]
+        {
+            for (int i = 0; i < 50; ++i)
+                jobs.run(counter, [i]{ if (i % 10 == 0) throw std::runtime_error("job " + std::to_string(i)); });
+            jobs.wait(counter);
+        }, "job ");
+        expect("the counter is done", counter.done() && !counter.error);
+    }
+
+    // A child job throws: the parent's wait rethrows it inside the parent job,
+    // which passes it on to the parent's counter
+    {
+        job_counter counter;
+        std::atomic<int> children{0};
+
+        expect_throw("nested job throws", [&]
+        {
+            for (int i = 0; i < 4; ++i)
+                jobs.run(counter, [&, i]
+                {
+                    job_counter child_counter;
+                    for (int k = 0; k < 8; ++k)
+                        jobs.run(child_counter, [&, i, k]
+                        {
+                            ++children;
+                            if (i == 2 && k == 5)
+                                throw std::runtime_error("child 2.5");
+                        });
+                    jobs.wait(child_counter);
+                });
+            jobs.wait(counter);
+        }, "child 2.5");
+
+        expect("all children ran", children == 32);
+    }
+
+    // parallel_for waits for all the ranges before rethrowing
+    {
+        std::atomic<std::size_t> covered{0};
+        expect_throw("parallel_for throws", [&]
+        {
+            jobs.parallel_for(1000, 10, [&](std::size_t begin, std::size_t end)
+            {
+                covered += end - begin;
+                if (begin == 500)
+                    throw std::runtime_error("range 500");
+            });
+        }, "range 500");
+
+        expect("parallel_for covered every item", covered == 1000);
+    }
+
+    return failures;
+}
+
+int main() try
+{
+    int failures = 0;
+
+    job_system single(0);
+    failures += run(single);
+
+    job_system workers(3);
+    failures += run(workers);
+
+    std::cout << "1 and 4 threads, " << failures << " failures" << std::endl;
+
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+catch (std::exception const & e)
+{
+    std::cerr << e.what() << std::endl;
+    return EXIT_FAILURE;
+}
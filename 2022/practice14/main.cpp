@@ -16,6 +16,8 @@
 #include <random>
 #include <map>
 #include <cmath>
+#include <sstream>
+#include <cstring>
 
 #include <glm/vec3.hpp>
 #include <glm/mat4x4.hpp>
@@ -30,6 +32,8 @@
 #include "aabb.hpp"
 #include "frustum.hpp"
 #include "intersect.hpp"
+#include "occlusion_buffer.hpp"
+#include "job_system.hpp"
 
 std::string to_string(std::string_view str)
 {
@@ -213,6 +217,56 @@ int main() try
         vaos.push_back(vao);
     }
 
+    // Instances are drawn with the most detailed mesh, while
+    // the nearest of them rasterize the coarsest one as occluders
+    auto const & draw_mesh = input_model.meshes.front();
+    auto const & occluder_mesh = input_model.meshes.back();
+
+    std::vector<glm::vec3> occluder_positions(occluder_mesh.position.count);
+    std::memcpy(occluder_positions.data(), input_model.buffer.data() + occluder_mesh.position.view.offset, occluder_positions.size() * sizeof(glm::vec3));
+
+    std::vector<std::uint32_t> occluder_indices(occluder_mesh.indices.count);
+    for (std::size_t i = 0; i < occluder_indices.size(); ++i)
+    {
+        char const * index = input_model.buffer.data() + occluder_mesh.indices.view.offset;
+        if (occluder_mesh.indices.type == GL_UNSIGNED_SHORT)
+            occluder_indices[i] = reinterpret_cast<std::uint16_t const *>(index)[i];
+        else
+            occluder_indices[i] = reinterpret_cast<std::uint32_t const *>(index)[i];
+    }
+
+    std::vector<glm::vec3> instance_positions;
+    for (int x = -10; x <= 10; ++x)
+        for (int z = 0; z < 30; ++z)
+            instance_positions.push_back({x * 1.5f, 0.f, -z * 1.5f});
+
+    occlusion_buffer occlusion(320, 192);
+    std::size_t const max_occluders = 32;
+    float const max_occluder_distance = 10.f;
+    bool occlusion_culling = true;
+
+    std::vector<occluder> occluders;
+    std::vector<std::size_t> occluder_candidates;
+
+    job_system jobs;
+
+    enum class visibility : std::uint8_t
+    {
+        visible,
+        frustum_culled,
+        occlusion_culled,
+    };
+
+    std::vector<visibility> instance_visibility(instance_positions.size());
+
+    float stats_time = 0.f;
+    float stats_occlusion_time = 0.f;
+    float stats_culling_time = 0.f;
+    std::size_t stats_frames = 0;
+    std::size_t stats_drawn = 0;
+    std::size_t stats_frustum_culled = 0;
+    std::size_t stats_occlusion_culled = 0;
+
     GLuint texture;
     {
         auto const & mesh = input_model.meshes[0];
@@ -265,6 +319,8 @@ int main() try
             button_down[event.key.keysym.sym] = true;
             if (event.key.keysym.sym == SDLK_SPACE)
                 paused = !paused;
+            if (event.key.keysym.sym == SDLK_o)
+                occlusion_culling = !occlusion_culling;
             break;
         case SDL_KEYUP:
             button_down[event.key.keysym.sym] = false;
@@ -316,8 +372,6 @@ int main() try
         float near = 0.1f;
         float far = 100.f;
 
-        glm::mat4 model(1.f);
-
         glm::mat4 view(1.f);
         view = glm::rotate(view, camera_rotation, {0.f, 1.f, 0.f});
         view = glm::translate(view, -camera_position);
@@ -329,17 +383,102 @@ int main() try
         glm::vec3 light_direction = glm::normalize(glm::vec3(1.f, 2.f, 3.f));
 
         glUseProgram(program);
-        glUniformMatrix4fv(model_location, 1, GL_FALSE, reinterpret_cast<float *>(&model));
         glUniformMatrix4fv(view_location, 1, GL_FALSE, reinterpret_cast<float *>(&view));
         glUniformMatrix4fv(projection_location, 1, GL_FALSE, reinterpret_cast<float *>(&projection));
         glUniform3fv(light_direction_location, 1, reinterpret_cast<float *>(&light_direction));
 
         glBindTexture(GL_TEXTURE_2D, texture);
 
+        if (occlusion_culling)
+        {
+            auto occlusion_start = std::chrono::high_resolution_clock::now();
+
+            occluder_candidates.clear();
+            for (std::size_t i = 0; i < instance_positions.size(); ++i)
+                if (glm::distance(instance_positions[i], camera_position) < max_occluder_distance)
+                    occluder_candidates.push_back(i);
+
+            std::sort(occluder_candidates.begin(), occluder_candidates.end(), [&](std::size_t i, std::size_t j)
+            {
+                return glm::distance(instance_positions[i], camera_position) < glm::distance(instance_positions[j], camera_position);
+            });
+            if (occluder_candidates.size() > max_occluders)
+                occluder_candidates.resize(max_occluders);
+
+            occluders.clear();
+            for (auto i : occluder_candidates)
+                occluders.push_back({occluder_positions, occluder_indices, projection * view * glm::translate(glm::mat4(1.f), instance_positions[i])});
+
+            occlusion.render(occluders, jobs);
+
+            stats_occlusion_time += std::chrono::duration_cast<std::chrono::duration<float>>(std::chrono::high_resolution_clock::now() - occlusion_start).count();
+        }
+
+        frustum view_frustum(projection * view);
+
+        auto culling_start = std::chrono::high_resolution_clock::now();
+
+        // Instances are tested in parallel; only the draw calls stay on this thread
+        jobs.parallel_for(instance_positions.size(), 64, [&](std::size_t begin, std::size_t end)
+        {
+            for (std::size_t i = begin; i < end; ++i)
+            {
+                glm::vec3 const & position = instance_positions[i];
+
+                // Instances are only translated, so the mesh bounds just move along
+                if (!intersect(view_frustum, aabb(draw_mesh.min + position, draw_mesh.max + position)))
+                    instance_visibility[i] = visibility::frustum_culled;
+                else if (occlusion_culling && !occlusion.is_visible(draw_mesh.min, draw_mesh.max, projection * view * glm::translate(glm::mat4(1.f), position)))
+                    instance_visibility[i] = visibility::occlusion_culled;
+                else
+                    instance_visibility[i] = visibility::visible;
+            }
+        });
+
+        stats_culling_time += std::chrono::duration_cast<std::chrono::duration<float>>(std::chrono::high_resolution_clock::now() - culling_start).count();
+
+        glBindVertexArray(vaos[0]);
+        for (std::size_t i = 0; i < instance_positions.size(); ++i)
+        {
+            if (instance_visibility[i] == visibility::frustum_culled)
+            {
+                ++stats_frustum_culled;
+                continue;
+            }
+
+            if (instance_visibility[i] == visibility::occlusion_culled)
+            {
+                ++stats_occlusion_culled;
+                continue;
+            }
+
+            glm::mat4 model = glm::translate(glm::mat4(1.f), instance_positions[i]);
+            glUniformMatrix4fv(model_location, 1, GL_FALSE, reinterpret_cast<float *>(&model));
+            glDrawElements(GL_TRIANGLES, draw_mesh.indices.count, draw_mesh.indices.type, reinterpret_cast<void *>(draw_mesh.indices.view.offset));
+            ++stats_drawn;
+        }
+
+        stats_time += dt;
+        ++stats_frames;
+        if (stats_time >= 0.5f)
         {
-            auto const & mesh = input_model.meshes[0];
-            glBindVertexArray(vaos[0]);
-            glDrawElements(GL_TRIANGLES, mesh.indices.count, mesh.indices.type, reinterpret_cast<void *>(mesh.indices.view.offset));
+            std::ostringstream title;
+            title << "Graphics course practice 14: " << (stats_time / stats_frames * 1000.f) << " ms/frame, drawn "
+                << (stats_drawn / stats_frames) << "/" << instance_positions.size()
+                << ", frustum culled " << (stats_frustum_culled / stats_frames)
+                << ", culling " << (stats_culling_time / stats_frames * 1000.f) << " ms on " << jobs.thread_count() << " threads";
+            if (occlusion_culling)
+                title << ", occlusion culled " << (stats_occlusion_culled / stats_frames)
+                    << " in " << (stats_occlusion_time / stats_frames * 1000.f) << " ms";
+            SDL_SetWindowTitle(window, title.str().c_str());
+
+            stats_time = 0.f;
+            stats_occlusion_time = 0.f;
+            stats_culling_time = 0.f;
+            stats_frames = 0;
+            stats_drawn = 0;
+            stats_frustum_culled = 0;
+            stats_occlusion_culled = 0;
         }
 
         SDL_GL_SwapWindow(window);
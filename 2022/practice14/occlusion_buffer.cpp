@@ -0,0 +1,282 @@
+#include "occlusion_buffer.hpp"
+
+#include <glm/common.hpp>
+
+#include <algorithm>
+#include <limits>
+#include <cmath>
+#include <stdexcept>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define OCCLUSION_SSE2
+#include <emmintrin.h>
+#endif
+
+occlusion_buffer::occlusion_buffer(int width, int height)
+    : width_(width)
+    , height_(height)
+    , tiles_x_(width / tile_size)
+    , tiles_y_(height / tile_size)
+{
+    if (width <= 0 || height <= 0 || width % tile_size != 0 || height % tile_size != 0)
+        throw std::runtime_error("Occlusion buffer size must be a positive multiple of " + std::to_string(tile_size));
+
+    for (int w = width, h = height;; w = (w + 1) / 2, h = (h + 1) / 2)
+    {
+        level_sizes_.push_back({w, h});
+        levels_.emplace_back(w * h, 1.f);
+        if (w == 1 && h == 1)
+            break;
+    }
+
+    bins_.resize(tiles_x_ * tiles_y_);
+}
+
+void occlusion_buffer::setup_triangle(glm::vec4 const & v0, glm::vec4 const & v1, glm::vec4 const & v2)
+{
+    // To window coordinates: pixels and [0, 1] depth
+    auto to_window = [this](glm::vec4 const & v)
+    {
+        glm::vec3 ndc = glm::vec3(v) / v.w;
+        return glm::vec3((ndc.x * 0.5f + 0.5f) * width_, (ndc.y * 0.5f + 0.5f) * height_, ndc.z * 0.5f + 0.5f);
+    };
+
+    std::array<glm::vec3, 3> p{to_window(v0), to_window(v1), to_window(v2)};
+
+    float area = (p[1].x - p[0].x) * (p[2].y - p[0].y) - (p[1].y - p[0].y) * (p[2].x - p[0].x);
+    if (!(std::abs(area) > 0.f))
+        return;
+
+    triangle t;
+
+    // Pixels whose centers are inside the bounding box
+    glm::vec3 min = glm::min(p[0], glm::min(p[1], p[2]));
+    glm::vec3 max = glm::max(p[0], glm::max(p[1], p[2]));
+    t.x0 = std::max(0, int(std::ceil(min.x - 0.5f)));
+    t.y0 = std::max(0, int(std::ceil(min.y - 0.5f)));
+    t.x1 = std::min(width_ - 1, int(std::floor(max.x - 0.5f)));
+    t.y1 = std::min(height_ - 1, int(std::floor(max.y - 0.5f)));
+    if (t.x0 > t.x1 || t.y0 > t.y1)
+        return;
+
+    // Both windings are rasterized: occluders need not be closed or consistently oriented
+    float sign = area > 0.f ? 1.f : -1.f;
+    for (int i = 0; i < 3; ++i)
+    {
+        auto const & q0 = p[i];
+        auto const & q1 = p[(i + 1) % 3];
+        t.a[i] = -(q1.y - q0.y) * sign;
+        t.b[i] = (q1.x - q0.x) * sign;
+        t.c[i] = -(t.a[i] * q0.x + t.b[i] * q0.y);
+    }
+
+    glm::vec3 e1 = p[1] - p[0];
+    glm::vec3 e2 = p[2] - p[0];
+    t.za = (e1.z * e2.y - e2.z * e1.y) / area;
+    t.zb = (e2.z * e1.x - e1.z * e2.x) / area;
+    t.zc = p[0].z - t.za * p[0].x - t.zb * p[0].y;
+
+    std::uint32_t id = triangles_.size();
+    triangles_.push_back(t);
+
+    for (int ty = t.y0 / tile_size; ty <= t.y1 / tile_size; ++ty)
+        for (int tx = t.x0 / tile_size; tx <= t.x1 / tile_size; ++tx)
+            bins_[ty * tiles_x_ + tx].push_back(id);
+}
+
+void occlusion_buffer::rasterize_tile(int tile)
+{
+    int const tile_x0 = (tile % tiles_x_) * tile_size;
+    int const tile_y0 = (tile / tiles_x_) * tile_size;
+
+    float * depth = levels_[0].data();
+
+    for (auto id : bins_[tile])
+    {
+        triangle const & t = triangles_[id];
+
+        int x0 = std::max(t.x0, tile_x0);
+        int y0 = std::max(t.y0, tile_y0);
+        int x1 = std::min(t.x1, tile_x0 + tile_size - 1);
+        int y1 = std::min(t.y1, tile_y0 + tile_size - 1);
+
+#ifdef OCCLUSION_SSE2
+        // Whole groups of 4 pixels: the tile is a multiple of 4 wide, and pixels
+        // of the group outside the triangle's bounds are outside the triangle itself
+        x0 &= ~3;
+
+        __m128 const lane = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+        __m128 const far = _mm_set1_ps(std::numeric_limits<float>::infinity());
+        __m128 const zero = _mm_setzero_ps();
+        __m128 const a0 = _mm_set1_ps(t.a[0]), a1 = _mm_set1_ps(t.a[1]), a2 = _mm_set1_ps(t.a[2]);
+        __m128 const za = _mm_set1_ps(t.za);
+
+        for (int y = y0; y <= y1; ++y)
+        {
+            float py = y + 0.5f;
+            __m128 const r0 = _mm_set1_ps(t.b[0] * py + t.c[0]);
+            __m128 const r1 = _mm_set1_ps(t.b[1] * py + t.c[1]);
+            __m128 const r2 = _mm_set1_ps(t.b[2] * py + t.c[2]);
+            __m128 const rz = _mm_set1_ps(t.zb * py + t.zc);
+
+            float * row = depth + y * width_;
+
+            for (int x = x0; x <= x1; x += 4)
+            {
+                __m128 px = _mm_add_ps(_mm_set1_ps(float(x)), lane);
+
+                __m128 inside = _mm_and_ps(
+                    _mm_and_ps(
+                        _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(a0, px), r0), zero),
+                        _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(a1, px), r1), zero)),
+                    _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(a2, px), r2), zero));
+
+                if (_mm_movemask_ps(inside) == 0)
+                    continue;
+
+                __m128 z = _mm_add_ps(_mm_mul_ps(za, px), rz);
+                z = _mm_or_ps(_mm_and_ps(inside, z), _mm_andnot_ps(inside, far));
+
+                _mm_storeu_ps(row + x, _mm_min_ps(_mm_loadu_ps(row + x), z));
+            }
+        }
+#else
+        for (int y = y0; y <= y1; ++y)
+        {
+            float py = y + 0.5f;
+            for (int x = x0; x <= x1; ++x)
+            {
+                float px = x + 0.5f;
+
+                bool inside = true;
+                for (int i = 0; i < 3; ++i)
+                    inside &= (t.a[i] * px + t.b[i] * py + t.c[i] >= 0.f);
+
+                if (inside)
+                {
+                    float & d = depth[y * width_ + x];
+                    d = std::min(d, t.za * px + t.zb * py + t.zc);
+                }
+            }
+        }
+#endif
+    }
+}
+
+void occlusion_buffer::build_pyramid()
+{
+    for (std::size_t l = 1; l < levels_.size(); ++l)
+    {
+        auto [w, h] = level_sizes_[l];
+        auto [pw, ph] = level_sizes_[l - 1];
+        auto const & prev = levels_[l - 1];
+        auto & level = levels_[l];
+
+        for (int y = 0; y < h; ++y)
+        {
+            for (int x = 0; x < w; ++x)
+            {
+                int x0 = 2 * x, x1 = std::min(2 * x + 1, pw - 1);
+                int y0 = 2 * y, y1 = std::min(2 * y + 1, ph - 1);
+                level[y * w + x] = std::max(
+                    std::max(prev[y0 * pw + x0], prev[y0 * pw + x1]),
+                    std::max(prev[y1 * pw + x0], prev[y1 * pw + x1]));
+            }
+        }
+    }
+}
+
+void occlusion_buffer::render(std::span<occluder const> occluders, job_system & jobs)
+{
+    std::fill(levels_[0].begin(), levels_[0].end(), 1.f);
+    triangles_.clear();
+    for (auto & bin : bins_)
+        bin.clear();
+
+    for (auto const & o : occluders)
+    {
+        for (std::size_t i = 0; i + 2 < o.indices.size(); i += 3)
+        {
+            std::array<glm::vec4, 3> v;
+            for (int k = 0; k < 3; ++k)
+                v[k] = o.transform * glm::vec4(o.positions[o.indices[i + k]], 1.f);
+
+            // Clip against the near plane z = -w; the rest is handled by the screen bounds
+            std::array<glm::vec4, 4> clipped;
+            int count = 0;
+            for (int k = 0; k < 3; ++k)
+            {
+                glm::vec4 const & a = v[k];
+                glm::vec4 const & b = v[(k + 1) % 3];
+                float da = a.z + a.w;
+                float db = b.z + b.w;
+
+                if (da >= 0.f)
+                    clipped[count++] = a;
+                if ((da >= 0.f) != (db >= 0.f))
+                    clipped[count++] = a + (b - a) * (da / (da - db));
+            }
+
+            for (int k = 2; k < count; ++k)
+                setup_triangle(clipped[0], clipped[k - 1], clipped[k]);
+        }
+    }
+
+    // Tiles don't share pixels, so they are rasterized independently
+    jobs.parallel_for(bins_.size(), 1, [this](std::size_t begin, std::size_t end)
+    {
+        for (std::size_t tile = begin; tile < end; ++tile)
+            rasterize_tile(tile);
+    });
+
+    build_pyramid();
+}
+
+bool occlusion_buffer::is_visible(glm::vec3 const & min, glm::vec3 const & max, glm::mat4 const & transform) const
+{
+    static constexpr float inf = std::numeric_limits<float>::infinity();
+
+    glm::vec2 screen_min(inf), screen_max(-inf);
+    float nearest = inf;
+
+    for (int i = 0; i < 8; ++i)
+    {
+        glm::vec4 v = transform * glm::vec4(
+            (i & 1) ? max.x : min.x,
+            (i & 2) ? max.y : min.y,
+            (i & 4) ? max.z : min.z,
+            1.f);
+
+        // Crosses the near plane: can't be occluded by anything
+        if (v.z < -v.w)
+            return true;
+
+        glm::vec3 ndc = glm::vec3(v) / v.w;
+        screen_min = glm::min(screen_min, glm::vec2(ndc));
+        screen_max = glm::max(screen_max, glm::vec2(ndc));
+        nearest = std::min(nearest, ndc.z * 0.5f + 0.5f);
+    }
+
+    int x0 = std::max(0, int(std::floor((screen_min.x * 0.5f + 0.5f) * width_)));
+    int y0 = std::max(0, int(std::floor((screen_min.y * 0.5f + 0.5f) * height_)));
+    int x1 = std::min(width_ - 1, int(std::floor((screen_max.x * 0.5f + 0.5f) * width_)));
+    int y1 = std::min(height_ - 1, int(std::floor((screen_max.y * 0.5f + 0.5f) * height_)));
+
+    if (x0 > x1 || y0 > y1)
+        return false;
+
+    // The coarsest level where the rectangle still covers at most 2x2 texels
+    std::size_t level = 0;
+    while (level + 1 < levels_.size() && ((x1 >> level) - (x0 >> level) > 1 || (y1 >> level) - (y0 >> level) > 1))
+        ++level;
+
+    int const w = level_sizes_[level].first;
+    auto const & depth = levels_[level];
+
+    for (int y = y0 >> level; y <= (y1 >> level); ++y)
+        for (int x = x0 >> level; x <= (x1 >> level); ++x)
+            if (nearest <= depth[y * w + x])
+                return true;
+
+    return false;
+}
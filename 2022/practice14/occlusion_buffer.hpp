@@ -0,0 +1,73 @@
+#pragma once
+
+#include "job_system.hpp"
+
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+#include <glm/mat4x4.hpp>
+
+#include <span>
+#include <array>
+#include <utility>
+#include <vector>
+#include <cstdint>
+
+struct occluder
+{
+    std::span<glm::vec3 const> positions;
+    std::span<std::uint32_t const> indices;
+    // Model to clip space
+    glm::mat4 transform;
+};
+
+// Low-resolution CPU depth buffer for occlusion culling: occluder triangles
+// are rasterized into it in screen tiles on several threads, and objects are
+// tested against the max-depth pyramid built on top of it.
+// Depth is window-space z in [0, 1], as for the default glDepthRange
+struct occlusion_buffer
+{
+    static constexpr int tile_size = 32;
+
+    // Both dimensions must be multiples of tile_size
+    occlusion_buffer(int width, int height);
+
+    int width() const { return width_; }
+    int height() const { return height_; }
+
+    // Clears the buffer, rasterizes the occluders tile by tile as jobs and rebuilds the pyramid
+    void render(std::span<occluder const> occluders, job_system & jobs);
+
+    // Whether any part of the box (in model space) may be visible: false only if
+    // its projection lies completely off screen or behind the occluders
+    bool is_visible(glm::vec3 const & min, glm::vec3 const & max, glm::mat4 const & transform) const;
+
+    // Depth of a pixel of the full-resolution level
+    float depth(int x, int y) const { return levels_[0][y * width_ + x]; }
+
+private:
+    struct triangle
+    {
+        // Edge functions a * x + b * y + c, non-negative inside
+        std::array<float, 3> a, b, c;
+        // Depth plane
+        float za, zb, zc;
+        int x0, y0, x1, y1;
+    };
+
+    int width_;
+    int height_;
+    int tiles_x_;
+    int tiles_y_;
+
+    // levels_[0] is the depth buffer itself, each next level
+    // holds the farthest depth of 2x2 texels of the previous one
+    std::vector<std::vector<float>> levels_;
+    std::vector<std::pair<int, int>> level_sizes_;
+
+    std::vector<triangle> triangles_;
+    std::vector<std::vector<std::uint32_t>> bins_;
+
+    void setup_triangle(glm::vec4 const & v0, glm::vec4 const & v1, glm::vec4 const & v2);
+    void rasterize_tile(int tile);
+    void build_pyramid();
+};
@@ -0,0 +1,125 @@
+// Renders a wall with a square hole into an occlusion_buffer, with the camera at the
+// origin looking down -z, and checks the visibility of boxes placed behind the wall,
+// beside it, in front of it, behind the hole, across the near plane and off screen.
+// Every layout is checked on a single thread and with workers rasterizing the tiles
+
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <glm/vec3.hpp>
+#include <glm/mat4x4.hpp>
+#include <glm/ext/matrix_clip_space.hpp>
+#include <glm/ext/scalar_constants.hpp>
+
+#include "job_system.hpp"
+#include "occlusion_buffer.hpp"
+
+// The wall spans [-5, 5] in x and y at z = -10, with a hole of [-1, 1] in the middle
+std::vector<glm::vec3> wall_positions;
+std::vector<std::uint32_t> wall_indices;
+
+void add_quad(float x0, float y0, float x1, float y1, float z)
+{
+    std::uint32_t const base = wall_positions.size();
+    wall_positions.insert(wall_positions.end(), {{x0, y0, z}, {x1, y0, z}, {x1, y1, z}, {x0, y1, z}});
+    wall_indices.insert(wall_indices.end(), {base, base + 1, base + 2, base, base + 2, base + 3});
+}
+
+struct test_case
+{
+    char const * name;
+    glm::vec3 min;
+    glm::vec3 max;
+    bool visible;
+};
+
+glm::vec3 const half(0.5f);
+
+std::vector<test_case> const cases
+{
+    {"behind the wall", glm::vec3(3.5f, 3.5f, -20.f) - half, glm::vec3(3.5f, 3.5f, -20.f) + half, false},
+    {"behind the wall, below the hole", glm::vec3(0.f, -3.5f, -20.f) - half, glm::vec3(0.f, -3.5f, -20.f) + half, false},
+    {"beside the wall", glm::vec3(15.f, 0.f, -20.f) - half, glm::vec3(15.f, 0.f, -20.f) + half, true},
+    {"in front of the wall", glm::vec3(3.5f, 3.5f, -5.f) - half, glm::vec3(3.5f, 3.5f, -5.f) + half, true},
+    {"partly in front of the wall", glm::vec3(3.f, 3.f, -15.f), glm::vec3(4.f, 4.f, -8.f), true},
+    {"seen through the hole", glm::vec3(0.f, 0.f, -20.f) - half, glm::vec3(0.f, 0.f, -20.f) + half, true},
+    {"crossing the near plane", glm::vec3(3.f, 3.f, -20.f), glm::vec3(4.f, 4.f, 0.5f), true},
+    {"off screen", glm::vec3(100.f, 0.f, -20.f) - half, glm::vec3(100.f, 0.f, -20.f) + half, false},
+    {"off screen, behind the wall's plane", glm::vec3(0.f, 100.f, -30.f) - half, glm::vec3(0.f, 100.f, -30.f) + half, false},
+};
+
+int run(job_system & jobs)
+{
+    int const width = 320, height = 192;
+    glm::mat4 const view_projection = glm::perspective(glm::pi<float>() / 2.f, float(width) / height, 0.1f, 100.f);
+
+    occlusion_buffer buffer(width, height);
+    int failures = 0;
+
+    auto check = [&](char const * name, bool actual, bool expected)
+    {
+        if (actual != expected)
+        {
+            std::cerr << "  " << name << ": expected " << (expected ? "visible" : "occluded") << ", got " << (actual ? "visible" : "occluded") << std::endl;
+            ++failures;
+        }
+    };
+
+    // Without occluders only the boxes off screen are rejected
+    buffer.render({}, jobs);
+    for (auto const & c : cases)
+        check(c.name, buffer.is_visible(c.min, c.max, view_projection), c.min.x < 50.f && c.min.y < 50.f);
+
+    occluder const wall{wall_positions, wall_indices, view_projection};
+    buffer.render({&wall, 1}, jobs);
+
+    for (auto const & c : cases)
+        check(c.name, buffer.is_visible(c.min, c.max, view_projection), c.visible);
+
+    // The wall's depth where it is, the far plane in the hole and around the wall
+    float const wall_depth = 0.5f * (glm::vec4(view_projection * glm::vec4(0.f, 0.f, -10.f, 1.f)).z / 10.f) + 0.5f;
+    int const hole_x = width / 2, hole_y = height / 2;
+    int const wall_x = width / 2 + width / 8, wall_y = height / 2 + height / 8;
+
+    if (std::abs(buffer.depth(wall_x, wall_y) - wall_depth) > 1e-4f)
+    {
+        std::cerr << "  wall depth " << buffer.depth(wall_x, wall_y) << ", expected " << wall_depth << std::endl;
+        ++failures;
+    }
+    if (buffer.depth(hole_x, hole_y) != 1.f || buffer.depth(0, 0) != 1.f)
+    {
+        std::cerr << "  depth in the hole " << buffer.depth(hole_x, hole_y) << ", in the corner " << buffer.depth(0, 0) << ", expected 1" << std::endl;
+        ++failures;
+    }
+
+    return failures;
+}
+
+int main() try
+{
+    add_quad(-5.f, -5.f, -1.f, 5.f, -10.f);
+    add_quad(1.f, -5.f, 5.f, 5.f, -10.f);
+    add_quad(-1.f, -5.f, 1.f, -1.f, -10.f);
+    add_quad(-1.f, 1.f, 1.f, 5.f, -10.f);
+
+    int failures = 0;
+
+    job_system single(0);
+    failures += run(single);
+
+    job_system workers(3);
+    failures += run(workers);
+
+    std::cout << cases.size() << " layouts on 1 and 4 threads, " << failures << " failures" << std::endl;
+
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+catch (std::exception const & e)
+{
+    std::cerr << e.what() << std::endl;
+    return EXIT_FAILURE;
+}
@@ -29,7 +29,9 @@
 #include <glm/ext/scalar_constants.hpp>
 #include <glm/gtx/string_cast.hpp>
 
-#include "obj_parser.hpp"
+#include "mesh_cache.hpp"
+#include "vertex_packing.hpp"
+#include "meshlets.hpp"
 
 std::string to_string(std::string_view str)
 {
@@ -53,17 +55,32 @@ uniform mat4 model;
 uniform mat4 view;
 uniform mat4 projection;
 
+uniform vec3 position_offset;
+uniform vec3 position_scale;
+uniform bool octahedral_normals;
+
 layout (location = 0) in vec3 in_position;
 layout (location = 1) in vec3 in_normal;
 
 out vec3 position;
 out vec3 normal;
 
+vec3 decode_normal(vec3 n)
+{
+    if (!octahedral_normals)
+        return n;
+
+    vec3 v = vec3(n.xy, 1.0 - abs(n.x) - abs(n.y));
+    if (v.z < 0.0)
+        v.xy = (1.0 - abs(v.yx)) * mix(vec2(-1.0), vec2(1.0), greaterThanEqual(v.xy, vec2(0.0)));
+    return v;
+}
+
 void main()
 {
-    position = (model * vec4(in_position, 1.0)).xyz;
+    position = (model * vec4(position_offset + position_scale * in_position, 1.0)).xyz;
     gl_Position = projection * view * vec4(position, 1.0);
-    normal = normalize(mat3(model) * in_normal);
+    normal = normalize(mat3(model) * decode_normal(in_normal));
 }
 )";
 
@@ -194,10 +211,23 @@ try
     GLuint albedo_location = glGetUniformLocation(program, "albedo");
     GLuint sun_direction_location = glGetUniformLocation(program, "sun_direction");
     GLuint sun_color_location = glGetUniformLocation(program, "sun_color");
+    GLuint position_offset_location = glGetUniformLocation(program, "position_offset");
+    GLuint position_scale_location = glGetUniformLocation(program, "position_scale");
+    GLuint octahedral_normals_location = glGetUniformLocation(program, "octahedral_normals");
 
     std::string project_root = PROJECT_ROOT;
     std::string scene_path = project_root + "/buddha.obj";
-    obj_data scene = parse_obj(scene_path);
+    cached_mesh scene = load_mesh_cached(scene_path, true);
+
+    if (scene.optimization)
+    {
+        auto const & [before, after] = *scene.optimization;
+        std::cout << "Vertex cache optimization: ACMR " << before.acmr << " -> " << after.acmr
+            << ", ATVR " << before.atvr << " -> " << after.atvr << std::endl;
+    }
+
+    // 12 bytes per vertex instead of 32
+    packed_vertices scene_vertices = pack_vertices(scene.vertices, {position_format::unorm16, normal_format::octahedral16, texcoord_format::none});
 
     GLuint scene_vao, scene_vbo, scene_ebo;
     glGenVertexArrays(1, &scene_vao);
@@ -205,16 +235,33 @@ try
 
     glGenBuffers(1, &scene_vbo);
     glBindBuffer(GL_ARRAY_BUFFER, scene_vbo);
-    glBufferData(GL_ARRAY_BUFFER, scene.vertices.size() * sizeof(scene.vertices[0]), scene.vertices.data(), GL_STATIC_DRAW);
+    glBufferData(GL_ARRAY_BUFFER, scene_vertices.data.size(), scene_vertices.data.data(), GL_STATIC_DRAW);
 
+    // Allocated once: the meshlet culling overwrites a prefix of it every frame,
+    // the visible indices never being more than all of them
     glGenBuffers(1, &scene_ebo);
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, scene_ebo);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, scene.indices.size() * sizeof(scene.indices[0]), scene.indices.data(), GL_STATIC_DRAW);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, scene.indices.size_bytes(), scene.indices.data(), GL_DYNAMIC_DRAW);
+
+    setup_vertex_attributes(scene_vertices, 0, 1, 2);
+
+    std::vector<glm::vec3> scene_positions;
+    scene_positions.reserve(scene.vertices.size());
+    for (auto const & v : scene.vertices)
+        scene_positions.push_back({v.position[0], v.position[1], v.position[2]});
+
+    meshlet_data scene_meshlets = build_meshlets(scene_positions, scene.indices);
+    std::cout << "Meshlets: " << scene_meshlets.meshlets.size() << " for " << scene.indices.size() / 3 << " triangles" << std::endl;
 
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(obj_data::vertex), (void *)(0));
-    glEnableVertexAttribArray(1);
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(obj_data::vertex), (void *)(12));
+    // Indices of the meshlets surviving culling, written to scene_ebo every frame
+    std::vector<std::uint32_t> visible_indices;
+    bool meshlet_culling = true;
+
+    float stats_time = 0.f;
+    std::size_t stats_frames = 0;
+    std::size_t stats_triangles = 0;
+    std::size_t stats_frustum_culled = 0;
+    std::size_t stats_backface_culled = 0;
 
     auto last_frame_start = std::chrono::high_resolution_clock::now();
 
@@ -245,6 +292,15 @@ try
                 break;
             case SDL_KEYDOWN:
                 button_down[event.key.keysym.sym] = true;
+                if (event.key.keysym.sym == SDLK_m)
+                {
+                    meshlet_culling = !meshlet_culling;
+                    if (!meshlet_culling)
+                    {
+                        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, scene_ebo);
+                        glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, 0, scene.indices.size_bytes(), scene.indices.data());
+                    }
+                }
                 break;
             case SDL_KEYUP:
                 button_down[event.key.keysym.sym] = false;
@@ -303,9 +359,46 @@ try
         glUniform3f(albedo_location, .8f, .7f, .6f);
         glUniform3f(sun_color_location, 1.f, 1.f, 1.f);
         glUniform3fv(sun_direction_location, 1, reinterpret_cast<float *>(&sun_direction));
+        glUniform3fv(position_offset_location, 1, reinterpret_cast<float *>(&scene_vertices.position_offset));
+        glUniform3fv(position_scale_location, 1, reinterpret_cast<float *>(&scene_vertices.position_scale));
+        glUniform1i(octahedral_normals_location, scene_vertices.format.normal == normal_format::octahedral16);
 
         glBindVertexArray(scene_vao);
-        glDrawElements(GL_TRIANGLES, scene.indices.size(), GL_UNSIGNED_INT, nullptr);
+
+        if (meshlet_culling)
+        {
+            auto culling = cull_meshlets(scene_meshlets, model, projection * view, camera_position, visible_indices);
+            stats_triangles += culling.triangles;
+            stats_frustum_culled += culling.frustum_culled;
+            stats_backface_culled += culling.backface_culled;
+
+            glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, 0, visible_indices.size() * sizeof(visible_indices[0]), visible_indices.data());
+            glDrawElements(GL_TRIANGLES, visible_indices.size(), GL_UNSIGNED_INT, nullptr);
+        }
+        else
+        {
+            stats_triangles += scene.indices.size() / 3;
+            glDrawElements(GL_TRIANGLES, scene.indices.size(), GL_UNSIGNED_INT, nullptr);
+        }
+
+        stats_time += dt;
+        ++stats_frames;
+        if (stats_time >= 0.5f)
+        {
+            std::ostringstream title;
+            title << "Graphics course practice 8: " << (stats_time / stats_frames * 1000.f) << " ms/frame, triangles "
+                << (stats_triangles / stats_frames) << "/" << (scene.indices.size() / 3);
+            if (meshlet_culling)
+                title << ", meshlets culled by frustum " << (stats_frustum_culled / stats_frames)
+                    << ", backfacing " << (stats_backface_culled / stats_frames) << "/" << scene_meshlets.meshlets.size();
+            SDL_SetWindowTitle(window, title.str().c_str());
+
+            stats_time = 0.f;
+            stats_frames = 0;
+            stats_triangles = 0;
+            stats_frustum_culled = 0;
+            stats_backface_culled = 0;
+        }
 
         SDL_GL_SwapWindow(window);
     }
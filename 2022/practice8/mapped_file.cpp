@@ -0,0 +1,156 @@
+#include "mapped_file.hpp"
+
+#include <stdexcept>
+#include <utility>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#ifdef _WIN32
+
+mapped_file::mapped_file(std::filesystem::path const & path)
+{
+    HANDLE file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+        throw std::runtime_error("Failed to open " + path.string());
+    file_ = file;
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size))
+    {
+        reset();
+        throw std::runtime_error("Failed to get size of " + path.string());
+    }
+    size_ = static_cast<std::size_t>(size.QuadPart);
+
+    // Empty files cannot be mapped, but are perfectly valid to read
+    if (size_ == 0)
+        return;
+
+    HANDLE mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!mapping)
+    {
+        reset();
+        throw std::runtime_error("Failed to map " + path.string());
+    }
+    mapping_ = mapping;
+
+    data_ = static_cast<char const *>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+    if (!data_)
+    {
+        reset();
+        throw std::runtime_error("Failed to map " + path.string());
+    }
+}
+
+void mapped_file::reset()
+{
+    if (data_)
+        UnmapViewOfFile(data_);
+    if (mapping_)
+        CloseHandle(mapping_);
+    if (file_)
+        CloseHandle(file_);
+
+    data_ = nullptr;
+    size_ = 0;
+    mapping_ = nullptr;
+    file_ = nullptr;
+}
+
+mapped_file::mapped_file(mapped_file && other) noexcept
+    : data_(std::exchange(other.data_, nullptr))
+    , size_(std::exchange(other.size_, 0))
+    , file_(std::exchange(other.file_, nullptr))
+    , mapping_(std::exchange(other.mapping_, nullptr))
+{}
+
+mapped_file & mapped_file::operator = (mapped_file && other) noexcept
+{
+    if (this != &other)
+    {
+        reset();
+        data_ = std::exchange(other.data_, nullptr);
+        size_ = std::exchange(other.size_, 0);
+        file_ = std::exchange(other.file_, nullptr);
+        mapping_ = std::exchange(other.mapping_, nullptr);
+    }
+    return *this;
+}
+
+#else
+
+mapped_file::mapped_file(std::filesystem::path const & path)
+{
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        throw std::runtime_error("Failed to open " + path.string());
+
+    struct stat st;
+    if (::fstat(fd, &st) != 0)
+    {
+        ::close(fd);
+        throw std::runtime_error("Failed to get size of " + path.string());
+    }
+    size_ = static_cast<std::size_t>(st.st_size);
+
+    // Empty files cannot be mapped, but are perfectly valid to read
+    if (size_ == 0)
+    {
+        ::close(fd);
+        return;
+    }
+
+    void * data = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+
+    if (data == MAP_FAILED)
+    {
+        size_ = 0;
+        throw std::runtime_error("Failed to map " + path.string());
+    }
+
+    ::madvise(data, size_, MADV_SEQUENTIAL);
+
+    data_ = static_cast<char const *>(data);
+}
+
+void mapped_file::reset()
+{
+    if (data_)
+        ::munmap(const_cast<char *>(data_), size_);
+
+    data_ = nullptr;
+    size_ = 0;
+}
+
+mapped_file::mapped_file(mapped_file && other) noexcept
+    : data_(std::exchange(other.data_, nullptr))
+    , size_(std::exchange(other.size_, 0))
+{}
+
+mapped_file & mapped_file::operator = (mapped_file && other) noexcept
+{
+    if (this != &other)
+    {
+        reset();
+        data_ = std::exchange(other.data_, nullptr);
+        size_ = std::exchange(other.size_, 0);
+    }
+    return *this;
+}
+
+#endif
+
+mapped_file::~mapped_file()
+{
+    reset();
+}
@@ -0,0 +1,197 @@
+#include "mesh_cache.hpp"
+
+#include <fstream>
+#include <cstring>
+#include <cstdint>
+#include <exception>
+
+namespace
+{
+
+    constexpr char cache_magic[8] = {'O', 'B', 'J', 'C', 'A', 'C', 'H', 'E'};
+    constexpr std::uint32_t cache_version = 2;
+
+    constexpr std::uint32_t optimized_flag = 1;
+
+    // Blobs are aligned for direct upload and SIMD access
+    constexpr std::uint64_t blob_alignment = 64;
+
+    struct cache_header
+    {
+        char magic[8];
+        std::uint32_t version;
+        std::uint32_t vertex_size;
+        std::uint32_t flags;
+        std::uint32_t reserved;
+
+        std::uint64_t source_size;
+        std::int64_t source_mtime;
+
+        std::uint64_t vertex_count;
+        std::uint64_t vertex_offset;
+        std::uint64_t index_count;
+        std::uint64_t index_offset;
+    };
+
+    std::uint64_t align(std::uint64_t offset)
+    {
+        return (offset + blob_alignment - 1) / blob_alignment * blob_alignment;
+    }
+
+    struct source_stamp
+    {
+        std::uint64_t size;
+        std::int64_t mtime;
+        std::uint32_t flags;
+    };
+
+    source_stamp stamp(std::filesystem::path const & path, std::uint32_t flags)
+    {
+        return {
+            std::filesystem::file_size(path),
+            static_cast<std::int64_t>(std::filesystem::last_write_time(path).time_since_epoch().count()),
+            flags,
+        };
+    }
+
+    std::optional<mapped_file> map_cache(std::filesystem::path const & cache_path, source_stamp const & source)
+    {
+        std::error_code ec;
+        if (!std::filesystem::is_regular_file(cache_path, ec))
+            return std::nullopt;
+
+        std::optional<mapped_file> file;
+        try
+        {
+            file.emplace(cache_path);
+        }
+        catch (std::exception const &)
+        {
+            return std::nullopt;
+        }
+
+        if (file->size() < sizeof(cache_header))
+            return std::nullopt;
+
+        cache_header header;
+        std::memcpy(&header, file->data(), sizeof(header));
+
+        if (std::memcmp(header.magic, cache_magic, sizeof(cache_magic)) != 0
+            || header.version != cache_version
+            || header.vertex_size != sizeof(obj_data::vertex)
+            || header.flags != source.flags
+            || header.source_size != source.size
+            || header.source_mtime != source.mtime)
+            return std::nullopt;
+
+        if (header.vertex_offset % blob_alignment != 0
+            || header.index_offset % blob_alignment != 0
+            || header.vertex_offset + header.vertex_count * sizeof(obj_data::vertex) > file->size()
+            || header.index_offset + header.index_count * sizeof(std::uint32_t) > file->size())
+            return std::nullopt;
+
+        return file;
+    }
+
+    bool write_cache(std::filesystem::path const & cache_path, source_stamp const & source, obj_data const & data)
+    {
+        cache_header header;
+        std::memcpy(header.magic, cache_magic, sizeof(cache_magic));
+        header.version = cache_version;
+        header.vertex_size = sizeof(obj_data::vertex);
+        header.flags = source.flags;
+        header.reserved = 0;
+        header.source_size = source.size;
+        header.source_mtime = source.mtime;
+        header.vertex_count = data.vertices.size();
+        header.vertex_offset = align(sizeof(header));
+        header.index_count = data.indices.size();
+        header.index_offset = align(header.vertex_offset + header.vertex_count * sizeof(obj_data::vertex));
+
+        // Write to a temporary file first, so that a crashed or concurrent
+        // writer never leaves a truncated cache behind
+        auto temp_path = cache_path;
+        temp_path += ".tmp";
+
+        bool failed = false;
+
+        {
+            std::ofstream os(temp_path, std::ios::binary | std::ios::trunc);
+            if (!os)
+                return false;
+
+            char const padding[blob_alignment] = {};
+
+            auto pad_to = [&](std::uint64_t offset){
+                os.write(padding, offset - static_cast<std::uint64_t>(os.tellp()));
+            };
+
+            os.write(reinterpret_cast<char const *>(&header), sizeof(header));
+            pad_to(header.vertex_offset);
+            os.write(reinterpret_cast<char const *>(data.vertices.data()), data.vertices.size() * sizeof(obj_data::vertex));
+            pad_to(header.index_offset);
+            os.write(reinterpret_cast<char const *>(data.indices.data()), data.indices.size() * sizeof(std::uint32_t));
+
+            if (!os)
+                failed = true;
+        }
+
+        std::error_code ec;
+        if (!failed)
+            std::filesystem::rename(temp_path, cache_path, ec);
+
+        if (failed || ec)
+        {
+            std::filesystem::remove(temp_path, ec);
+            return false;
+        }
+
+        return true;
+    }
+
+    void point_into_file(cached_mesh & mesh)
+    {
+        cache_header header;
+        std::memcpy(&header, mesh.file->data(), sizeof(header));
+
+        mesh.vertices = {reinterpret_cast<obj_data::vertex const *>(mesh.file->data() + header.vertex_offset), header.vertex_count};
+        mesh.indices = {reinterpret_cast<std::uint32_t const *>(mesh.file->data() + header.index_offset), header.index_count};
+    }
+
+}
+
+cached_mesh load_mesh_cached(std::filesystem::path const & path, bool optimize)
+{
+    auto cache_path = path;
+    cache_path += ".cache";
+
+    auto const source = stamp(path, optimize ? optimized_flag : 0);
+
+    cached_mesh result;
+
+    result.file = map_cache(cache_path, source);
+    if (result.file)
+    {
+        point_into_file(result);
+        return result;
+    }
+
+    obj_data data = parse_obj(path, obj_parse_mode::parallel);
+
+    if (optimize)
+        result.optimization = optimize_mesh(data.vertices, data.indices);
+
+    if (write_cache(cache_path, source, data))
+        result.file = map_cache(cache_path, source);
+
+    if (result.file)
+        point_into_file(result);
+    else
+    {
+        result.data = std::move(data);
+        result.vertices = result.data.vertices;
+        result.indices = result.data.indices;
+    }
+
+    return result;
+}
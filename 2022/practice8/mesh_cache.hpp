@@ -0,0 +1,29 @@
+#pragma once
+
+#include "obj_parser.hpp"
+#include "mapped_file.hpp"
+#include "mesh_optimizer.hpp"
+
+#include <span>
+#include <optional>
+
+struct cached_mesh
+{
+    // Ready to be passed to glBufferData as is
+    std::span<obj_data::vertex const> vertices;
+    std::span<std::uint32_t const> indices;
+
+    // Storage the spans point into: the mapped cache file,
+    // or the parsed OBJ data if the cache couldn't be written
+    std::optional<mapped_file> file;
+    obj_data data;
+
+    // Set if the cache was just rebuilt with optimization enabled
+    std::optional<mesh_optimization_report> optimization;
+};
+
+// Loads the mesh from a binary cache stored next to the OBJ file (<path>.cache).
+// The cache is rebuilt whenever it is missing, malformed or was created
+// from an OBJ file of a different size or modification time, or with a different
+// optimize flag; with optimize set, the cached mesh goes through optimize_mesh
+cached_mesh load_mesh_cached(std::filesystem::path const & path, bool optimize = false);
@@ -0,0 +1,193 @@
+#include "mesh_optimizer.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+vertex_cache_stats analyze_vertex_cache(std::span<std::uint32_t const> indices, std::size_t vertex_count, std::size_t cache_size)
+{
+    // A vertex is in the FIFO cache iff it was loaded during the last cache_size misses
+    std::vector<std::size_t> loaded_at(vertex_count, 0);
+    std::vector<bool> used(vertex_count, false);
+
+    std::size_t misses = 0;
+    std::size_t used_count = 0;
+
+    for (auto index : indices)
+    {
+        if (!used[index])
+        {
+            used[index] = true;
+            ++used_count;
+        }
+
+        if (loaded_at[index] == 0 || misses + 1 - loaded_at[index] > cache_size)
+            loaded_at[index] = ++misses;
+    }
+
+    std::size_t const triangle_count = indices.size() / 3;
+
+    return {
+        triangle_count > 0 ? float(misses) / triangle_count : 0.f,
+        used_count > 0 ? float(misses) / used_count : 0.f,
+    };
+}
+
+namespace
+{
+
+    constexpr std::size_t max_cache_size = 32;
+
+    float vertex_score(int cache_position, std::uint32_t remaining_triangles)
+    {
+        if (remaining_triangles == 0)
+            return -1.f;
+
+        float score = 0.f;
+
+        if (cache_position >= 0)
+        {
+            // The last triangle's vertices get a fixed score, so that
+            // the next triangle doesn't just reuse the same edge
+            if (cache_position < 3)
+                score = 0.75f;
+            else
+                score = std::pow(1.f - float(cache_position - 3) / (max_cache_size - 3), 1.5f);
+        }
+
+        // Prefer vertices with few triangles left to get rid of them early
+        score += 2.f / std::sqrt(float(remaining_triangles));
+
+        return score;
+    }
+
+}
+
+void optimize_vertex_cache(std::span<std::uint32_t> indices, std::size_t vertex_count)
+{
+    std::size_t const triangle_count = indices.size() / 3;
+
+    // Triangles adjacent to each vertex; the first remaining[v] of them are not emitted yet
+    std::vector<std::uint32_t> remaining(vertex_count, 0);
+    for (auto index : indices)
+        ++remaining[index];
+
+    std::vector<std::uint32_t> offsets(vertex_count + 1, 0);
+    for (std::size_t v = 0; v < vertex_count; ++v)
+        offsets[v + 1] = offsets[v] + remaining[v];
+
+    std::vector<std::uint32_t> adjacency(indices.size());
+    {
+        std::vector<std::uint32_t> fill(offsets.begin(), offsets.end() - 1);
+        for (std::size_t i = 0; i < indices.size(); ++i)
+            adjacency[fill[indices[i]]++] = i / 3;
+    }
+
+    std::vector<int> cache_position(vertex_count, -1);
+    std::vector<float> score(vertex_count);
+    for (std::size_t v = 0; v < vertex_count; ++v)
+        score[v] = vertex_score(-1, remaining[v]);
+
+    std::vector<bool> emitted(triangle_count, false);
+
+    std::vector<std::uint32_t> result;
+    result.reserve(indices.size());
+
+    std::vector<std::uint32_t> cache;
+    std::vector<std::uint32_t> new_cache;
+
+    std::size_t next_unemitted = 0;
+    std::size_t best = triangle_count;
+
+    for (std::size_t emitted_count = 0; emitted_count < triangle_count; ++emitted_count)
+    {
+        // Nothing adjacent to the cache: start over from the first triangle left
+        if (best == triangle_count)
+        {
+            while (emitted[next_unemitted])
+                ++next_unemitted;
+            best = next_unemitted;
+        }
+
+        emitted[best] = true;
+
+        std::uint32_t const * triangle = indices.data() + 3 * best;
+
+        new_cache.assign(triangle, triangle + 3);
+
+        for (int i = 0; i < 3; ++i)
+        {
+            std::uint32_t v = triangle[i];
+            result.push_back(v);
+
+            auto begin = adjacency.begin() + offsets[v];
+            auto end = begin + remaining[v];
+            std::iter_swap(std::find(begin, end, best), end - 1);
+            --remaining[v];
+        }
+
+        for (auto v : cache)
+            if (v != triangle[0] && v != triangle[1] && v != triangle[2])
+                new_cache.push_back(v);
+
+        // Vertices pushed out of the cache lose their cache score
+        for (std::size_t i = max_cache_size; i < new_cache.size(); ++i)
+        {
+            cache_position[new_cache[i]] = -1;
+            score[new_cache[i]] = vertex_score(-1, remaining[new_cache[i]]);
+        }
+
+        if (new_cache.size() > max_cache_size)
+            new_cache.resize(max_cache_size);
+
+        for (std::size_t i = 0; i < new_cache.size(); ++i)
+        {
+            cache_position[new_cache[i]] = i;
+            score[new_cache[i]] = vertex_score(i, remaining[new_cache[i]]);
+        }
+
+        std::swap(cache, new_cache);
+
+        // The next triangle is the best one touching the cache
+        best = triangle_count;
+        float best_score = -std::numeric_limits<float>::infinity();
+
+        for (auto v : cache)
+        {
+            for (std::size_t i = offsets[v]; i < offsets[v] + remaining[v]; ++i)
+            {
+                std::uint32_t t = adjacency[i];
+                std::uint32_t const * tv = indices.data() + 3 * t;
+                float s = score[tv[0]] + score[tv[1]] + score[tv[2]];
+                if (s > best_score)
+                {
+                    best_score = s;
+                    best = t;
+                }
+            }
+        }
+    }
+
+    std::copy(result.begin(), result.end(), indices.begin());
+}
+
+std::vector<std::uint32_t> optimize_vertex_fetch(std::span<std::uint32_t> indices, std::size_t vertex_count)
+{
+    static constexpr std::uint32_t unused = std::numeric_limits<std::uint32_t>::max();
+
+    std::vector<std::uint32_t> remap(vertex_count, unused);
+    std::uint32_t next = 0;
+
+    for (auto & index : indices)
+    {
+        if (remap[index] == unused)
+            remap[index] = next++;
+        index = remap[index];
+    }
+
+    for (auto & r : remap)
+        if (r == unused)
+            r = next++;
+
+    return remap;
+}
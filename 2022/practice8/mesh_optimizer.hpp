@@ -0,0 +1,54 @@
+#pragma once
+
+#include <span>
+#include <vector>
+#include <cstdint>
+
+struct vertex_cache_stats
+{
+    // Average cache miss ratio: vertex shader invocations per triangle, 0.5 at best for large meshes
+    float acmr;
+    // Average transform to vertex ratio: vertex shader invocations per vertex, 1 at best
+    float atvr;
+};
+
+// Simulates a FIFO post-transform vertex cache of the given size on the triangle list
+vertex_cache_stats analyze_vertex_cache(std::span<std::uint32_t const> indices, std::size_t vertex_count, std::size_t cache_size = 16);
+
+// Reorders triangles for post-transform vertex cache locality
+// using Tom Forsyth's linear-speed vertex cache optimisation
+void optimize_vertex_cache(std::span<std::uint32_t> indices, std::size_t vertex_count);
+
+// Renumbers vertices in the order of their first use by the triangle list,
+// so that vertex fetch walks the vertex buffer almost sequentially.
+// Returns the new index of every old vertex; unreferenced vertices go last
+std::vector<std::uint32_t> optimize_vertex_fetch(std::span<std::uint32_t> indices, std::size_t vertex_count);
+
+template <typename Vertex>
+void remap_vertices(std::vector<Vertex> & vertices, std::vector<std::uint32_t> const & remap)
+{
+    std::vector<Vertex> result(vertices.size());
+    for (std::size_t i = 0; i < vertices.size(); ++i)
+        result[remap[i]] = vertices[i];
+    vertices = std::move(result);
+}
+
+struct mesh_optimization_report
+{
+    vertex_cache_stats before;
+    vertex_cache_stats after;
+};
+
+// Reorders triangles and then vertices; the rendered mesh stays the same
+template <typename Vertex>
+mesh_optimization_report optimize_mesh(std::vector<Vertex> & vertices, std::vector<std::uint32_t> & indices)
+{
+    mesh_optimization_report report;
+    report.before = analyze_vertex_cache(indices, vertices.size());
+
+    optimize_vertex_cache(indices, vertices.size());
+    remap_vertices(vertices, optimize_vertex_fetch(indices, vertices.size()));
+
+    report.after = analyze_vertex_cache(indices, vertices.size());
+    return report;
+}
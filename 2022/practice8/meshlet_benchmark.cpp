@@ -0,0 +1,266 @@
+// Builds meshlets for a noisy icosphere of 1.3M triangles (about the size of buddha.obj),
+// for buddha.obj itself if it is there, and for any OBJ files given as arguments, then
+// culls them from a few cameras and prints the triangles saved and the time taken.
+// Checks that every triangle is in exactly one meshlet, and that no triangle which is
+// front-facing and not completely outside the frustum is culled
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <iostream>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+#include <glm/mat4x4.hpp>
+#include <glm/geometric.hpp>
+#include <glm/ext/matrix_transform.hpp>
+#include <glm/ext/matrix_clip_space.hpp>
+#include <glm/ext/scalar_constants.hpp>
+
+#include "obj_parser.hpp"
+#include "meshlets.hpp"
+
+struct mesh
+{
+    std::string name;
+    std::vector<glm::vec3> positions;
+    std::vector<std::uint32_t> indices;
+};
+
+// Subdivided icosahedron with the vertices pushed in and out by a sum of sines,
+// so that the normals vary like those of a scanned model
+mesh noisy_icosphere(int subdivisions)
+{
+    float const t = (1.f + std::sqrt(5.f)) / 2.f;
+
+    mesh result;
+    result.name = "noisy icosphere";
+    result.positions = {
+        {-1.f, t, 0.f}, {1.f, t, 0.f}, {-1.f, -t, 0.f}, {1.f, -t, 0.f},
+        {0.f, -1.f, t}, {0.f, 1.f, t}, {0.f, -1.f, -t}, {0.f, 1.f, -t},
+        {t, 0.f, -1.f}, {t, 0.f, 1.f}, {-t, 0.f, -1.f}, {-t, 0.f, 1.f},
+    };
+    result.indices = {
+        0, 11, 5, 0, 5, 1, 0, 1, 7, 0, 7, 10, 0, 10, 11,
+        1, 5, 9, 5, 11, 4, 11, 10, 2, 10, 7, 6, 7, 1, 8,
+        3, 9, 4, 3, 4, 2, 3, 2, 6, 3, 6, 8, 3, 8, 9,
+        4, 9, 5, 2, 4, 11, 6, 2, 10, 8, 6, 7, 9, 8, 1,
+    };
+
+    for (int s = 0; s < subdivisions; ++s)
+    {
+        std::unordered_map<std::uint64_t, std::uint32_t> midpoints;
+        auto midpoint = [&](std::uint32_t a, std::uint32_t b)
+        {
+            std::uint64_t const key = (std::uint64_t(std::min(a, b)) << 32) | std::max(a, b);
+            auto [it, inserted] = midpoints.emplace(key, std::uint32_t(result.positions.size()));
+            if (inserted)
+                result.positions.push_back((result.positions[a] + result.positions[b]) / 2.f);
+            return it->second;
+        };
+
+        std::vector<std::uint32_t> indices;
+        indices.reserve(result.indices.size() * 4);
+        for (std::size_t i = 0; i < result.indices.size(); i += 3)
+        {
+            std::uint32_t const a = result.indices[i], b = result.indices[i + 1], c = result.indices[i + 2];
+            std::uint32_t const ab = midpoint(a, b), bc = midpoint(b, c), ca = midpoint(c, a);
+            indices.insert(indices.end(), {a, ab, ca, b, bc, ab, c, ca, bc, ab, bc, ca});
+        }
+        result.indices = std::move(indices);
+    }
+
+    for (auto & p : result.positions)
+    {
+        glm::vec3 const n = glm::normalize(p);
+        float const noise = 0.03f * std::sin(40.f * n.x) * std::sin(37.f * n.y) + 0.01f * std::sin(150.f * n.z + 90.f * n.x);
+        p = n * (1.f + noise);
+    }
+
+    return result;
+}
+
+mesh load_obj(std::filesystem::path const & path)
+{
+    obj_data data = parse_obj(path);
+
+    mesh result;
+    result.name = path.filename().string();
+    for (auto const & v : data.vertices)
+        result.positions.push_back({v.position[0], v.position[1], v.position[2]});
+    result.indices = std::move(data.indices);
+    return result;
+}
+
+template <typename Function>
+double time_ms(Function const & function)
+{
+    auto const start = std::chrono::steady_clock::now();
+    function();
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Rotated so that the smallest index is first, which keeps the winding
+std::uint64_t triangle_key(std::uint32_t a, std::uint32_t b, std::uint32_t c)
+{
+    while (a > b || a > c)
+        std::tie(a, b, c) = std::tuple(b, c, a);
+    return (std::uint64_t(a) << 42) | (std::uint64_t(b) << 21) | c;
+}
+
+bool run(mesh const & m)
+{
+    if (m.positions.size() >= (std::size_t(1) << 21))
+        throw std::runtime_error(m.name + " has too many vertices");
+
+    std::size_t const triangle_count = m.indices.size() / 3;
+
+    meshlet_data meshlets;
+    double const build_ms = time_ms([&]{ meshlets = build_meshlets(m.positions, m.indices); });
+
+    std::cout << m.name << ": " << triangle_count << " triangles, " << meshlets.meshlets.size() << " meshlets averaging "
+        << double(meshlets.vertices.size()) / meshlets.meshlets.size() << " vertices and "
+        << double(triangle_count) / meshlets.meshlets.size() << " triangles, built in " << build_ms << " ms" << std::endl;
+
+    bool ok = true;
+
+    std::unordered_map<std::uint64_t, int> meshlet_triangles;
+    for (auto const & ml : meshlets.meshlets)
+        for (std::uint32_t i = 0; i < ml.triangle_count; ++i)
+        {
+            auto vertex = [&](int j){ return meshlets.vertices[ml.vertex_offset + meshlets.triangles[(ml.triangle_offset + i) * 3 + j]]; };
+            ++meshlet_triangles[triangle_key(vertex(0), vertex(1), vertex(2))];
+        }
+    for (std::size_t t = 0; t < triangle_count; ++t)
+    {
+        auto it = meshlet_triangles.find(triangle_key(m.indices[t * 3], m.indices[t * 3 + 1], m.indices[t * 3 + 2]));
+        if (it == meshlet_triangles.end() || it->second != 1)
+        {
+            std::cerr << "  triangle " << t << " is not in exactly one meshlet" << std::endl;
+            ok = false;
+            break;
+        }
+    }
+
+    glm::vec3 min(std::numeric_limits<float>::infinity()), max(-std::numeric_limits<float>::infinity());
+    for (auto const & p : m.positions)
+    {
+        min = glm::min(min, p);
+        max = glm::max(max, p);
+    }
+    glm::vec3 const center = (min + max) / 2.f;
+    float const size = glm::length(max - min) / 2.f;
+
+    struct view
+    {
+        char const * name;
+        glm::vec3 eye;
+        glm::vec3 target;
+    };
+
+    // Four cameras seeing the whole object, and one close to the surface looking along it
+    std::vector<view> views;
+    for (int i = 0; i < 4; ++i)
+    {
+        float const angle = glm::pi<float>() / 2.f * i + 0.3f;
+        views.push_back({"whole", center + 2.5f * size * glm::vec3(std::sin(angle), 0.3f, std::cos(angle)), center});
+    }
+    views.push_back({"close-up", center + glm::vec3(0.f, 0.f, 1.05f * (max.z - center.z)), center + glm::vec3(size, 0.f, max.z - center.z)});
+
+    glm::mat4 const model(1.f);
+    glm::mat4 const projection = glm::perspective(glm::pi<float>() / 3.f, 16.f / 9.f, 0.01f * size, 100.f * size);
+
+    std::vector<std::uint32_t> visible;
+    for (auto const & v : views)
+    {
+        glm::mat4 const view_projection = projection * glm::lookAt(v.eye, v.target, glm::vec3(0.f, 1.f, 0.f));
+
+        meshlet_culling_stats stats;
+        int const repeats = 10;
+        double const cull_ms = time_ms([&]
+        {
+            for (int r = 0; r < repeats; ++r)
+                stats = cull_meshlets(meshlets, model, view_projection, v.eye, visible);
+        }) / repeats;
+
+        std::cout << "  " << v.name << " view: " << (100.0 * (triangle_count - stats.triangles) / triangle_count) << "% of triangles culled, meshlets culled by frustum "
+            << stats.frustum_culled << ", backfacing " << stats.backface_culled << ", in " << cull_ms << " ms" << std::endl;
+
+        std::unordered_set<std::uint64_t> drawn;
+        for (std::size_t i = 0; i < visible.size(); i += 3)
+            drawn.insert(triangle_key(visible[i], visible[i + 1], visible[i + 2]));
+
+        // Clip space is -w <= x, y, z <= w
+        auto outside = [&](glm::vec3 const & a, glm::vec3 const & b, glm::vec3 const & c)
+        {
+            glm::vec4 const ca = view_projection * glm::vec4(a, 1.f), cb = view_projection * glm::vec4(b, 1.f), cc = view_projection * glm::vec4(c, 1.f);
+            for (int i = 0; i < 3; ++i)
+            {
+                if (ca[i] < -ca.w && cb[i] < -cb.w && cc[i] < -cc.w)
+                    return true;
+                if (ca[i] > ca.w && cb[i] > cb.w && cc[i] > cc.w)
+                    return true;
+            }
+            return false;
+        };
+
+        std::size_t wrongly_culled = 0;
+        for (std::size_t t = 0; t < triangle_count; ++t)
+        {
+            std::uint32_t const i0 = m.indices[t * 3], i1 = m.indices[t * 3 + 1], i2 = m.indices[t * 3 + 2];
+            if (drawn.contains(triangle_key(i0, i1, i2)))
+                continue;
+
+            glm::vec3 const a = m.positions[i0], b = m.positions[i1], c = m.positions[i2];
+            glm::vec3 const normal = glm::cross(b - a, c - a);
+            if (glm::length(normal) == 0.f)
+                continue;
+
+            // A little slack for triangles seen exactly edge-on
+            bool const front_facing = glm::dot(glm::normalize(normal), glm::normalize(v.eye - a)) > 1e-3f;
+            if (front_facing && !outside(a, b, c))
+                ++wrongly_culled;
+        }
+
+        if (wrongly_culled > 0)
+        {
+            std::cerr << "  " << wrongly_culled << " visible front-facing triangles culled" << std::endl;
+            ok = false;
+        }
+    }
+
+    return ok;
+}
+
+int main(int argc, char ** argv) try
+{
+    std::vector<mesh> meshes;
+    meshes.push_back(noisy_icosphere(8));
+
+    std::filesystem::path const buddha = std::string(PROJECT_ROOT) + "/buddha.obj";
+    if (std::filesystem::exists(buddha))
+        meshes.push_back(load_obj(buddha));
+    for (int i = 1; i < argc; ++i)
+        meshes.push_back(load_obj(argv[i]));
+
+    bool ok = true;
+    for (auto const & m : meshes)
+        ok = run(m) && ok;
+
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+catch (std::exception const & e)
+{
+    std::cerr << e.what() << std::endl;
+    return EXIT_FAILURE;
+}
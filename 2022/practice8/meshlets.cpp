@@ -0,0 +1,274 @@
+#include "meshlets.hpp"
+
+#include <glm/vec4.hpp>
+#include <glm/geometric.hpp>
+#include <glm/common.hpp>
+#include <glm/matrix.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <limits>
+
+namespace
+{
+
+    constexpr std::uint8_t no_local_index = 0xff;
+
+    void compute_bounds(meshlet & m, std::span<glm::vec3 const> positions, meshlet_data const & data)
+    {
+        m.min = glm::vec3(std::numeric_limits<float>::infinity());
+        m.max = -m.min;
+
+        for (std::uint32_t i = 0; i < m.vertex_count; ++i)
+        {
+            auto const & p = positions[data.vertices[m.vertex_offset + i]];
+            m.min = glm::min(m.min, p);
+            m.max = glm::max(m.max, p);
+        }
+
+        m.center = (m.min + m.max) * 0.5f;
+        m.radius = 0.f;
+        for (std::uint32_t i = 0; i < m.vertex_count; ++i)
+            m.radius = std::max(m.radius, glm::distance(m.center, positions[data.vertices[m.vertex_offset + i]]));
+
+        std::vector<std::pair<glm::vec3, glm::vec3>> planes;
+        planes.reserve(m.triangle_count);
+
+        glm::vec3 normal_sum(0.f);
+        for (std::uint32_t t = 0; t < m.triangle_count; ++t)
+        {
+            std::array<glm::vec3, 3> v;
+            for (int k = 0; k < 3; ++k)
+                v[k] = positions[data.vertices[m.vertex_offset + data.triangles[(m.triangle_offset + t) * 3 + k]]];
+
+            glm::vec3 n = glm::cross(v[1] - v[0], v[2] - v[0]);
+            float length = glm::length(n);
+            if (length == 0.f)
+                continue;
+
+            n /= length;
+            planes.push_back({v[0], n});
+            normal_sum += n;
+        }
+
+        // Degenerate cone, never culled
+        m.cone_apex = m.center;
+        m.cone_axis = glm::vec3(0.f);
+        m.cone_cutoff = 2.f;
+
+        float const sum_length = glm::length(normal_sum);
+        if (planes.empty() || sum_length == 0.f)
+            return;
+
+        glm::vec3 const axis = normal_sum / sum_length;
+
+        float min_dot = 1.f;
+        for (auto const & [p, n] : planes)
+            min_dot = std::min(min_dot, glm::dot(n, axis));
+
+        // Normals spread over a hemisphere or more, or close to it: the
+        // cone would hardly ever cull anything and the apex would be far away
+        if (min_dot <= 0.1f)
+            return;
+
+        // Move the apex back along the axis until it is behind every triangle plane:
+        // then a point which sees the apex from inside the backfacing cone sees
+        // the back of every triangle
+        float max_t = 0.f;
+        for (auto const & [p, n] : planes)
+            max_t = std::max(max_t, glm::dot(m.center - p, n) / glm::dot(axis, n));
+
+        m.cone_apex = m.center - axis * max_t;
+        m.cone_axis = axis;
+        m.cone_cutoff = std::sqrt(1.f - min_dot * min_dot);
+    }
+
+}
+
+meshlet_data build_meshlets(std::span<glm::vec3 const> positions, std::span<std::uint32_t const> indices)
+{
+    std::size_t const vertex_count = positions.size();
+    std::size_t const triangle_count = indices.size() / 3;
+
+    // Vertex to triangles adjacency
+    std::vector<std::uint32_t> adjacency_offsets(vertex_count + 1, 0);
+    for (auto index : indices)
+        ++adjacency_offsets[index + 1];
+    for (std::size_t v = 0; v < vertex_count; ++v)
+        adjacency_offsets[v + 1] += adjacency_offsets[v];
+
+    std::vector<std::uint32_t> adjacency(indices.size());
+    {
+        std::vector<std::uint32_t> fill(adjacency_offsets.begin(), adjacency_offsets.end() - 1);
+        for (std::size_t i = 0; i < indices.size(); ++i)
+            adjacency[fill[indices[i]]++] = i / 3;
+    }
+
+    meshlet_data result;
+    result.meshlets.reserve(triangle_count / max_meshlet_triangles + 1);
+    result.vertices.reserve(triangle_count);
+    result.triangles.reserve(triangle_count * 3);
+
+    std::vector<bool> emitted(triangle_count, false);
+    std::vector<std::uint8_t> local_index(vertex_count, no_local_index);
+
+    meshlet current{};
+    glm::vec3 centroid_sum(0.f);
+
+    auto new_vertices = [&](std::uint32_t t)
+    {
+        int count = 0;
+        for (int k = 0; k < 3; ++k)
+            count += (local_index[indices[t * 3 + k]] == no_local_index);
+        return count;
+    };
+
+    auto add_triangle = [&](std::uint32_t t)
+    {
+        for (int k = 0; k < 3; ++k)
+        {
+            std::uint32_t const v = indices[t * 3 + k];
+            if (local_index[v] == no_local_index)
+            {
+                local_index[v] = current.vertex_count++;
+                result.vertices.push_back(v);
+            }
+            result.triangles.push_back(local_index[v]);
+            centroid_sum += positions[v];
+        }
+        ++current.triangle_count;
+        emitted[t] = true;
+    };
+
+    auto flush = [&]
+    {
+        if (current.triangle_count == 0)
+            return;
+
+        for (std::uint32_t i = 0; i < current.vertex_count; ++i)
+            local_index[result.vertices[current.vertex_offset + i]] = no_local_index;
+
+        compute_bounds(current, positions, result);
+        result.meshlets.push_back(current);
+
+        current = {};
+        current.vertex_offset = result.vertices.size();
+        current.triangle_offset = result.triangles.size() / 3;
+        centroid_sum = glm::vec3(0.f);
+    };
+
+    // Seeds are taken in index order, which after optimize_mesh is already spatially coherent
+    std::size_t seed = 0;
+
+    while (true)
+    {
+        std::uint32_t best = -1;
+
+        if (current.triangle_count > 0 && current.triangle_count < max_meshlet_triangles)
+        {
+            // Among unused triangles sharing a vertex with the meshlet, prefer the ones
+            // adding the fewest vertices, then the ones closest to the meshlet centroid
+            glm::vec3 const centroid = centroid_sum / float(current.triangle_count * 3);
+            int best_new = 4;
+            float best_distance = std::numeric_limits<float>::infinity();
+
+            for (std::uint32_t i = 0; i < current.vertex_count && best_new > 0; ++i)
+            {
+                std::uint32_t const v = result.vertices[current.vertex_offset + i];
+                for (std::uint32_t a = adjacency_offsets[v]; a < adjacency_offsets[v + 1]; ++a)
+                {
+                    std::uint32_t const t = adjacency[a];
+                    if (emitted[t])
+                        continue;
+
+                    int const added = new_vertices(t);
+                    if (current.vertex_count + added > max_meshlet_vertices || added > best_new)
+                        continue;
+
+                    glm::vec3 const c = (positions[indices[t * 3]] + positions[indices[t * 3 + 1]] + positions[indices[t * 3 + 2]]) / 3.f;
+                    float const distance = glm::distance(c, centroid);
+
+                    if (added < best_new || distance < best_distance)
+                    {
+                        best = t;
+                        best_new = added;
+                        best_distance = distance;
+                    }
+                }
+            }
+        }
+
+        if (best == std::uint32_t(-1))
+        {
+            flush();
+
+            while (seed < triangle_count && emitted[seed])
+                ++seed;
+            if (seed == triangle_count)
+                break;
+
+            best = seed;
+        }
+
+        add_triangle(best);
+    }
+
+    return result;
+}
+
+meshlet_culling_stats cull_meshlets(meshlet_data const & data, glm::mat4 const & model, glm::mat4 const & view_projection, glm::vec3 const & camera_position, std::vector<std::uint32_t> & indices)
+{
+    indices.clear();
+
+    // Both tests are done in model space: the planes come from the full matrix,
+    // and the camera is moved into model space for the cone test
+    glm::mat4 const model_view_projection = view_projection * model;
+    glm::vec3 const model_camera_position = glm::vec3(glm::inverse(model) * glm::vec4(camera_position, 1.f));
+
+    // Frustum planes from the rows of the matrix, normalized so that
+    // plane values are distances comparable with sphere radii
+    std::array<glm::vec4, 6> planes;
+    for (int i = 0; i < 3; ++i)
+    {
+        glm::vec4 row(model_view_projection[0][i], model_view_projection[1][i], model_view_projection[2][i], model_view_projection[3][i]);
+        glm::vec4 w(model_view_projection[0][3], model_view_projection[1][3], model_view_projection[2][3], model_view_projection[3][3]);
+        planes[2 * i] = w + row;
+        planes[2 * i + 1] = w - row;
+    }
+    for (auto & p : planes)
+        p /= glm::length(glm::vec3(p));
+
+    meshlet_culling_stats stats;
+    stats.meshlets = data.meshlets.size();
+
+    for (auto const & m : data.meshlets)
+    {
+        bool outside = false;
+        for (auto const & p : planes)
+            if (glm::dot(glm::vec3(p), m.center) + p.w < -m.radius)
+            {
+                outside = true;
+                break;
+            }
+
+        if (outside)
+        {
+            ++stats.frustum_culled;
+            continue;
+        }
+
+        if (glm::dot(glm::normalize(m.cone_apex - model_camera_position), m.cone_axis) >= m.cone_cutoff)
+        {
+            ++stats.backface_culled;
+            continue;
+        }
+
+        for (std::uint32_t i = 0; i < m.triangle_count * 3; ++i)
+            indices.push_back(data.vertices[m.vertex_offset + data.triangles[m.triangle_offset * 3 + i]]);
+
+        stats.triangles += m.triangle_count;
+    }
+
+    return stats;
+}
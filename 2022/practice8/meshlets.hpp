@@ -0,0 +1,61 @@
+#pragma once
+
+#include <glm/vec3.hpp>
+#include <glm/mat4x4.hpp>
+
+#include <span>
+#include <vector>
+#include <cstdint>
+
+// Limits of typical mesh shader hardware, so that
+// local triangle indices fit in a byte
+constexpr std::size_t max_meshlet_vertices = 64;
+constexpr std::size_t max_meshlet_triangles = 124;
+
+struct meshlet
+{
+    // Ranges in meshlet_data::vertices and meshlet_data::triangles (in triangles)
+    std::uint32_t vertex_offset;
+    std::uint32_t vertex_count;
+    std::uint32_t triangle_offset;
+    std::uint32_t triangle_count;
+
+    glm::vec3 min;
+    glm::vec3 max;
+
+    glm::vec3 center;
+    float radius;
+
+    // Every triangle is backfacing when seen from a point p with
+    // dot(normalize(cone_apex - p), cone_axis) >= cone_cutoff;
+    // meshlets with normals too spread out have cone_cutoff > 1
+    glm::vec3 cone_apex;
+    glm::vec3 cone_axis;
+    float cone_cutoff;
+};
+
+struct meshlet_data
+{
+    std::vector<meshlet> meshlets;
+    // Mesh vertex indices used by the meshlets
+    std::vector<std::uint32_t> vertices;
+    // Triples of indices into the meshlet's range of vertices
+    std::vector<std::uint8_t> triangles;
+};
+
+// Greedily grows each meshlet from a seed triangle, adding the adjacent triangle which
+// brings the fewest new vertices, so that meshlets stay compact and their bounds tight
+meshlet_data build_meshlets(std::span<glm::vec3 const> positions, std::span<std::uint32_t const> indices);
+
+struct meshlet_culling_stats
+{
+    std::size_t meshlets = 0;
+    std::size_t frustum_culled = 0;
+    std::size_t backface_culled = 0;
+    std::size_t triangles = 0;
+};
+
+// Rejects meshlets whose bounding spheres are outside the frustum and meshlets
+// which are completely backfacing, and writes the mesh indices of the rest.
+// The meshlet bounds are in model space, the camera position is in world space
+meshlet_culling_stats cull_meshlets(meshlet_data const & data, glm::mat4 const & model, glm::mat4 const & view_projection, glm::vec3 const & camera_position, std::vector<std::uint32_t> & indices);
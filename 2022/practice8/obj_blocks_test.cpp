@@ -0,0 +1,77 @@
+// Parses the OBJ models of the other practices with parse_obj_blocks at several block
+// sizes, puts the blocks back together and checks that the result equals parse_obj
+// in mapped mode, and that no block exceeds the block size
+
+#include <cstdlib>
+#include <filesystem>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "obj_parser.hpp"
+
+bool operator == (obj_data::vertex const & v1, obj_data::vertex const & v2)
+{
+    return v1.position == v2.position && v1.normal == v2.normal && v1.texcoord == v2.texcoord;
+}
+
+int main() try
+{
+    std::string const project_root = PROJECT_ROOT;
+    std::filesystem::path const models[] =
+    {
+        project_root + "/../practice4/bunny_lowres.obj",
+        project_root + "/../practice5/cow.obj",
+        project_root + "/../practice7/suzanne.obj",
+    };
+    std::size_t const block_sizes[] = {3, 4, 64, 1000, 1 << 20};
+
+    int failures = 0;
+
+    for (auto const & path : models)
+    {
+        obj_data const expected = parse_obj(path, obj_parse_mode::mapped);
+
+        for (std::size_t block_size : block_sizes)
+        {
+            obj_data joined;
+            std::size_t block_count = 0;
+            std::string error;
+
+            parse_obj_blocks(path, block_size, [&](obj_block const & block)
+            {
+                ++block_count;
+                if (block.vertices.size() > block_size || block.indices.size() > block_size)
+                    error = "block " + std::to_string(block_count) + " exceeds the block size";
+                if (block.first_vertex != joined.vertices.size())
+                    error = "block " + std::to_string(block_count) + " starts at vertex " + std::to_string(block.first_vertex)
+                        + " instead of " + std::to_string(joined.vertices.size());
+
+                joined.vertices.insert(joined.vertices.end(), block.vertices.begin(), block.vertices.end());
+                joined.indices.insert(joined.indices.end(), block.indices.begin(), block.indices.end());
+            });
+
+            if (error.empty() && joined.vertices != expected.vertices)
+                error = "vertices differ";
+            if (error.empty() && joined.indices != expected.indices)
+                error = "indices differ";
+
+            if (!error.empty())
+            {
+                std::cerr << path.filename().string() << " in blocks of " << block_size << ": " << error << std::endl;
+                ++failures;
+            }
+            else
+                std::cout << path.filename().string() << " in blocks of " << block_size << ": " << block_count << " blocks, "
+                    << joined.vertices.size() << " vertices, " << joined.indices.size() << " indices" << std::endl;
+        }
+    }
+
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+catch (std::exception const & e)
+{
+    std::cerr << e.what() << std::endl;
+    return EXIT_FAILURE;
+}
@@ -1,10 +1,20 @@
 #include "obj_parser.hpp"
+#include "mapped_file.hpp"
+#include "vertex_index_map.hpp"
 
 #include <string>
+#include <string_view>
 #include <sstream>
 #include <fstream>
 #include <stdexcept>
-#include <map>
+#include <charconv>
+#include <cstring>
+#include <algorithm>
+#include <functional>
+#include <optional>
+#include <exception>
+#include <thread>
+#include <limits>
 
 namespace
 {
@@ -17,169 +27,634 @@ namespace
         return os.str();
     }
 
-}
+    // Resolves face indices (1-based or negative, i.e. relative to the end),
+    // deduplicates (position, texcoord, normal) triples and triangulates faces
+    struct obj_builder
+    {
+        std::vector<std::array<float, 3>> positions;
+        std::vector<std::array<float, 3>> normals;
+        std::vector<std::array<float, 2>> texcoords;
 
-obj_data parse_obj(std::filesystem::path const & path)
-{
-    std::ifstream is(path);
+        vertex_index_map index_map;
 
-    std::vector<std::array<float, 3>> positions;
-    std::vector<std::array<float, 3>> normals;
-    std::vector<std::array<float, 2>> texcoords;
+        std::vector<std::uint32_t> face;
 
-    std::map<std::array<std::int32_t, 3>, std::uint32_t> index_map;
+        obj_data result;
 
-    obj_data result;
+        // When set, result is handed out and cleared whenever it would
+        // grow past block_size vertices or indices
+        std::function<void(obj_block const &)> on_block;
+        std::size_t block_size = std::numeric_limits<std::size_t>::max();
+        std::size_t flushed_vertices = 0;
 
-    std::string line;
-    std::size_t line_count = 0;
+        void flush()
+        {
+            if (result.vertices.empty() && result.indices.empty())
+                return;
 
-    auto fail = [&](auto const & ... args){
-        throw std::runtime_error(to_string("Error parsing OBJ data, line ", line_count, ": ", args...));
+            on_block({result.vertices, static_cast<std::uint32_t>(flushed_vertices), result.indices});
+
+            flushed_vertices += result.vertices.size();
+            result.vertices.clear();
+            result.indices.clear();
+        }
+
+        template <typename Fail>
+        void add_corner(std::array<std::int32_t, 3> index, bool has_texcoord, bool has_normal, Fail const & fail)
+        {
+            add_corner(index, has_texcoord, has_normal, {positions.size(), texcoords.size(), normals.size()}, fail);
+        }
+
+        // counts are the numbers of positions, texcoords and normals defined
+        // before the face, i.e. the ones the face is allowed to reference
+        template <typename Fail>
+        void add_corner(std::array<std::int32_t, 3> index, bool has_texcoord, bool has_normal, std::array<std::size_t, 3> const & counts, Fail const & fail)
+        {
+            if (index[0] > 0)
+                --index[0];
+            else
+                index[0] = counts[0] + index[0];
+
+            if (has_texcoord)
+            {
+                if (index[1] > 0)
+                    --index[1];
+                else
+                    index[1] = counts[1] + index[1];
+            }
+            else
+                index[1] = -1;
+
+            if (has_normal)
+            {
+                if (index[2] > 0)
+                    --index[2];
+                else
+                    index[2] = counts[2] + index[2];
+            }
+            else
+                index[2] = -1;
+
+            if (index[0] >= counts[0])
+                fail("bad position index (", index[0], ")");
+
+            if (index[1] != -1 && index[1] >= counts[1])
+                fail("bad texcoord index (", index[1], ")");
+
+            if (index[2] != -1 && index[2] >= counts[2])
+                fail("bad normal index (", index[2], ")");
+
+            auto [vertex_index, inserted] = index_map.insert(index, flushed_vertices + result.vertices.size());
+            if (inserted)
+            {
+                auto & v = result.vertices.emplace_back();
+
+                v.position = positions[index[0]];
+
+                if (index[1] != -1)
+                    v.texcoord = texcoords[index[1]];
+                else
+                    v.texcoord = {0.f, 0.f};
+
+                if (index[2] != -1)
+                    v.normal = normals[index[2]];
+                else
+                    v.normal = {0.f, 0.f, 0.f};
+
+                if (result.vertices.size() == block_size)
+                    flush();
+            }
+
+            face.push_back(vertex_index);
+        }
+
+        void finish_face()
+        {
+            for (std::size_t i = 1; i + 1 < face.size(); ++i)
+            {
+                if (result.indices.size() + 3 > block_size)
+                    flush();
+
+                result.indices.push_back(face[0]);
+                result.indices.push_back(face[i]);
+                result.indices.push_back(face[i + 1]);
+            }
+
+            face.clear();
+        }
     };
 
-    while (std::getline(is >> std::ws, line))
+    obj_data parse_obj_stream(std::filesystem::path const & path)
     {
-        ++line_count;
+        std::ifstream is(path);
+
+        obj_builder builder;
 
-        if (line.empty()) continue;
+        std::string line;
+        std::size_t line_count = 0;
 
-        if (line[0] == '#') continue;
+        auto fail = [&](auto const & ... args){
+            throw std::runtime_error(to_string("Error parsing OBJ data, line ", line_count, ": ", args...));
+        };
+
+        while (std::getline(is >> std::ws, line))
+        {
+            ++line_count;
 
-        std::istringstream ls(std::move(line));
+            if (line.empty()) continue;
 
-        std::string tag;
-        ls >> tag;
+            if (line[0] == '#') continue;
 
-        if (tag == "v")
+            std::istringstream ls(std::move(line));
+
+            std::string tag;
+            ls >> tag;
+
+            if (tag == "v")
+            {
+                auto & p = builder.positions.emplace_back();
+                ls >> p[0] >> p[1] >> p[2];
+            }
+            else if (tag == "vn")
+            {
+                auto & n = builder.normals.emplace_back();
+                ls >> n[0] >> n[1] >> n[2];
+            }
+            else if (tag == "vt")
+            {
+                auto & t = builder.texcoords.emplace_back();
+                ls >> t[0] >> t[1];
+            }
+            else if (tag == "f")
+            {
+                while (ls)
+                {
+                    std::array<std::int32_t, 3> index{0, 0, 0};
+                    bool has_texcoord = false;
+                    bool has_normal = false;
+
+                    ls >> index[0];
+                    // a successful read of the last index on the line sets eof too
+                    if (!ls && ls.eof()) break;
+                    if (!ls)
+                        fail("expected position index");
+
+                    if (!std::isspace(ls.peek()) && !ls.eof())
+                    {
+                        if (ls.get() != '/')
+                            fail("expected '/'");
+
+                        if (ls.peek() != '/')
+                        {
+                            ls >> index[1];
+                            if (!ls)
+                                fail("expected texcoord index");
+                            has_texcoord = true;
+
+                            if (!std::isspace(ls.peek()) && !ls.eof())
+                            {
+                                if (ls.get() != '/')
+                                    fail("expected '/'");
+
+                                ls >> index[2];
+                                if (!ls)
+                                    fail("expected normal index");
+                                has_normal = true;
+                            }
+                        }
+                        else
+                        {
+                            ls.get();
+
+                            ls >> index[2];
+                            if (!ls)
+                                fail("expected normal index");
+                            has_normal = true;
+                        }
+                    }
+
+                    builder.add_corner(index, has_texcoord, has_normal, fail);
+                }
+
+                builder.finish_face();
+            }
+        }
+
+        return std::move(builder.result);
+    }
+
+    bool is_space(char c)
+    {
+        return c == ' ' || c == '\t' || c == '\n' || c == '\v' || c == '\f' || c == '\r';
+    }
+
+    // A single line of a memory-mapped file, read with the same
+    // whitespace and number rules as std::istringstream::operator >>
+    struct line_scanner
+    {
+        char const * cur;
+        char const * end;
+
+        // like the stream's failbit, a failed read makes all further reads fail
+        bool good = true;
+
+        bool at_end() const
         {
-            auto & p = positions.emplace_back();
-            ls >> p[0] >> p[1] >> p[2];
+            return cur == end;
         }
-        else if (tag == "vn")
+
+        bool at_separator() const
         {
-            auto & n = normals.emplace_back();
-            ls >> n[0] >> n[1] >> n[2];
+            return cur == end || is_space(*cur);
         }
-        else if (tag == "vt")
+
+        void skip_spaces()
         {
-            auto & t = texcoords.emplace_back();
-            ls >> t[0] >> t[1];
+            while (cur != end && is_space(*cur))
+                ++cur;
         }
-        else if (tag == "f")
+
+        std::string_view word()
+        {
+            skip_spaces();
+            char const * begin = cur;
+            while (cur != end && !is_space(*cur))
+                ++cur;
+            return {begin, static_cast<std::size_t>(cur - begin)};
+        }
+
+        template <typename T>
+        bool number(T & value)
         {
-            std::vector<std::uint32_t> vertices;
+            if (!good)
+                return false;
 
-            while (ls)
+            skip_spaces();
+
+            char const * begin = cur;
+            // std::from_chars doesn't accept an explicit plus sign
+            if (begin != end && *begin == '+')
             {
-                std::array<std::int32_t, 3> index{0, 0, 0};
-                bool has_texcoord = false;
-                bool has_normal = false;
+                if (++begin != end && *begin == '-')
+                    return good = false;
+            }
 
-                ls >> index[0];
-                if (ls.eof()) break;
-                if (!ls)
-                    fail("expected position index");
+            auto [ptr, ec] = std::from_chars(begin, end, value);
+            if (ec != std::errc{})
+                return good = false;
 
-                if (!std::isspace(ls.peek()) && !ls.eof())
+            cur = ptr;
+            return true;
+        }
+    };
+
+    // Feeds every record in [cur, end), which has to start at the beginning of a line,
+    // to handler: attributes go to its positions, normals and texcoords arrays,
+    // faces to its add_corner and finish_face, just like for obj_builder
+    template <typename Handler, typename Fail>
+    void scan_obj(char const * cur, char const * end, std::size_t & line_count, Handler & handler, Fail const & fail)
+    {
+        while (true)
+        {
+            while (cur != end && is_space(*cur))
+                ++cur;
+
+            if (cur == end) break;
+
+            char const * line_end = static_cast<char const *>(std::memchr(cur, '\n', end - cur));
+            if (!line_end)
+                line_end = end;
+
+            line_scanner ls{cur, line_end};
+            cur = line_end;
+
+            ++line_count;
+
+            if (*ls.cur == '#') continue;
+
+            auto tag = ls.word();
+
+            if (tag == "v")
+            {
+                auto & p = handler.positions.emplace_back();
+                ls.number(p[0]);
+                ls.number(p[1]);
+                ls.number(p[2]);
+            }
+            else if (tag == "vn")
+            {
+                auto & n = handler.normals.emplace_back();
+                ls.number(n[0]);
+                ls.number(n[1]);
+                ls.number(n[2]);
+            }
+            else if (tag == "vt")
+            {
+                auto & t = handler.texcoords.emplace_back();
+                ls.number(t[0]);
+                ls.number(t[1]);
+            }
+            else if (tag == "f")
+            {
+                while (true)
                 {
-                    if (ls.get() != '/')
-                        fail("expected '/'");
+                    std::array<std::int32_t, 3> index{0, 0, 0};
+                    bool has_texcoord = false;
+                    bool has_normal = false;
+
+                    ls.skip_spaces();
+                    if (ls.at_end()) break;
 
-                    if (ls.peek() != '/')
+                    if (!ls.number(index[0]))
+                        fail("expected position index");
+
+                    if (!ls.at_separator())
                     {
-                        ls >> index[1];
-                        if (!ls)
-                            fail("expected texcoord index");
-                        has_texcoord = true;
+                        if (*ls.cur++ != '/')
+                            fail("expected '/'");
 
-                        if (!std::isspace(ls.peek()) && !ls.eof())
+                        if (ls.at_end() || *ls.cur != '/')
                         {
-                            if (ls.get() != '/')
-                                fail("expected '/'");
+                            if (!ls.number(index[1]))
+                                fail("expected texcoord index");
+                            has_texcoord = true;
+
+                            if (!ls.at_separator())
+                            {
+                                if (*ls.cur++ != '/')
+                                    fail("expected '/'");
+
+                                if (!ls.number(index[2]))
+                                    fail("expected normal index");
+                                has_normal = true;
+                            }
+                        }
+                        else
+                        {
+                            ++ls.cur;
 
-                            ls >> index[2];
-                            if (!ls)
+                            if (!ls.number(index[2]))
                                 fail("expected normal index");
                             has_normal = true;
                         }
                     }
-                    else
-                    {
-                        ls.get();
 
-                        ls >> index[2];
-                        if (!ls)
-                            fail("expected normal index");
-                        has_normal = true;
-                    }
+                    handler.add_corner(index, has_texcoord, has_normal, fail);
                 }
 
-                if (index[0] > 0)
-                    --index[0];
-                else
-                    index[0] = positions.size() + index[0];
+                handler.finish_face();
+            }
+        }
+    }
 
-                if (has_texcoord)
-                {
-                    if (index[1] > 0)
-                        --index[1];
-                    else
-                        index[1] = texcoords.size() + index[1];
-                }
-                else
-                    index[1] = -1;
+    // Number of lines starting with an 'f' tag, which is a cheap estimate
+    // of the number of unique vertices in a typical triangle mesh
+    std::size_t count_faces(std::string_view data)
+    {
+        std::size_t count = 0;
+        for (std::size_t i = data.find('f'); i != data.npos; i = data.find('f', i + 1))
+        {
+            if ((i == 0 || data[i - 1] == '\n') && i + 1 < data.size() && is_space(data[i + 1]))
+                ++count;
+        }
+        return count;
+    }
 
-                if (has_normal)
-                {
-                    if (index[2] > 0)
-                        --index[2];
-                    else
-                        index[2] = normals.size() + index[2];
-                }
-                else
-                    index[2] = -1;
+    obj_data parse_obj_mapped(std::filesystem::path const & path)
+    {
+        mapped_file file(path);
 
-                if (index[0] >= positions.size())
-                    fail("bad position index (", index[0], ")");
+        obj_builder builder;
 
-                if (index[1] != -1 && index[1] >= texcoords.size())
-                    fail("bad texcoord index (", index[1], ")");
+        std::size_t line_count = 0;
 
-                if (index[2] != -1 && index[2] >= normals.size())
-                    fail("bad normal index (", index[2], ")");
+        auto fail = [&](auto const & ... args){
+            throw std::runtime_error(to_string("Error parsing OBJ data, line ", line_count, ": ", args...));
+        };
 
-                auto it = index_map.find(index);
-                if (it == index_map.end())
-                {
-                    it = index_map.insert({index, result.vertices.size()}).first;
+        builder.index_map.reserve(count_faces(file.view()));
 
-                    auto & v = result.vertices.emplace_back();
+        scan_obj(file.data(), file.data() + file.size(), line_count, builder, fail);
 
-                    v.position = positions[index[0]];
+        return std::move(builder.result);
+    }
 
-                    if (index[1] != -1)
-                        v.texcoord = texcoords[index[1]];
-                    else
-                        v.texcoord = {0.f, 0.f};
+    // A line-aligned part of a file, parsed independently of the others:
+    // attributes are stored as is, while face corners are kept unresolved
+    // together with the attribute counts that relative indices refer to
+    struct obj_chunk
+    {
+        struct corner
+        {
+            std::array<std::int32_t, 3> index;
+            bool has_texcoord;
+            bool has_normal;
+        };
 
-                    if (index[2] != -1)
-                        v.normal = normals[index[2]];
-                    else
-                        v.normal = {0.f, 0.f, 0.f};
-                }
+        struct face
+        {
+            // line number within the chunk
+            std::size_t line;
+            // end of the face's corners in the corners array
+            std::size_t corners_end;
+            // positions, texcoords and normals defined in the chunk before the face
+            std::array<std::size_t, 3> counts;
+        };
+
+        std::vector<std::array<float, 3>> positions;
+        std::vector<std::array<float, 3>> normals;
+        std::vector<std::array<float, 2>> texcoords;
+
+        std::vector<corner> corners;
+        std::vector<face> faces;
+
+        std::size_t line_count = 0;
+
+        // Scanning stops at the first error, which is reported only after
+        // everything preceding it in the file has been merged
+        std::optional<std::string> error;
+        std::exception_ptr exception;
+
+        template <typename Fail>
+        void add_corner(std::array<std::int32_t, 3> index, bool has_texcoord, bool has_normal, Fail const &)
+        {
+            corners.push_back({index, has_texcoord, has_normal});
+        }
 
-                vertices.push_back(it->second);
-            }
+        void finish_face()
+        {
+            faces.push_back({line_count, corners.size(), {positions.size(), texcoords.size(), normals.size()}});
+        }
+    };
+
+    struct chunk_error
+    {
+        std::string message;
+    };
+
+    void parse_chunk(obj_chunk & chunk, char const * begin, char const * end)
+    {
+        auto fail = [](auto const & ... args){
+            throw chunk_error{to_string(args...)};
+        };
+
+        try
+        {
+            scan_obj(begin, end, chunk.line_count, chunk, fail);
+        }
+        catch (chunk_error & e)
+        {
+            chunk.error = std::move(e.message);
+        }
+        catch (...)
+        {
+            chunk.exception = std::current_exception();
+        }
+    }
+
+    // Splitting smaller files costs more than it saves
+    constexpr std::size_t min_chunk_size = 1 << 20;
+}
+
+obj_data parse_obj_parallel(std::filesystem::path const & path, std::size_t chunk_count)
+{
+    mapped_file file(path);
+
+    char const * const begin = file.data();
+    char const * const end = begin + file.size();
+
+    if (chunk_count == 0)
+    {
+        std::size_t const thread_count = std::max<std::size_t>(1, std::thread::hardware_concurrency());
+        chunk_count = std::clamp<std::size_t>(file.size() / min_chunk_size, 1, thread_count);
+    }
+
+    // Chunks start at line starts, so that every line belongs to exactly one chunk
+    std::vector<char const *> bounds{begin};
+    for (std::size_t i = 1; i < chunk_count; ++i)
+    {
+        char const * bound = std::max(bounds.back(), begin + file.size() * i / chunk_count);
+        if (auto newline = static_cast<char const *>(std::memchr(bound, '\n', end - bound)))
+            bound = newline + 1;
+        else
+            bound = end;
+        bounds.push_back(bound);
+    }
+    bounds.push_back(end);
+
+    std::vector<obj_chunk> chunks(chunk_count);
+
+    {
+        std::vector<std::thread> threads;
+        for (std::size_t i = 1; i < chunk_count; ++i)
+            threads.emplace_back(parse_chunk, std::ref(chunks[i]), bounds[i], bounds[i + 1]);
+
+        parse_chunk(chunks[0], bounds[0], bounds[1]);
+
+        for (auto & thread : threads)
+            thread.join();
+    }
+
+    // Corners are resolved and deduplicated serially in file order,
+    // which gives exactly the vertex order and errors of the serial parser
+    obj_builder builder;
+
+    {
+        std::size_t face_count = 0;
+        for (auto const & chunk : chunks)
+            face_count += chunk.faces.size();
+        builder.index_map.reserve(face_count);
+    }
+
+    std::size_t line_count = 0;
+
+    auto fail = [&](auto const & ... args){
+        throw std::runtime_error(to_string("Error parsing OBJ data, line ", line_count, ": ", args...));
+    };
 
-            for (std::size_t i = 1; i + 1 < vertices.size(); ++i)
+    std::size_t line_offset = 0;
+
+    for (auto & chunk : chunks)
+    {
+        if (chunk.exception)
+            std::rethrow_exception(chunk.exception);
+
+        std::array<std::size_t, 3> const offset{builder.positions.size(), builder.texcoords.size(), builder.normals.size()};
+
+        builder.positions.insert(builder.positions.end(), chunk.positions.begin(), chunk.positions.end());
+        builder.texcoords.insert(builder.texcoords.end(), chunk.texcoords.begin(), chunk.texcoords.end());
+        builder.normals.insert(builder.normals.end(), chunk.normals.begin(), chunk.normals.end());
+
+        std::size_t corner = 0;
+
+        auto add_corners = [&](std::size_t corners_end, std::array<std::size_t, 3> const & counts)
+        {
+            std::array<std::size_t, 3> const global_counts{offset[0] + counts[0], offset[1] + counts[1], offset[2] + counts[2]};
+
+            for (; corner < corners_end; ++corner)
             {
-                result.indices.push_back(vertices[0]);
-                result.indices.push_back(vertices[i]);
-                result.indices.push_back(vertices[i + 1]);
+                auto const & c = chunk.corners[corner];
+                builder.add_corner(c.index, c.has_texcoord, c.has_normal, global_counts, fail);
             }
+        };
+
+        for (auto const & face : chunk.faces)
+        {
+            line_count = line_offset + face.line;
+            add_corners(face.corners_end, face.counts);
+            builder.finish_face();
         }
+
+        if (chunk.error)
+        {
+            // Corners preceding the error on its line are still checked first
+            line_count = line_offset + chunk.line_count;
+            add_corners(chunk.corners.size(), {chunk.positions.size(), chunk.texcoords.size(), chunk.normals.size()});
+            fail(*chunk.error);
+        }
+
+        line_offset += chunk.line_count;
+
+        chunk = obj_chunk{};
+    }
+
+    return std::move(builder.result);
+}
+
+obj_data parse_obj(std::filesystem::path const & path, obj_parse_mode mode)
+{
+    switch (mode)
+    {
+    case obj_parse_mode::stream:
+        return parse_obj_stream(path);
+    case obj_parse_mode::mapped:
+        return parse_obj_mapped(path);
+    case obj_parse_mode::parallel:
+        return parse_obj_parallel(path, 0);
     }
 
-    return result;
+    throw std::runtime_error("Unknown OBJ parse mode");
+}
+
+void parse_obj_blocks(std::filesystem::path const & path, std::size_t block_size, std::function<void(obj_block const &)> const & callback)
+{
+    if (block_size < 3)
+        throw std::runtime_error("OBJ block size must fit at least one triangle");
+
+    mapped_file file(path);
+
+    obj_builder builder;
+    builder.on_block = callback;
+    builder.block_size = block_size;
+    builder.index_map.reserve(count_faces(file.view()));
+
+    std::size_t line_count = 0;
+
+    auto fail = [&](auto const & ... args){
+        throw std::runtime_error(to_string("Error parsing OBJ data, line ", line_count, ": ", args...));
+    };
+
+    scan_obj(file.data(), file.data() + file.size(), line_count, builder, fail);
+
+    builder.flush();
 }
@@ -2,6 +2,8 @@
 
 #include <array>
 #include <vector>
+#include <span>
+#include <functional>
 #include <filesystem>
 
 struct obj_data
@@ -17,4 +19,34 @@ struct obj_data
     std::vector<std::uint32_t> indices;
 };
 
-obj_data parse_obj(std::filesystem::path const & path);
+enum class obj_parse_mode
+{
+    // std::getline + std::istringstream per line
+    stream,
+    // memory-mapped file scanned in place with std::from_chars
+    mapped,
+    // like mapped, with line-aligned chunks of the file scanned on all cores
+    parallel,
+};
+
+obj_data parse_obj(std::filesystem::path const & path, obj_parse_mode mode = obj_parse_mode::mapped);
+
+// parse_obj in parallel mode, with the file split into chunk_count chunks scanned on as many threads.
+// The result doesn't depend on the chunk count; 0 picks it from the file size and the number of cores
+obj_data parse_obj_parallel(std::filesystem::path const & path, std::size_t chunk_count);
+
+struct obj_block
+{
+    // Vertices first referenced since the previous block,
+    // the first one having index first_vertex in the whole mesh
+    std::span<obj_data::vertex const> vertices;
+    std::uint32_t first_vertex;
+
+    // Triangles, which may reference vertices of this or any earlier block
+    std::span<std::uint32_t const> indices;
+};
+
+// Parses the file like parse_obj in mapped mode, but instead of collecting the whole mesh
+// passes it to callback in blocks of at most block_size vertices and block_size indices.
+// The block's data is only valid during the call
+void parse_obj_blocks(std::filesystem::path const & path, std::size_t block_size, std::function<void(obj_block const &)> const & callback);
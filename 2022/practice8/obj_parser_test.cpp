@@ -0,0 +1,131 @@
+// Parses the OBJ models of the other practices and a generated file in every parse_obj mode,
+// and in parallel mode with several forced chunk counts, and checks that the vertex and
+// index arrays are byte-for-byte equal to the ones of the stream parser. The generated file
+// interleaves attributes and faces, so that negative indices reach back across chunk bounds,
+// and mixes the corner formats, polygons, comments, blank lines and CRLF line ends
+
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "obj_parser.hpp"
+
+// Faces reference up to this many attributes back, using negative indices about half the time
+constexpr int reach = 40;
+
+void write_test_obj(std::filesystem::path const & path)
+{
+    std::ofstream os(path, std::ios::binary);
+    if (!os)
+        throw std::runtime_error("Failed to create " + path.string());
+
+    std::mt19937 rng(12345);
+    auto uniform_int = [&](int min, int max){ return std::uniform_int_distribution<int>(min, max)(rng); };
+    auto uniform = [&]{ return std::uniform_real_distribution<float>(-10.f, 10.f)(rng); };
+
+    int positions = 0, texcoords = 0, normals = 0;
+
+    // Either 1-based or relative to the end, for an attribute at most reach back
+    auto index = [&](int count)
+    {
+        int back = uniform_int(1, std::min(count, reach));
+        return std::to_string(uniform_int(0, 1) ? count - back + 1 : -back);
+    };
+
+    for (int block = 0; block < 400; ++block)
+    {
+        char const * eol = (block % 7 == 3) ? "\r\n" : "\n";
+
+        for (int i = uniform_int(1, 6); i > 0; --i, ++positions)
+            os << "v " << uniform() << ' ' << uniform() << ' ' << uniform() << eol;
+        for (int i = uniform_int(0, 3); i > 0; --i, ++texcoords)
+            os << "vt " << uniform() << ' ' << uniform() << eol;
+        for (int i = uniform_int(0, 3); i > 0; --i, ++normals)
+            os << "vn " << uniform() << ' ' << uniform() << ' ' << uniform() << eol;
+
+        if (block % 5 == 0)
+            os << "# block " << block << eol << eol;
+
+        for (int f = uniform_int(1, 8); f > 0; --f)
+        {
+            // Same format for all corners of a face, one of v, v/t, v//n and v/t/n
+            int const format = uniform_int(0, 3);
+            bool const texcoord = (format & 1) && texcoords > 0;
+            bool const normal = (format & 2) && normals > 0;
+
+            os << 'f';
+            for (int c = uniform_int(3, 5); c > 0; --c)
+            {
+                os << ' ' << index(positions);
+                if (texcoord && normal)
+                    os << '/' << index(texcoords) << '/' << index(normals);
+                else if (texcoord)
+                    os << '/' << index(texcoords);
+                else if (normal)
+                    os << "//" << index(normals);
+            }
+            os << eol;
+        }
+    }
+}
+
+bool same_bytes(obj_data const & a, obj_data const & b)
+{
+    return a.vertices.size() == b.vertices.size() && a.indices.size() == b.indices.size()
+        && std::memcmp(a.vertices.data(), b.vertices.data(), a.vertices.size() * sizeof(obj_data::vertex)) == 0
+        && std::memcmp(a.indices.data(), b.indices.data(), a.indices.size() * sizeof(std::uint32_t)) == 0;
+}
+
+int main() try
+{
+    std::string const project_root = PROJECT_ROOT;
+    std::filesystem::path const generated = std::filesystem::temp_directory_path() / "obj_parser_test.obj";
+    write_test_obj(generated);
+
+    std::filesystem::path const models[] =
+    {
+        project_root + "/../practice4/bunny_lowres.obj",
+        project_root + "/../practice5/cow.obj",
+        project_root + "/../practice7/suzanne.obj",
+        generated,
+    };
+    std::size_t const chunk_counts[] = {1, 2, 3, 7, 64};
+
+    int failures = 0;
+
+    for (auto const & path : models)
+    {
+        obj_data const expected = parse_obj(path, obj_parse_mode::stream);
+
+        auto check = [&](std::string const & mode, obj_data const & actual)
+        {
+            if (!same_bytes(actual, expected))
+            {
+                std::cerr << path.filename().string() << ": " << mode << " differs from stream" << std::endl;
+                ++failures;
+            }
+        };
+
+        check("mapped", parse_obj(path, obj_parse_mode::mapped));
+        check("parallel", parse_obj(path, obj_parse_mode::parallel));
+        for (std::size_t chunk_count : chunk_counts)
+            check("parallel in " + std::to_string(chunk_count) + " chunks", parse_obj_parallel(path, chunk_count));
+
+        std::cout << path.filename().string() << ": " << expected.vertices.size() << " vertices, " << expected.indices.size() << " indices" << std::endl;
+    }
+
+    std::filesystem::remove(generated);
+
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+catch (std::exception const & e)
+{
+    std::cerr << e.what() << std::endl;
+    return EXIT_FAILURE;
+}
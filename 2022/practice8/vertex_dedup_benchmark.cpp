@@ -0,0 +1,179 @@
+// Deduplicates the (position, texcoord, normal) triples of face corners with the
+// std::map that parse_obj used before and with vertex_index_map, and prints the
+// time per corner of both. The corners come from suzanne.obj, cow.obj, any OBJ files
+// given as arguments, and a synthetic grid mesh of 10M corners built in memory.
+// Both tables must assign the same vertex to every corner
+
+#include <array>
+#include <charconv>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "vertex_index_map.hpp"
+
+using corner = std::array<std::int32_t, 3>;
+
+struct corner_list
+{
+    std::string name;
+    std::vector<corner> corners;
+    std::size_t face_count = 0;
+};
+
+// Resolves the corners of the f records to 0-based indices, -1 for a missing one.
+// Faces are not triangulated, which doesn't change the set of triples
+corner_list read_corners(std::filesystem::path const & path)
+{
+    std::ifstream is(path);
+    if (!is)
+        throw std::runtime_error("Failed to open " + path.string());
+
+    corner_list result;
+    result.name = path.filename().string();
+    std::array<std::int32_t, 3> counts{0, 0, 0};
+
+    std::string line;
+    while (std::getline(is, line))
+    {
+        std::string_view rest = line;
+        if (rest.starts_with("v "))
+            ++counts[0];
+        else if (rest.starts_with("vt "))
+            ++counts[1];
+        else if (rest.starts_with("vn "))
+            ++counts[2];
+        else if (rest.starts_with("f "))
+        {
+            ++result.face_count;
+            rest.remove_prefix(2);
+            while (true)
+            {
+                while (!rest.empty() && (rest.front() == ' ' || rest.front() == '\r'))
+                    rest.remove_prefix(1);
+                if (rest.empty())
+                    break;
+
+                corner c{-1, -1, -1};
+                for (int i = 0; i < 3 && !rest.empty() && rest.front() != ' '; ++i)
+                {
+                    if (rest.front() != '/')
+                    {
+                        std::int32_t value = 0;
+                        auto [end, error] = std::from_chars(rest.data(), rest.data() + rest.size(), value);
+                        if (error != std::errc())
+                            throw std::runtime_error("Bad face in " + path.string() + ": " + line);
+                        rest.remove_prefix(end - rest.data());
+                        c[i] = (value > 0) ? value - 1 : counts[i] + value;
+                    }
+                    if (!rest.empty() && rest.front() == '/')
+                        rest.remove_prefix(1);
+                }
+                result.corners.push_back(c);
+            }
+        }
+    }
+
+    return result;
+}
+
+// Two triangles per cell of a grid, every corner sharing its position, texcoord and normal index
+corner_list synthetic_grid(std::size_t corner_count)
+{
+    std::int32_t cells = 1;
+    while (6 * std::size_t(cells + 1) * std::size_t(cells + 1) <= corner_count)
+        ++cells;
+
+    corner_list result;
+    result.name = "synthetic " + std::to_string(cells) + "x" + std::to_string(cells) + " grid";
+    result.corners.reserve(6 * std::size_t(cells) * cells);
+
+    std::int32_t const row = cells + 1;
+    for (std::int32_t y = 0; y < cells; ++y)
+    {
+        for (std::int32_t x = 0; x < cells; ++x)
+        {
+            std::int32_t const v = y * row + x;
+            for (std::int32_t i : {v, v + 1, v + row + 1, v, v + row + 1, v + row})
+                result.corners.push_back({i, i, i});
+            result.face_count += 2;
+        }
+    }
+
+    return result;
+}
+
+template <typename Function>
+double time_ms(Function const & function)
+{
+    auto const start = std::chrono::steady_clock::now();
+    function();
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+bool run(corner_list const & list)
+{
+    std::vector<std::uint32_t> map_indices, hash_indices;
+    map_indices.reserve(list.corners.size());
+    hash_indices.reserve(list.corners.size());
+    std::size_t map_vertices = 0, hash_vertices = 0;
+
+    double const map_ms = time_ms([&]
+    {
+        std::map<corner, std::uint32_t> index_map;
+        for (auto const & c : list.corners)
+            map_indices.push_back(index_map.emplace(c, std::uint32_t(index_map.size())).first->second);
+        map_vertices = index_map.size();
+    });
+
+    double const hash_ms = time_ms([&]
+    {
+        // Sized from the number of f records, like parse_obj does
+        vertex_index_map index_map;
+        index_map.reserve(list.face_count);
+        for (auto const & c : list.corners)
+            hash_indices.push_back(index_map.insert(c, std::uint32_t(index_map.size)).first);
+        hash_vertices = index_map.size;
+    });
+
+    double const corners = double(list.corners.size());
+    std::cout << list.name << ": " << list.corners.size() << " corners, " << hash_vertices << " vertices; std::map "
+        << map_ms << " ms (" << map_ms * 1e6 / corners << " ns/corner), vertex_index_map " << hash_ms << " ms ("
+        << hash_ms * 1e6 / corners << " ns/corner), " << map_ms / hash_ms << "x faster" << std::endl;
+
+    if (map_indices != hash_indices || map_vertices != hash_vertices)
+    {
+        std::cerr << list.name << ": the tables assign different vertices" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char ** argv) try
+{
+    std::string const project_root = PROJECT_ROOT;
+
+    std::vector<std::filesystem::path> paths{project_root + "/../practice7/suzanne.obj", project_root + "/../practice5/cow.obj"};
+    for (int i = 1; i < argc; ++i)
+        paths.push_back(argv[i]);
+
+    bool ok = true;
+    for (auto const & path : paths)
+        ok = run(read_corners(path)) && ok;
+    ok = run(synthetic_grid(10'000'000)) && ok;
+
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+catch (std::exception const & e)
+{
+    std::cerr << e.what() << std::endl;
+    return EXIT_FAILURE;
+}
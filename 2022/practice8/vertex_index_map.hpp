@@ -0,0 +1,77 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+// Open addressing hash table with linear probing from (position, texcoord, normal)
+// index triples to vertex indices. Compared to std::map it needs no allocation
+// per vertex and a lookup usually touches a single cache line
+struct vertex_index_map
+{
+    struct slot
+    {
+        std::array<std::int32_t, 3> key;
+        std::uint32_t value;
+    };
+
+    static constexpr std::uint32_t empty = -1;
+
+    std::vector<slot> slots;
+    std::size_t size = 0;
+
+    static std::size_t hash(std::array<std::int32_t, 3> const & key)
+    {
+        std::uint64_t h = std::uint64_t(std::uint32_t(key[0])) * 0x9e3779b97f4a7c15ull;
+        h ^= std::uint64_t(std::uint32_t(key[1])) * 0xc2b2ae3d27d4eb4full;
+        h ^= std::uint64_t(std::uint32_t(key[2])) * 0x165667b19e3779f9ull;
+        h ^= h >> 29;
+        h *= 0xbf58476d1ce4e5b9ull;
+        h ^= h >> 32;
+        return h;
+    }
+
+    // Keeps the load factor under 1/2 for the given number of keys
+    void reserve(std::size_t count)
+    {
+        std::size_t capacity = 16;
+        while (capacity < 2 * count)
+            capacity *= 2;
+
+        if (capacity <= slots.size())
+            return;
+
+        std::vector<slot> old(capacity, slot{{0, 0, 0}, empty});
+        std::swap(slots, old);
+
+        for (auto const & s : old)
+            if (s.value != empty)
+                slots[find(s.key)] = s;
+    }
+
+    // Slot containing the key, or the empty slot where it should be inserted
+    std::size_t find(std::array<std::int32_t, 3> const & key) const
+    {
+        std::size_t const mask = slots.size() - 1;
+        std::size_t i = hash(key) & mask;
+        while (slots[i].value != empty && slots[i].key != key)
+            i = (i + 1) & mask;
+        return i;
+    }
+
+    // Returns the value stored for the key and whether it was inserted just now
+    std::pair<std::uint32_t, bool> insert(std::array<std::int32_t, 3> const & key, std::uint32_t value)
+    {
+        if (2 * (size + 1) > slots.size())
+            reserve(size + 1);
+
+        auto & s = slots[find(key)];
+        if (s.value != empty)
+            return {s.value, false};
+
+        s = {key, value};
+        ++size;
+        return {value, true};
+    }
+};
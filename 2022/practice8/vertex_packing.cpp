@@ -0,0 +1,235 @@
+#include "vertex_packing.hpp"
+
+#include <glm/common.hpp>
+#include <glm/gtc/packing.hpp>
+
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+namespace
+{
+
+    std::size_t align4(std::size_t offset)
+    {
+        return (offset + 3) & ~std::size_t(3);
+    }
+
+    std::size_t position_size(position_format format)
+    {
+        switch (format)
+        {
+        case position_format::float32: return 3 * sizeof(float);
+        case position_format::unorm16: return 3 * sizeof(std::uint16_t);
+        }
+        return 0;
+    }
+
+    std::size_t normal_size(normal_format format)
+    {
+        switch (format)
+        {
+        case normal_format::float32: return 3 * sizeof(float);
+        case normal_format::snorm8: return 3 * sizeof(std::int8_t);
+        case normal_format::octahedral16: return 2 * sizeof(std::int16_t);
+        }
+        return 0;
+    }
+
+    std::size_t texcoord_size(texcoord_format format)
+    {
+        switch (format)
+        {
+        case texcoord_format::float32: return 2 * sizeof(float);
+        case texcoord_format::float16: return 2 * sizeof(std::uint16_t);
+        case texcoord_format::none: return 0;
+        }
+        return 0;
+    }
+
+    template <typename T>
+    T snorm(float value)
+    {
+        constexpr float max = std::numeric_limits<T>::max();
+        return static_cast<T>(std::round(glm::clamp(value, -1.f, 1.f) * max));
+    }
+
+    std::uint16_t unorm16(float value)
+    {
+        return static_cast<std::uint16_t>(std::round(glm::clamp(value, 0.f, 1.f) * 65535.f));
+    }
+
+    float sign_not_zero(float value)
+    {
+        return value < 0.f ? -1.f : 1.f;
+    }
+
+    // Projects the unit sphere onto the octahedron |x| + |y| + |z| = 1
+    // and unfolds its lower half over the corners of the [-1, 1]^2 square
+    std::array<std::int16_t, 2> encode_octahedral(std::array<float, 3> const & n)
+    {
+        float l1 = std::abs(n[0]) + std::abs(n[1]) + std::abs(n[2]);
+        if (l1 == 0.f)
+            return {0, 0};
+
+        float x = n[0] / l1;
+        float y = n[1] / l1;
+
+        if (n[2] < 0.f)
+        {
+            float folded_x = (1.f - std::abs(y)) * sign_not_zero(x);
+            float folded_y = (1.f - std::abs(x)) * sign_not_zero(y);
+            x = folded_x;
+            y = folded_y;
+        }
+
+        return {snorm<std::int16_t>(x), snorm<std::int16_t>(y)};
+    }
+
+    template <typename T>
+    void store(std::uint8_t * dst, T const & value)
+    {
+        std::memcpy(dst, &value, sizeof(value));
+    }
+
+}
+
+packed_vertices pack_vertices(std::span<obj_data::vertex const> vertices, vertex_format const & format)
+{
+    packed_vertices result;
+    result.format = format;
+
+    result.normal_offset = align4(position_size(format.position));
+    result.texcoord_offset = align4(result.normal_offset + normal_size(format.normal));
+    result.stride = align4(result.texcoord_offset + texcoord_size(format.texcoord));
+
+    result.count = vertices.size();
+    result.data.assign(result.count * result.stride, 0);
+
+    result.position_offset = glm::vec3(0.f);
+    result.position_scale = glm::vec3(1.f);
+
+    glm::vec3 inverse_scale(1.f);
+
+    if (format.position == position_format::unorm16 && !vertices.empty())
+    {
+        glm::vec3 min(std::numeric_limits<float>::infinity());
+        glm::vec3 max(-std::numeric_limits<float>::infinity());
+
+        for (auto const & v : vertices)
+        {
+            glm::vec3 p{v.position[0], v.position[1], v.position[2]};
+            min = glm::min(min, p);
+            max = glm::max(max, p);
+        }
+
+        result.position_offset = min;
+        result.position_scale = max - min;
+
+        for (int i = 0; i < 3; ++i)
+            inverse_scale[i] = result.position_scale[i] > 0.f ? 1.f / result.position_scale[i] : 0.f;
+    }
+
+    for (std::size_t i = 0; i < vertices.size(); ++i)
+    {
+        auto const & v = vertices[i];
+        std::uint8_t * dst = result.data.data() + i * result.stride;
+
+        switch (format.position)
+        {
+        case position_format::float32:
+            store(dst, v.position);
+            break;
+        case position_format::unorm16:
+            store(dst, std::array<std::uint16_t, 3>{
+                unorm16((v.position[0] - result.position_offset.x) * inverse_scale.x),
+                unorm16((v.position[1] - result.position_offset.y) * inverse_scale.y),
+                unorm16((v.position[2] - result.position_offset.z) * inverse_scale.z),
+            });
+            break;
+        }
+
+        dst += result.normal_offset;
+
+        switch (format.normal)
+        {
+        case normal_format::float32:
+            store(dst, v.normal);
+            break;
+        case normal_format::snorm8:
+            store(dst, std::array<std::int8_t, 3>{
+                snorm<std::int8_t>(v.normal[0]),
+                snorm<std::int8_t>(v.normal[1]),
+                snorm<std::int8_t>(v.normal[2]),
+            });
+            break;
+        case normal_format::octahedral16:
+            store(dst, encode_octahedral(v.normal));
+            break;
+        }
+
+        dst += result.texcoord_offset - result.normal_offset;
+
+        switch (format.texcoord)
+        {
+        case texcoord_format::float32:
+            store(dst, v.texcoord);
+            break;
+        case texcoord_format::float16:
+            store(dst, std::array<std::uint16_t, 2>{
+                glm::packHalf1x16(v.texcoord[0]),
+                glm::packHalf1x16(v.texcoord[1]),
+            });
+            break;
+        case texcoord_format::none:
+            break;
+        }
+    }
+
+    return result;
+}
+
+void setup_vertex_attributes(packed_vertices const & vertices, GLuint position_location, GLuint normal_location, GLuint texcoord_location)
+{
+    GLsizei const stride = vertices.stride;
+
+    glEnableVertexAttribArray(position_location);
+    switch (vertices.format.position)
+    {
+    case position_format::float32:
+        glVertexAttribPointer(position_location, 3, GL_FLOAT, GL_FALSE, stride, (void *)(0));
+        break;
+    case position_format::unorm16:
+        glVertexAttribPointer(position_location, 3, GL_UNSIGNED_SHORT, GL_TRUE, stride, (void *)(0));
+        break;
+    }
+
+    glEnableVertexAttribArray(normal_location);
+    switch (vertices.format.normal)
+    {
+    case normal_format::float32:
+        glVertexAttribPointer(normal_location, 3, GL_FLOAT, GL_FALSE, stride, (void *)(vertices.normal_offset));
+        break;
+    case normal_format::snorm8:
+        glVertexAttribPointer(normal_location, 3, GL_BYTE, GL_TRUE, stride, (void *)(vertices.normal_offset));
+        break;
+    case normal_format::octahedral16:
+        glVertexAttribPointer(normal_location, 2, GL_SHORT, GL_TRUE, stride, (void *)(vertices.normal_offset));
+        break;
+    }
+
+    switch (vertices.format.texcoord)
+    {
+    case texcoord_format::float32:
+        glEnableVertexAttribArray(texcoord_location);
+        glVertexAttribPointer(texcoord_location, 2, GL_FLOAT, GL_FALSE, stride, (void *)(vertices.texcoord_offset));
+        break;
+    case texcoord_format::float16:
+        glEnableVertexAttribArray(texcoord_location);
+        glVertexAttribPointer(texcoord_location, 2, GL_HALF_FLOAT, GL_FALSE, stride, (void *)(vertices.texcoord_offset));
+        break;
+    case texcoord_format::none:
+        break;
+    }
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include "obj_parser.hpp"
+
+#include <GL/glew.h>
+
+#include <glm/vec3.hpp>
+
+#include <span>
+#include <vector>
+#include <cstdint>
+
+enum class position_format
+{
+    float32,
+    // 3 x GL_UNSIGNED_SHORT normalized to [0, 1] within the mesh bounding box,
+    // restored in the shader as position_offset + position_scale * position
+    unorm16,
+};
+
+enum class normal_format
+{
+    float32,
+    // 3 x GL_BYTE normalized to [-1, 1]
+    snorm8,
+    // 2 x GL_SHORT normalized to [-1, 1], octahedral mapping of the unit sphere
+    // onto a square; has to be decoded in the shader
+    octahedral16,
+};
+
+enum class texcoord_format
+{
+    float32,
+    // 2 x GL_HALF_FLOAT
+    float16,
+    // texcoords are not stored at all
+    none,
+};
+
+struct vertex_format
+{
+    position_format position = position_format::float32;
+    normal_format normal = normal_format::float32;
+    texcoord_format texcoord = texcoord_format::float32;
+};
+
+struct packed_vertices
+{
+    vertex_format format;
+
+    // Byte layout of a single vertex; every attribute starts at a multiple of 4 bytes
+    std::size_t stride;
+    std::size_t normal_offset;
+    std::size_t texcoord_offset;
+
+    std::size_t count;
+    std::vector<std::uint8_t> data;
+
+    // Identity for float32 positions
+    glm::vec3 position_offset;
+    glm::vec3 position_scale;
+};
+
+packed_vertices pack_vertices(std::span<obj_data::vertex const> vertices, vertex_format const & format);
+
+// Sets up the attribute pointers of the bound VAO for the packed vertices
+// stored in the bound GL_ARRAY_BUFFER; the texcoord location is ignored
+// for texcoord_format::none
+void setup_vertex_attributes(packed_vertices const & vertices, GLuint position_location, GLuint normal_location, GLuint texcoord_location);